@@ -0,0 +1,914 @@
+/*
+ * vaggr.c - Aggregate capture device for synchronized grabbers
+ *
+ * The aggregate device takes over the buffer queues of several capture
+ * devices and combines their frames into sets of frames whose timestamps
+ * are within a configurable tolerance. Applications get one file descriptor
+ * to poll and dequeue a single buffer per set, which tells them which buffer
+ * of each member holds the frame. The frame data itself stays in the member
+ * buffers, mapped through the member device nodes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version
+ */
+#include <linux/module.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/platform_device.h>
+#include <linux/vaggr.h>
+#include <media/v4l2-device.h>
+#include <media/v4l2-ioctl.h>
+#include <media/v4l2-ctrls.h>
+#include <media/v4l2-fh.h>
+#include <media/v4l2-event.h>
+#include <media/videobuf2-vmalloc.h>
+
+MODULE_DESCRIPTION("Aggregate capture device for synchronized grabbers");
+MODULE_LICENSE("GPL");
+MODULE_VERSION("0.1");
+
+#define VAGGR_NAME		"vaggr"
+#define VAGGR_MAX_DEVS		16
+
+/* Default timestamp tolerance in microseconds */
+#define VAGGR_DEF_TOLERANCE	10000
+
+static unsigned n_devs = 1;
+module_param(n_devs, uint, 0444);
+MODULE_PARM_DESC(n_devs, " number of aggregate devices to create");
+
+static unsigned debug;
+module_param(debug, uint, 0644);
+MODULE_PARM_DESC(debug, " activates debug info");
+
+#define dprintk(dev, fmt, arg...) \
+	v4l2_dbg(1, debug, &dev->v4l2_dev, "%s: " fmt, __func__, ## arg)
+
+struct vaggr_dev;
+
+/* A member capture device */
+struct vaggr_input {
+	struct vaggr_dev *dev;
+	struct file *file;
+	struct vb2_queue *q;
+	wait_queue_t wait;
+
+	/* Frames dequeued from the member, oldest first. Protected by slock. */
+	struct vaggr_frame fifo[VIDEO_MAX_FRAME];
+	unsigned int head;
+	unsigned int count;
+	/* Bitmask of member buffers to queue again. Protected by slock. */
+	u32 requeue;
+	unsigned long dropped;
+};
+
+struct vaggr_buffer {
+	struct vb2_v4l2_buffer vb;
+	struct list_head list;
+
+	/* Member buffers referenced by the set held in this buffer */
+	unsigned int generation;
+	unsigned int count;
+	u8 index[VAGGR_MAX_MEMBERS];
+};
+
+struct vaggr_dev {
+	struct v4l2_device v4l2_dev;
+	struct video_device vdev;
+	struct v4l2_ctrl_handler ctrl_handler;
+	struct vb2_queue queue;
+
+	/* Serializes ioctls and protects the members list */
+	struct mutex mutex;
+	struct vaggr_input inputs[VAGGR_MAX_MEMBERS];
+	unsigned int num_inputs;
+
+	/* Matches the frames, the only user of the member queues while
+	   streaming. */
+	struct work_struct work;
+
+	/* Protects the fields below and the input frame lists */
+	spinlock_t slock;
+	struct list_head buf_list;
+	u64 tolerance;
+	unsigned int sequence;
+	unsigned int generation;
+};
+
+static struct vaggr_dev *vaggr_devs[VAGGR_MAX_DEVS];
+
+static inline struct vaggr_buffer *to_vaggr_buffer(struct vb2_buffer *vb)
+{
+	return container_of(to_vb2_v4l2_buffer(vb), struct vaggr_buffer, vb);
+}
+
+/* ------------------------------------------------------------------
+	Frame matching
+   ------------------------------------------------------------------*/
+
+static void vaggr_init_v4l2_buffer(struct vaggr_input *in,
+				   struct v4l2_buffer *b, unsigned int index)
+{
+	memset(b, 0, sizeof(*b));
+	b->type = in->q->type;
+	b->memory = V4L2_MEMORY_MMAP;
+	b->index = index;
+}
+
+static struct vaggr_frame *vaggr_input_head(struct vaggr_input *in)
+{
+	return &in->fifo[in->head];
+}
+
+/* function expects dev->slock to be held by caller */
+static void vaggr_input_pop(struct vaggr_input *in, bool drop)
+{
+	if (drop) {
+		in->requeue |= BIT(vaggr_input_head(in)->index);
+		in->dropped++;
+	}
+	in->head = (in->head + 1) % VIDEO_MAX_FRAME;
+	in->count--;
+}
+
+/*
+ * Give the buffers released by the frame matching back to the member, and
+ * collect the frames it completed.
+ */
+static void vaggr_input_update(struct vaggr_input *in)
+{
+	struct vaggr_dev *dev = in->dev;
+	struct vb2_queue *q = in->q;
+	struct v4l2_buffer b;
+	struct vaggr_frame *frame;
+	u32 requeue;
+
+	spin_lock_irq(&dev->slock);
+	requeue = in->requeue;
+	in->requeue = 0;
+	spin_unlock_irq(&dev->slock);
+
+	mutex_lock(q->lock);
+
+	while (requeue) {
+		unsigned int index = __ffs(requeue);
+
+		requeue &= ~BIT(index);
+		vaggr_init_v4l2_buffer(in, &b, index);
+		vb2_qbuf(q, &b);
+	}
+
+	for (;;) {
+		vaggr_init_v4l2_buffer(in, &b, 0);
+		if (vb2_dqbuf(q, &b, true))
+			break;
+
+		if (!b.bytesused || (b.flags & V4L2_BUF_FLAG_ERROR)) {
+			vb2_qbuf(q, &b);
+			continue;
+		}
+
+		spin_lock_irq(&dev->slock);
+		frame = &in->fifo[(in->head + in->count) % VIDEO_MAX_FRAME];
+		frame->index = b.index;
+		frame->bytesused = b.bytesused;
+		frame->sequence = b.sequence;
+		frame->flags = b.flags;
+		frame->timestamp = timeval_to_ns(&b.timestamp);
+		in->count++;
+		spin_unlock_irq(&dev->slock);
+	}
+
+	mutex_unlock(q->lock);
+}
+
+/*
+ * Build as many frame sets as possible out of the dequeued frames. The oldest
+ * frame of each member is a set candidate. Candidates too old to match the
+ * newest one are dropped, and a set is complete when all candidates are
+ * within the tolerance. Sets are dropped when no buffer is queued, as
+ * capture drivers do with frames.
+ *
+ * Returns true when member buffers have to be queued again.
+ */
+static bool vaggr_match(struct vaggr_dev *dev)
+{
+	bool requeue = false;
+	unsigned int i;
+
+	assert_spin_locked(&dev->slock);
+
+	for (;;) {
+		struct vaggr_buffer *buf;
+		struct vaggr_set *set;
+		u64 newest = 0;
+		bool dropped = false;
+
+		for (i = 0; i < dev->num_inputs; i++) {
+			struct vaggr_input *in = &dev->inputs[i];
+
+			if (!in->count)
+				return requeue;
+			newest = max(newest, vaggr_input_head(in)->timestamp);
+		}
+
+		for (i = 0; i < dev->num_inputs; i++) {
+			struct vaggr_input *in = &dev->inputs[i];
+
+			if (vaggr_input_head(in)->timestamp + dev->tolerance <
+			    newest) {
+				vaggr_input_pop(in, true);
+				dropped = true;
+			}
+		}
+		if (dropped) {
+			requeue = true;
+			continue;
+		}
+
+		if (list_empty(&dev->buf_list)) {
+			for (i = 0; i < dev->num_inputs; i++)
+				vaggr_input_pop(&dev->inputs[i], true);
+			requeue = true;
+			continue;
+		}
+
+		buf = list_first_entry(&dev->buf_list, struct vaggr_buffer,
+				       list);
+		list_del(&buf->list);
+
+		set = vb2_plane_vaddr(&buf->vb.vb2_buf, 0);
+		memset(set, 0, sizeof(*set));
+		set->count = dev->num_inputs;
+		for (i = 0; i < dev->num_inputs; i++) {
+			struct vaggr_input *in = &dev->inputs[i];
+
+			set->frames[i] = *vaggr_input_head(in);
+			buf->index[i] = vaggr_input_head(in)->index;
+			vaggr_input_pop(in, false);
+		}
+		buf->count = dev->num_inputs;
+		buf->generation = dev->generation;
+
+		buf->vb.sequence = dev->sequence++;
+		buf->vb.field = V4L2_FIELD_NONE;
+		buf->vb.timestamp = ns_to_timeval(newest);
+		vb2_set_plane_payload(&buf->vb.vb2_buf, 0, sizeof(*set));
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+	}
+}
+
+static void vaggr_work(struct work_struct *work)
+{
+	struct vaggr_dev *dev = container_of(work, struct vaggr_dev, work);
+	unsigned int i;
+	bool again;
+
+	do {
+		for (i = 0; i < dev->num_inputs; i++)
+			vaggr_input_update(&dev->inputs[i]);
+
+		spin_lock_irq(&dev->slock);
+		again = vaggr_match(dev);
+		spin_unlock_irq(&dev->slock);
+	} while (again);
+}
+
+/* Called from vb2_buffer_done() of the member, possibly in interrupt */
+static int vaggr_input_wake(wait_queue_t *wait, unsigned mode, int sync,
+			    void *key)
+{
+	struct vaggr_input *in = container_of(wait, struct vaggr_input, wait);
+
+	schedule_work(&in->dev->work);
+	return 0;
+}
+
+/* ------------------------------------------------------------------
+	Members
+   ------------------------------------------------------------------*/
+
+static const struct v4l2_file_operations vaggr_fops;
+
+/* function expects dev->mutex to be held by caller */
+static int vaggr_add_input(struct vaggr_dev *dev, struct vaggr_member *m)
+{
+	struct vaggr_input *in;
+	struct video_device *vdev;
+	struct file *file;
+	unsigned int i;
+	int ret = -EINVAL;
+
+	if (vb2_is_streaming(&dev->queue))
+		return -EBUSY;
+	if (dev->num_inputs == VAGGR_MAX_MEMBERS)
+		return -ENOSPC;
+
+	file = fget(m->fd);
+	if (!file)
+		return -EBADF;
+
+	/* Only vb2 capture queues that can be locked on their own */
+	vdev = video_devdata_checked(file);
+	if (!vdev || vdev->fops == &vaggr_fops || !vdev->queue ||
+	    !vdev->queue->lock ||
+	    vdev->queue->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		goto err;
+
+	for (i = 0; i < dev->num_inputs; i++) {
+		if (dev->inputs[i].q == vdev->queue)
+			goto err;
+	}
+
+	in = &dev->inputs[dev->num_inputs];
+	memset(in, 0, sizeof(*in));
+	in->dev = dev;
+	in->file = file;
+	in->q = vdev->queue;
+	init_waitqueue_func_entry(&in->wait, vaggr_input_wake);
+
+	dprintk(dev, "member %u is %s\n", dev->num_inputs,
+		video_device_node_name(vdev));
+	dev->num_inputs++;
+	return 0;
+
+err:
+	fput(file);
+	return ret;
+}
+
+/* function expects dev->mutex to be held by caller */
+static void vaggr_clear_inputs(struct vaggr_dev *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < dev->num_inputs; i++)
+		fput(dev->inputs[i].file);
+	dev->num_inputs = 0;
+}
+
+/*
+ * Queue all buffers of a member and start it. The buffers must have been
+ * allocated with VIDIOC_REQBUFS on the member device node beforehand.
+ */
+static int vaggr_input_start(struct vaggr_input *in)
+{
+	struct vb2_queue *q = in->q;
+	struct v4l2_buffer b;
+	unsigned int i;
+	int ret;
+
+	mutex_lock(q->lock);
+
+	if (q->memory != V4L2_MEMORY_MMAP || !q->num_buffers ||
+	    q->fileio || vb2_is_streaming(q)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	for (i = 0; i < q->num_buffers; i++) {
+		if (q->bufs[i]->state != VB2_BUF_STATE_DEQUEUED)
+			continue;
+		vaggr_init_v4l2_buffer(in, &b, i);
+		ret = vb2_qbuf(q, &b);
+		if (ret)
+			goto cancel;
+	}
+
+	add_wait_queue(&q->done_wq, &in->wait);
+	ret = vb2_streamon(q, q->type);
+	if (!ret)
+		goto unlock;
+	remove_wait_queue(&q->done_wq, &in->wait);
+
+cancel:
+	/* Take the buffers we queued back */
+	vb2_streamoff(q, q->type);
+unlock:
+	mutex_unlock(q->lock);
+	return ret;
+}
+
+/*
+ * Stop the first count members. The wake ups are disconnected and the work
+ * is cancelled first, so that nothing dequeues from or queues to a member
+ * while it is being stopped. The frame lists are emptied last, the stream off
+ * reclaimed all member buffers they refer to.
+ */
+static void vaggr_stop_inputs(struct vaggr_dev *dev, unsigned int count)
+{
+	struct vaggr_input *in;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		remove_wait_queue(&dev->inputs[i].q->done_wq,
+				  &dev->inputs[i].wait);
+	cancel_work_sync(&dev->work);
+
+	for (i = 0; i < count; i++) {
+		in = &dev->inputs[i];
+		mutex_lock(in->q->lock);
+		vb2_streamoff(in->q, in->q->type);
+		mutex_unlock(in->q->lock);
+	}
+
+	spin_lock_irq(&dev->slock);
+	for (i = 0; i < count; i++) {
+		in = &dev->inputs[i];
+		dprintk(dev, "member %u dropped %lu frames\n", i, in->dropped);
+		in->head = 0;
+		in->count = 0;
+		in->requeue = 0;
+		in->dropped = 0;
+	}
+	/* Sets held by the application no longer refer to member buffers */
+	dev->generation++;
+	spin_unlock_irq(&dev->slock);
+}
+
+/* ------------------------------------------------------------------
+	Videobuf operations
+   ------------------------------------------------------------------*/
+
+static int queue_setup(struct vb2_queue *vq, const void *parg,
+		       unsigned int *nbuffers, unsigned int *nplanes,
+		       unsigned int sizes[], void *alloc_ctxs[])
+{
+	sizes[0] = sizeof(struct vaggr_set);
+	*nplanes = 1;
+
+	if (*nbuffers < 2)
+		*nbuffers = 2;
+
+	return 0;
+}
+
+static int buffer_init(struct vb2_buffer *vb)
+{
+	struct vaggr_buffer *buf = to_vaggr_buffer(vb);
+
+	buf->count = 0;
+	return 0;
+}
+
+static int buffer_prepare(struct vb2_buffer *vb)
+{
+	if (vb2_plane_size(vb, 0) < sizeof(struct vaggr_set))
+		return -EINVAL;
+
+	return 0;
+}
+
+static void buffer_queue(struct vb2_buffer *vb)
+{
+	struct vaggr_dev *dev = vb2_get_drv_priv(vb->vb2_queue);
+	struct vaggr_buffer *buf = to_vaggr_buffer(vb);
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&dev->slock, flags);
+
+	/* The application is done with the previous set in this buffer */
+	if (buf->generation == dev->generation) {
+		for (i = 0; i < buf->count; i++)
+			dev->inputs[i].requeue |= BIT(buf->index[i]);
+	}
+	buf->count = 0;
+
+	list_add_tail(&buf->list, &dev->buf_list);
+	spin_unlock_irqrestore(&dev->slock, flags);
+
+	/* Buffers queued before stream on are picked up by start_streaming */
+	if (vb2_start_streaming_called(vb->vb2_queue))
+		schedule_work(&dev->work);
+}
+
+static void vaggr_return_all_buffers(struct vaggr_dev *dev,
+				     enum vb2_buffer_state state)
+{
+	struct vaggr_buffer *buf, *node;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->slock, flags);
+	list_for_each_entry_safe(buf, node, &dev->buf_list, list) {
+		list_del(&buf->list);
+		vb2_buffer_done(&buf->vb.vb2_buf, state);
+	}
+	spin_unlock_irqrestore(&dev->slock, flags);
+}
+
+static int start_streaming(struct vb2_queue *vq, unsigned int count)
+{
+	struct vaggr_dev *dev = vb2_get_drv_priv(vq);
+	unsigned int i;
+	int ret = 0;
+
+	if (!dev->num_inputs) {
+		ret = -ENODEV;
+		goto err;
+	}
+
+	dev->sequence = 0;
+
+	for (i = 0; i < dev->num_inputs; i++) {
+		ret = vaggr_input_start(&dev->inputs[i]);
+		if (ret) {
+			dprintk(dev, "member %u failed to start (%d)\n",
+				i, ret);
+			vaggr_stop_inputs(dev, i);
+			goto err;
+		}
+	}
+
+	schedule_work(&dev->work);
+	return 0;
+
+err:
+	cancel_work_sync(&dev->work);
+	vaggr_return_all_buffers(dev, VB2_BUF_STATE_QUEUED);
+	return ret;
+}
+
+static void stop_streaming(struct vb2_queue *vq)
+{
+	struct vaggr_dev *dev = vb2_get_drv_priv(vq);
+
+	vaggr_stop_inputs(dev, dev->num_inputs);
+	vaggr_return_all_buffers(dev, VB2_BUF_STATE_ERROR);
+}
+
+static struct vb2_ops vaggr_qops = {
+	.queue_setup		= queue_setup,
+	.buf_init		= buffer_init,
+	.buf_prepare		= buffer_prepare,
+	.buf_queue		= buffer_queue,
+	.start_streaming	= start_streaming,
+	.stop_streaming		= stop_streaming,
+	.wait_prepare		= vb2_ops_wait_prepare,
+	.wait_finish		= vb2_ops_wait_finish,
+};
+
+/* ------------------------------------------------------------------
+	IOCTL vidioc handling
+   ------------------------------------------------------------------*/
+
+static int vidioc_querycap(struct file *file, void *priv,
+			   struct v4l2_capability *cap)
+{
+	struct vaggr_dev *dev = video_drvdata(file);
+
+	strlcpy(cap->driver, VAGGR_NAME, sizeof(cap->driver));
+	strlcpy(cap->card, VAGGR_NAME, sizeof(cap->card));
+	snprintf(cap->bus_info, sizeof(cap->bus_info),
+		 "platform:%s", dev->v4l2_dev.name);
+	cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+	return 0;
+}
+
+static int vidioc_enum_fmt_vid_cap(struct file *file, void *priv,
+				   struct v4l2_fmtdesc *f)
+{
+	if (f->index)
+		return -EINVAL;
+
+	f->pixelformat = V4L2_PIX_FMT_VAGGR_SET;
+	return 0;
+}
+
+static int vidioc_g_fmt_vid_cap(struct file *file, void *priv,
+				struct v4l2_format *f)
+{
+	struct vaggr_dev *dev = video_drvdata(file);
+	struct v4l2_pix_format *pix = &f->fmt.pix;
+
+	/* One "pixel" per member */
+	pix->width = max(dev->num_inputs, 1U);
+	pix->height = 1;
+	pix->pixelformat = V4L2_PIX_FMT_VAGGR_SET;
+	pix->field = V4L2_FIELD_NONE;
+	pix->bytesperline = sizeof(struct vaggr_set);
+	pix->sizeimage = sizeof(struct vaggr_set);
+	pix->colorspace = V4L2_COLORSPACE_RAW;
+	pix->priv = 0;
+	return 0;
+}
+
+static int vidioc_enum_input(struct file *file, void *priv,
+			     struct v4l2_input *inp)
+{
+	if (inp->index)
+		return -EINVAL;
+
+	inp->type = V4L2_INPUT_TYPE_CAMERA;
+	strlcpy(inp->name, "Members", sizeof(inp->name));
+	return 0;
+}
+
+static int vidioc_g_input(struct file *file, void *priv, unsigned int *i)
+{
+	*i = 0;
+	return 0;
+}
+
+static int vidioc_s_input(struct file *file, void *priv, unsigned int i)
+{
+	return i ? -EINVAL : 0;
+}
+
+static long vidioc_default(struct file *file, void *fh, bool valid_prio,
+			   unsigned int cmd, void *arg)
+{
+	struct vaggr_dev *dev = video_drvdata(file);
+
+	switch (cmd) {
+	case VAGGR_IOC_ADD_MEMBER:
+		return vaggr_add_input(dev, arg);
+
+	case VAGGR_IOC_CLEAR_MEMBERS:
+		if (vb2_is_streaming(&dev->queue))
+			return -EBUSY;
+		vaggr_clear_inputs(dev);
+		return 0;
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+static const struct v4l2_ioctl_ops vaggr_ioctl_ops = {
+	.vidioc_querycap		= vidioc_querycap,
+	.vidioc_enum_fmt_vid_cap	= vidioc_enum_fmt_vid_cap,
+	.vidioc_g_fmt_vid_cap		= vidioc_g_fmt_vid_cap,
+	.vidioc_try_fmt_vid_cap		= vidioc_g_fmt_vid_cap,
+	.vidioc_s_fmt_vid_cap		= vidioc_g_fmt_vid_cap,
+	.vidioc_enum_input		= vidioc_enum_input,
+	.vidioc_g_input			= vidioc_g_input,
+	.vidioc_s_input			= vidioc_s_input,
+
+	.vidioc_reqbufs			= vb2_ioctl_reqbufs,
+	.vidioc_create_bufs		= vb2_ioctl_create_bufs,
+	.vidioc_querybuf		= vb2_ioctl_querybuf,
+	.vidioc_qbuf			= vb2_ioctl_qbuf,
+	.vidioc_dqbuf			= vb2_ioctl_dqbuf,
+	.vidioc_streamon		= vb2_ioctl_streamon,
+	.vidioc_streamoff		= vb2_ioctl_streamoff,
+
+	.vidioc_log_status		= v4l2_ctrl_log_status,
+	.vidioc_subscribe_event		= v4l2_ctrl_subscribe_event,
+	.vidioc_unsubscribe_event	= v4l2_event_unsubscribe,
+
+	.vidioc_default			= vidioc_default,
+};
+
+/* ------------------------------------------------------------------
+	Controls
+   ------------------------------------------------------------------*/
+
+static int vaggr_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct vaggr_dev *dev =
+		container_of(ctrl->handler, struct vaggr_dev, ctrl_handler);
+
+	switch (ctrl->id) {
+	case V4L2_CID_VAGGR_TOLERANCE:
+		spin_lock_irq(&dev->slock);
+		dev->tolerance = (u64)ctrl->val * NSEC_PER_USEC;
+		spin_unlock_irq(&dev->slock);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static const struct v4l2_ctrl_ops vaggr_ctrl_ops = {
+	.s_ctrl = vaggr_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config vaggr_ctrl_tolerance = {
+	.ops = &vaggr_ctrl_ops,
+	.id = V4L2_CID_VAGGR_TOLERANCE,
+	.name = "Timestamp Tolerance (us)",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = 1000000,
+	.step = 1,
+	.def = VAGGR_DEF_TOLERANCE,
+};
+
+/* ------------------------------------------------------------------
+	File operations
+   ------------------------------------------------------------------*/
+
+static int vaggr_release(struct file *file)
+{
+	struct vaggr_dev *dev = video_drvdata(file);
+	bool last;
+	int ret;
+
+	/* The last user takes the members away with it */
+	mutex_lock(&dev->mutex);
+	last = v4l2_fh_is_singular_file(file);
+	ret = _vb2_fop_release(file, NULL);
+	if (last)
+		vaggr_clear_inputs(dev);
+	mutex_unlock(&dev->mutex);
+
+	return ret;
+}
+
+static const struct v4l2_file_operations vaggr_fops = {
+	.owner		= THIS_MODULE,
+	.open		= v4l2_fh_open,
+	.release	= vaggr_release,
+	.poll		= vb2_fop_poll,
+	.unlocked_ioctl	= video_ioctl2,
+	.mmap		= vb2_fop_mmap,
+};
+
+static const struct video_device vaggr_template = {
+	.name		= VAGGR_NAME,
+	.fops		= &vaggr_fops,
+	.ioctl_ops	= &vaggr_ioctl_ops,
+	.release	= video_device_release_empty,
+};
+
+/* ------------------------------------------------------------------
+	Driver initialization
+   ------------------------------------------------------------------*/
+
+static void vaggr_dev_release(struct v4l2_device *v4l2_dev)
+{
+	struct vaggr_dev *dev = container_of(v4l2_dev, struct vaggr_dev,
+					     v4l2_dev);
+
+	v4l2_device_unregister(&dev->v4l2_dev);
+	v4l2_ctrl_handler_free(&dev->ctrl_handler);
+	kfree(dev);
+}
+
+static int vaggr_create_instance(struct platform_device *pdev, int inst)
+{
+	struct v4l2_ctrl_handler *hdl;
+	struct video_device *vfd;
+	struct vaggr_dev *dev;
+	struct vb2_queue *q;
+	int ret;
+
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return -ENOMEM;
+
+	snprintf(dev->v4l2_dev.name, sizeof(dev->v4l2_dev.name),
+		 "%s-%03d", VAGGR_NAME, inst);
+	ret = v4l2_device_register(&pdev->dev, &dev->v4l2_dev);
+	if (ret) {
+		kfree(dev);
+		return ret;
+	}
+	dev->v4l2_dev.release = vaggr_dev_release;
+
+	mutex_init(&dev->mutex);
+	spin_lock_init(&dev->slock);
+	INIT_LIST_HEAD(&dev->buf_list);
+	INIT_WORK(&dev->work, vaggr_work);
+	dev->tolerance = (u64)VAGGR_DEF_TOLERANCE * NSEC_PER_USEC;
+
+	hdl = &dev->ctrl_handler;
+	v4l2_ctrl_handler_init(hdl, 1);
+	v4l2_ctrl_new_custom(hdl, &vaggr_ctrl_tolerance, NULL);
+	if (hdl->error) {
+		ret = hdl->error;
+		goto unreg_dev;
+	}
+	dev->v4l2_dev.ctrl_handler = hdl;
+
+	q = &dev->queue;
+	q->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	q->io_modes = VB2_MMAP;
+	q->drv_priv = dev;
+	q->buf_struct_size = sizeof(struct vaggr_buffer);
+	q->ops = &vaggr_qops;
+	q->mem_ops = &vb2_vmalloc_memops;
+	q->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	q->lock = &dev->mutex;
+	ret = vb2_queue_init(q);
+	if (ret)
+		goto unreg_dev;
+
+	vfd = &dev->vdev;
+	*vfd = vaggr_template;
+	vfd->v4l2_dev = &dev->v4l2_dev;
+	vfd->queue = q;
+	vfd->lock = &dev->mutex;
+	video_set_drvdata(vfd, dev);
+
+	ret = video_register_device(vfd, VFL_TYPE_GRABBER, -1);
+	if (ret < 0)
+		goto unreg_dev;
+
+	v4l2_info(&dev->v4l2_dev, "V4L2 capture device registered as %s\n",
+		  video_device_node_name(vfd));
+
+	vaggr_devs[inst] = dev;
+	return 0;
+
+unreg_dev:
+	v4l2_device_put(&dev->v4l2_dev);
+	return ret;
+}
+
+static int vaggr_probe(struct platform_device *pdev)
+{
+	int ret = 0, i;
+
+	n_devs = clamp_t(unsigned, n_devs, 1, VAGGR_MAX_DEVS);
+
+	for (i = 0; i < n_devs; i++) {
+		ret = vaggr_create_instance(pdev, i);
+		if (ret) {
+			/* If some instantiations succeeded, keep driver */
+			if (i)
+				ret = 0;
+			break;
+		}
+	}
+
+	if (ret < 0) {
+		pr_err("vaggr: error %d while loading driver\n", ret);
+		return ret;
+	}
+
+	/* n_devs will reflect the actual number of allocated devices */
+	n_devs = i;
+
+	return ret;
+}
+
+static int vaggr_remove(struct platform_device *pdev)
+{
+	struct vaggr_dev *dev;
+	unsigned i;
+
+	for (i = 0; i < n_devs; i++) {
+		dev = vaggr_devs[i];
+		if (!dev)
+			continue;
+
+		v4l2_info(&dev->v4l2_dev, "unregistering %s\n",
+			  video_device_node_name(&dev->vdev));
+		video_unregister_device(&dev->vdev);
+		v4l2_device_put(&dev->v4l2_dev);
+		vaggr_devs[i] = NULL;
+	}
+	return 0;
+}
+
+static void vaggr_pdev_release(struct device *dev)
+{
+}
+
+static struct platform_device vaggr_pdev = {
+	.name		= VAGGR_NAME,
+	.dev.release	= vaggr_pdev_release,
+};
+
+static struct platform_driver vaggr_pdrv = {
+	.probe		= vaggr_probe,
+	.remove		= vaggr_remove,
+	.driver		= {
+		.name	= VAGGR_NAME,
+	},
+};
+
+static int __init vaggr_init(void)
+{
+	int ret;
+
+	ret = platform_device_register(&vaggr_pdev);
+	if (ret)
+		return ret;
+
+	ret = platform_driver_register(&vaggr_pdrv);
+	if (ret)
+		platform_device_unregister(&vaggr_pdev);
+
+	return ret;
+}
+
+static void __exit vaggr_exit(void)
+{
+	platform_driver_unregister(&vaggr_pdrv);
+	platform_device_unregister(&vaggr_pdev);
+}
+
+module_init(vaggr_init);
+module_exit(vaggr_exit);
@@ -41,6 +41,10 @@ static unsigned debug;
 module_param(debug, uint, 0644);
 MODULE_PARM_DESC(debug, "activates debug info");
 
+static bool wait_fences = true;
+module_param(wait_fences, bool, 0644);
+MODULE_PARM_DESC(wait_fences, "wait for implicit fences of imported source buffers");
+
 #define MIN_W 32
 #define MIN_H 32
 #define MAX_W 640
@@ -929,6 +933,8 @@ static int vim2m_open(struct file *file)
 		goto open_unlock;
 	}
 
+	v4l2_m2m_set_src_fence_wait(ctx->fh.m2m_ctx, wait_fences);
+
 	v4l2_fh_add(&ctx->fh);
 	atomic_inc(&dev->num_inst);
 
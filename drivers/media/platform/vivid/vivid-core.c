@@ -29,6 +29,8 @@
 #include <linux/platform_device.h>
 #include <linux/videodev2.h>
 #include <linux/v4l2-dv-timings.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <media/videobuf2-vmalloc.h>
 #include <media/v4l2-dv-timings.h>
 #include <media/v4l2-ioctl.h>
@@ -47,6 +49,7 @@
 #include "vivid-vbi-out.h"
 #include "vivid-osd.h"
 #include "vivid-ctrls.h"
+#include "vivid-kthread-cap.h"
 
 #define VIVID_MODULE_NAME "vivid"
 
@@ -626,6 +629,87 @@ static const struct v4l2_ioctl_ops vivid_ioctl_ops = {
 	.vidioc_unsubscribe_event	= v4l2_event_unsubscribe,
 };
 
+/* -----------------------------------------------------------------
+	Frame pacing statistics
+   ------------------------------------------------------------------*/
+
+void vivid_pacing_reset(struct vivid_pacing *pacing, u32 numerator,
+			u32 denominator)
+{
+	memset(pacing, 0, sizeof(*pacing));
+	pacing->period_ns = vivid_numerators_to_ns(numerator, denominator);
+}
+
+/* Called by the threads each time they wake up to process a frame */
+void vivid_pacing_update(struct vivid_pacing *pacing, u64 now_ns)
+{
+	if (pacing->frames) {
+		u64 ival = now_ns - pacing->last_ns;
+		u64 jitter = ival > pacing->period_ns ?
+			ival - pacing->period_ns : pacing->period_ns - ival;
+
+		if (pacing->frames == 1 || ival < pacing->ival_min_ns)
+			pacing->ival_min_ns = ival;
+		if (ival > pacing->ival_max_ns)
+			pacing->ival_max_ns = ival;
+		if (jitter > pacing->jitter_max_ns)
+			pacing->jitter_max_ns = jitter;
+		pacing->ival_sum_ns += ival;
+	}
+	if (pacing->target_ns && now_ns > pacing->target_ns) {
+		u64 late = now_ns - pacing->target_ns;
+
+		if (late > pacing->late_max_ns)
+			pacing->late_max_ns = late;
+		pacing->late_sum_ns += late;
+	}
+	pacing->last_ns = now_ns;
+	pacing->frames++;
+}
+
+static void vivid_pacing_show(struct seq_file *sf, const char *name,
+			      const struct vivid_pacing *pacing)
+{
+	u64 ivals = pacing->frames > 1 ? pacing->frames - 1 : 0;
+
+	seq_printf(sf, "%s: frames %llu, period %llu ns\n",
+		   name, pacing->frames, pacing->period_ns);
+	if (!ivals)
+		return;
+	seq_printf(sf, "  interval min/avg/max: %llu/%llu/%llu ns, jitter max: %llu ns\n",
+		   pacing->ival_min_ns, div64_u64(pacing->ival_sum_ns, ivals),
+		   pacing->ival_max_ns, pacing->jitter_max_ns);
+	seq_printf(sf, "  wakeup latency avg/max: %llu/%llu ns\n",
+		   div64_u64(pacing->late_sum_ns, ivals), pacing->late_max_ns);
+}
+
+static int vivid_pacing_debugfs_show(struct seq_file *sf, void *unused)
+{
+	struct vivid_dev *dev = sf->private;
+
+	if (mutex_lock_interruptible(&dev->mutex))
+		return -ERESTARTSYS;
+	if (dev->has_vid_cap)
+		vivid_pacing_show(sf, "vid_cap", &dev->pacing_vid_cap);
+	if (dev->has_vid_out)
+		vivid_pacing_show(sf, "vid_out", &dev->pacing_vid_out);
+	mutex_unlock(&dev->mutex);
+	return 0;
+}
+
+static int vivid_pacing_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, vivid_pacing_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations vivid_pacing_debugfs_fops = {
+	.owner = THIS_MODULE,
+	.open = vivid_pacing_debugfs_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 /* -----------------------------------------------------------------
 	Initialization and module stuff
    ------------------------------------------------------------------*/
@@ -633,14 +717,20 @@ static const struct v4l2_ioctl_ops vivid_ioctl_ops = {
 static void vivid_dev_release(struct v4l2_device *v4l2_dev)
 {
 	struct vivid_dev *dev = container_of(v4l2_dev, struct vivid_dev, v4l2_dev);
+	unsigned i;
 
+	cancel_work_sync(&dev->tpg_bench_work);
 	vivid_free_controls(dev);
 	v4l2_device_unregister(&dev->v4l2_dev);
 	vfree(dev->scaled_line);
 	vfree(dev->blended_line);
+	vfree(dev->scaler_lines);
+	for (i = 0; i < VIVID_SCALER_TABLES; i++)
+		vfree(dev->scaler_tables[i].coeffs);
 	vfree(dev->edid);
 	vfree(dev->bitmap_cap);
 	vfree(dev->bitmap_out);
+	vivid_frame_ring_free(dev);
 	tpg_free(&dev->tpg);
 	kfree(dev->query_dv_timings_qmenu);
 	kfree(dev);
@@ -849,6 +939,9 @@ static int vivid_create_instance(struct platform_device *pdev, int inst)
 	dev->blended_line = vzalloc(MAX_ZOOM * MAX_WIDTH);
 	if (!dev->blended_line)
 		goto free_dev;
+	dev->scaler_lines = vzalloc(VIVID_SCALER_TAPS * MAX_ZOOM * MAX_WIDTH);
+	if (!dev->scaler_lines)
+		goto free_dev;
 
 	/* load the edid */
 	dev->edid = vmalloc(256 * 128);
@@ -1017,6 +1110,7 @@ static int vivid_create_instance(struct platform_device *pdev, int inst)
 	/* initialize locks */
 	spin_lock_init(&dev->slock);
 	mutex_init(&dev->mutex);
+	INIT_WORK(&dev->tpg_bench_work, vivid_tpg_benchmark_work);
 
 	/* init dma queues */
 	INIT_LIST_HEAD(&dev->vid_cap_active);
@@ -1277,6 +1371,11 @@ static int vivid_create_instance(struct platform_device *pdev, int inst)
 					  video_device_node_name(vfd));
 	}
 
+	dev->debugfs_dir = debugfs_create_dir(dev->v4l2_dev.name, NULL);
+	if (!IS_ERR_OR_NULL(dev->debugfs_dir))
+		debugfs_create_file("pacing", 0444, dev->debugfs_dir, dev,
+				    &vivid_pacing_debugfs_fops);
+
 	/* Now that everything is fine, let's add it to device list */
 	vivid_devs[inst] = dev;
 
@@ -1388,6 +1487,7 @@ static int vivid_remove(struct platform_device *pdev)
 			unregister_framebuffer(&dev->fb_info);
 			vivid_fb_release_buffers(dev);
 		}
+		debugfs_remove_recursive(dev->debugfs_dir);
 		v4l2_device_put(&dev->v4l2_dev);
 		vivid_devs[i] = NULL;
 	}
@@ -21,6 +21,7 @@
 #define _VIVID_CORE_H_
 
 #include <linux/fb.h>
+#include <linux/math64.h>
 #include <media/videobuf2-v4l2.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-dev.h>
@@ -90,6 +91,68 @@ struct vivid_fmt {
 
 extern struct vivid_fmt vivid_formats[];
 
+/*
+ * The number of cached frames for static test patterns: one for each
+ * field parity, so V4L2_FIELD_ALTERNATE can be served from the cache as well.
+ */
+#define VIVID_FRAME_RING_SIZE 2
+
+/* a cached copy of all planes of a generated frame, before the OSD text */
+struct vivid_frame_ring_entry {
+	bool			valid;
+	v4l2_std_id		std;
+	struct tpg_data		tpg;
+	unsigned		size;
+	u8			*vbuf;
+};
+
+/* The scalers available for video looping */
+enum vivid_scaler {
+	VIVID_SCALER_NEAREST,
+	VIVID_SCALER_BILINEAR,
+	VIVID_SCALER_BOX,
+};
+
+/*
+ * The maximum number of source (two)pixels or lines that contribute to one
+ * scaled (two)pixel or line. Larger downscaling factors fall back to
+ * bilinear filtering.
+ */
+#define VIVID_SCALER_TAPS 8
+/* The number of cached per-column coefficient tables */
+#define VIVID_SCALER_TABLES 4
+
+/*
+ * Filter coefficients for one scaled (two)pixel or line: the weights of
+ * 'taps' consecutive source (two)pixels starting at 'src', adding up to 256.
+ */
+struct vivid_scaler_coeff {
+	u16	src;
+	u16	taps;
+	u16	weight[VIVID_SCALER_TAPS];
+};
+
+struct vivid_scaler_table {
+	enum vivid_scaler		mode;
+	unsigned			srcw;
+	unsigned			dstw;
+	struct vivid_scaler_coeff	*coeffs;
+};
+
+/* frame pacing statistics of the capture and output threads */
+struct vivid_pacing {
+	u64	frames;
+	u64	period_ns;
+	u64	last_ns;
+	u64	target_ns;
+	u64	ival_min_ns;
+	u64	ival_max_ns;
+	u64	ival_sum_ns;
+	u64	jitter_max_ns;
+	u64	late_max_ns;
+	u64	late_sum_ns;
+};
+
 /* buffer for one video frame */
 struct vivid_buffer {
 	/* common v4l buffer stuff -- must be first */
@@ -135,6 +198,7 @@ enum vivid_colorspace {
 struct vivid_dev {
 	unsigned			inst;
 	struct v4l2_device		v4l2_dev;
+	struct dentry			*debugfs_dir;
 	struct v4l2_ctrl_handler	ctrl_hdl_user_gen;
 	struct v4l2_ctrl_handler	ctrl_hdl_user_vid;
 	struct v4l2_ctrl_handler	ctrl_hdl_user_aud;
@@ -264,6 +328,7 @@ struct vivid_dev {
 	bool				vflip;
 	bool				vbi_cap_interlaced;
 	bool				loop_video;
+	enum vivid_scaler		loop_scaler;
 
 	/* Framebuffer */
 	unsigned long			video_pbase;
@@ -346,6 +411,10 @@ struct vivid_dev {
 	u8				*scaled_line;
 	u8				*blended_line;
 	unsigned			cur_scaled_line;
+	u8				*scaler_lines;
+	unsigned			scaler_line_y[VIVID_SCALER_TAPS];
+	struct vivid_scaler_table	scaler_tables[VIVID_SCALER_TABLES];
+	unsigned			scaler_next_table;
 
 	/* Output Overlay */
 	void				*fb_vbase_out;
@@ -363,6 +432,14 @@ struct vivid_dev {
 	struct tpg_data			tpg;
 	unsigned			ms_vid_cap;
 	bool				must_blank[VIDEO_MAX_FRAME];
+	bool				frame_ring;
+	struct vivid_frame_ring_entry	frame_ring_entries[VIVID_FRAME_RING_SIZE];
+	/* tpg benchmark work and the parameters it runs with */
+	struct work_struct		tpg_bench_work;
+	unsigned			tpg_bench_width;
+	unsigned			tpg_bench_height;
+	enum tpg_pattern		tpg_bench_pattern;
+	unsigned			tpg_bench_workers;
 
 	const struct vivid_fmt		*fmt_cap;
 	struct v4l2_fract		timeperframe_vid_cap;
@@ -380,6 +457,8 @@ struct vivid_dev {
 	/* thread for generating video capture stream */
 	struct task_struct		*kthread_vid_cap;
 	unsigned long			jiffies_vid_cap;
+	u64				ns_vid_cap;
+	struct vivid_pacing		pacing_vid_cap;
 	u32				cap_seq_offset;
 	u32				cap_seq_count;
 	bool				cap_seq_resync;
@@ -434,6 +513,8 @@ struct vivid_dev {
 	/* thread for generating video output stream */
 	struct task_struct		*kthread_vid_out;
 	unsigned long			jiffies_vid_out;
+	u64				ns_vid_out;
+	struct vivid_pacing		pacing_vid_out;
 	u32				out_seq_offset;
 	u32				out_seq_count;
 	bool				out_seq_resync;
@@ -533,4 +614,30 @@ static inline bool vivid_is_hdmi_out(const struct vivid_dev *dev)
 	return dev->output_type[dev->output] == HDMI;
 }
 
+/*
+ * Convert between nanoseconds and 'numerators' of a timeperframe with the
+ * given denominator. Splitting off the seconds avoids 64-bit overflows even
+ * for the large denominators of HDMI pixel clocks, and keeps fractional
+ * rates such as 60000/1001 exact.
+ */
+static inline u64 vivid_ns_to_numerators(u64 ns, u32 denominator)
+{
+	u32 rem;
+	u64 secs = div_u64_rem(ns, NSEC_PER_SEC, &rem);
+
+	return secs * denominator + div_u64((u64)rem * denominator, NSEC_PER_SEC);
+}
+
+static inline u64 vivid_numerators_to_ns(u64 numerators, u32 denominator)
+{
+	u32 rem;
+	u64 secs = div_u64_rem(numerators, denominator, &rem);
+
+	return secs * NSEC_PER_SEC + div_u64((u64)rem * NSEC_PER_SEC, denominator);
+}
+
+void vivid_pacing_reset(struct vivid_pacing *pacing, u32 numerator,
+			u32 denominator);
+void vivid_pacing_update(struct vivid_pacing *pacing, u64 now_ns);
+
 #endif
@@ -30,6 +30,7 @@
 #include "vivid-radio-common.h"
 #include "vivid-osd.h"
 #include "vivid-ctrls.h"
+#include "vivid-kthread-cap.h"
 
 #define VIVID_CID_CUSTOM_BASE		(V4L2_CID_USER_BASE | 0xf000)
 #define VIVID_CID_BUTTON		(VIVID_CID_CUSTOM_BASE + 0)
@@ -78,6 +79,10 @@
 #define VIVID_CID_TIME_WRAP		(VIVID_CID_VIVID_BASE + 39)
 #define VIVID_CID_MAX_EDID_BLOCKS	(VIVID_CID_VIVID_BASE + 40)
 #define VIVID_CID_PERCENTAGE_FILL	(VIVID_CID_VIVID_BASE + 41)
+#define VIVID_CID_TPG_WORKERS		(VIVID_CID_VIVID_BASE + 42)
+#define VIVID_CID_TPG_BENCHMARK		(VIVID_CID_VIVID_BASE + 43)
+#define VIVID_CID_FRAME_RING		(VIVID_CID_VIVID_BASE + 44)
+#define VIVID_CID_LOOP_SCALER		(VIVID_CID_VIVID_BASE + 45)
 
 #define VIVID_CID_STD_SIGNAL_MODE	(VIVID_CID_VIVID_BASE + 60)
 #define VIVID_CID_STANDARD		(VIVID_CID_VIVID_BASE + 61)
@@ -410,6 +415,16 @@ static int vivid_vid_cap_s_ctrl(struct v4l2_ctrl *ctrl)
 		for (i = 0; i < VIDEO_MAX_FRAME; i++)
 			dev->must_blank[i] = ctrl->val < 100;
 		break;
+	case VIVID_CID_TPG_WORKERS:
+		tpg_s_workers(&dev->tpg, ctrl->val);
+		break;
+	case VIVID_CID_TPG_BENCHMARK:
+		return vivid_tpg_benchmark(dev);
+	case VIVID_CID_FRAME_RING:
+		dev->frame_ring = ctrl->val;
+		if (!dev->frame_ring)
+			vivid_frame_ring_free(dev);
+		break;
 	case VIVID_CID_INSERT_SAV:
 		tpg_s_insert_sav(&dev->tpg, ctrl->val);
 		break;
@@ -565,6 +580,33 @@ static const struct v4l2_ctrl_config vivid_ctrl_perc_fill = {
 	.step = 1,
 };
 
+static const struct v4l2_ctrl_config vivid_ctrl_tpg_workers = {
+	.ops = &vivid_vid_cap_ctrl_ops,
+	.id = VIVID_CID_TPG_WORKERS,
+	.name = "Pattern Generator Workers",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 1,
+	.max = TPG_MAX_WORKERS,
+	.def = 1,
+	.step = 1,
+};
+
+static const struct v4l2_ctrl_config vivid_ctrl_tpg_benchmark = {
+	.ops = &vivid_vid_cap_ctrl_ops,
+	.id = VIVID_CID_TPG_BENCHMARK,
+	.name = "Benchmark Pattern Generator",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+static const struct v4l2_ctrl_config vivid_ctrl_frame_ring = {
+	.ops = &vivid_vid_cap_ctrl_ops,
+	.id = VIVID_CID_FRAME_RING,
+	.name = "Cache Static Frames",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.max = 1,
+	.step = 1,
+};
+
 static const struct v4l2_ctrl_config vivid_ctrl_insert_sav = {
 	.ops = &vivid_vid_cap_ctrl_ops,
 	.id = VIVID_CID_INSERT_SAV,
@@ -811,6 +853,9 @@ static int vivid_loop_cap_s_ctrl(struct v4l2_ctrl *ctrl)
 		vivid_send_source_change(dev, SVID);
 		vivid_send_source_change(dev, HDMI);
 		break;
+	case VIVID_CID_LOOP_SCALER:
+		dev->loop_scaler = ctrl->val;
+		break;
 	}
 	return 0;
 }
@@ -828,6 +873,22 @@ static const struct v4l2_ctrl_config vivid_ctrl_loop_video = {
 	.step = 1,
 };
 
+static const char * const vivid_ctrl_loop_scaler_strings[] = {
+	"Nearest Neighbor",
+	"Bilinear",
+	"Box Filter",
+	NULL,
+};
+
+static const struct v4l2_ctrl_config vivid_ctrl_loop_scaler = {
+	.ops = &vivid_loop_cap_ctrl_ops,
+	.id = VIVID_CID_LOOP_SCALER,
+	.name = "Loop Video Scaler",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.max = ARRAY_SIZE(vivid_ctrl_loop_scaler_strings) - 2,
+	.qmenu = vivid_ctrl_loop_scaler_strings,
+};
+
 
 /* VBI Capture Control */
 
@@ -1414,6 +1475,9 @@ int vivid_create_controls(struct vivid_dev *dev, bool show_ccs_cap,
 		v4l2_ctrl_new_custom(hdl_vid_cap, &vivid_ctrl_vflip, NULL);
 		v4l2_ctrl_new_custom(hdl_vid_cap, &vivid_ctrl_insert_sav, NULL);
 		v4l2_ctrl_new_custom(hdl_vid_cap, &vivid_ctrl_insert_eav, NULL);
+		v4l2_ctrl_new_custom(hdl_vid_cap, &vivid_ctrl_tpg_workers, NULL);
+		v4l2_ctrl_new_custom(hdl_vid_cap, &vivid_ctrl_tpg_benchmark, NULL);
+		v4l2_ctrl_new_custom(hdl_vid_cap, &vivid_ctrl_frame_ring, NULL);
 		if (show_ccs_cap) {
 			dev->ctrl_has_crop_cap = v4l2_ctrl_new_custom(hdl_vid_cap,
 				&vivid_ctrl_has_crop_cap, NULL);
@@ -1508,6 +1572,8 @@ int vivid_create_controls(struct vivid_dev *dev, bool show_ccs_cap,
 	if ((dev->has_vid_cap && dev->has_vid_out) ||
 	    (dev->has_vbi_cap && dev->has_vbi_out))
 		v4l2_ctrl_new_custom(hdl_loop_cap, &vivid_ctrl_loop_video, NULL);
+	if (dev->has_vid_cap && dev->has_vid_out)
+		v4l2_ctrl_new_custom(hdl_loop_cap, &vivid_ctrl_loop_scaler, NULL);
 
 	if (dev->has_fb)
 		v4l2_ctrl_new_custom(hdl_user_gen, &vivid_ctrl_clear_fb, NULL);
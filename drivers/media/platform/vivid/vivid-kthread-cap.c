@@ -23,14 +23,17 @@
 #include <linux/init.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/font.h>
 #include <linux/mutex.h>
 #include <linux/videodev2.h>
 #include <linux/kthread.h>
 #include <linux/freezer.h>
+#include <linux/hrtimer.h>
 #include <linux/random.h>
 #include <linux/v4l2-dv-timings.h>
 #include <asm/div64.h>
+#include <asm/unaligned.h>
 #include <media/videobuf2-vmalloc.h>
 #include <media/v4l2-dv-timings.h>
 #include <media/v4l2-ioctl.h>
@@ -147,6 +150,247 @@ static void scale_line(const u8 *src, u8 *dst, unsigned srcw, unsigned dstw, uns
 	}
 }
 
+/*
+ * Filtered scaling only makes sense if every byte is a separate color
+ * component. Formats with components packed into bitfields, 16-bit
+ * components or Bayer patterns (where adjacent lines have different
+ * colors) always use the coarse scaler.
+ */
+static bool vivid_scaler_can_filter(u32 fourcc)
+{
+	switch (fourcc) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_VYUY:
+	case V4L2_PIX_FMT_YUV422P:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_YUV420M:
+	case V4L2_PIX_FMT_YVU420M:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+	case V4L2_PIX_FMT_NV16:
+	case V4L2_PIX_FMT_NV61:
+	case V4L2_PIX_FMT_NV16M:
+	case V4L2_PIX_FMT_NV61M:
+	case V4L2_PIX_FMT_NV24:
+	case V4L2_PIX_FMT_NV42:
+	case V4L2_PIX_FMT_YUV32:
+	case V4L2_PIX_FMT_GREY:
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+	case V4L2_PIX_FMT_RGB32:
+	case V4L2_PIX_FMT_BGR32:
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_XBGR32:
+	case V4L2_PIX_FMT_ARGB32:
+	case V4L2_PIX_FMT_ABGR32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Calculate the filter coefficients for scaled (two)pixel or line 'x' when
+ * scaling 'srcw' to 'dstw'. The weights are in units of 1/256.
+ */
+static void vivid_scaler_calc(enum vivid_scaler mode, unsigned srcw,
+			      unsigned dstw, unsigned x,
+			      struct vivid_scaler_coeff *c)
+{
+	/* The source interval covered by x, in units of 1/dstw */
+	unsigned start = x * srcw;
+	unsigned end = start + srcw;
+	unsigned sum = 0;
+	unsigned i;
+	u64 pos;
+
+	if (mode == VIVID_SCALER_BOX &&
+	    (end - 1) / dstw - start / dstw >= VIVID_SCALER_TAPS)
+		mode = VIVID_SCALER_BILINEAR;
+
+	if (mode == VIVID_SCALER_BOX) {
+		c->src = start / dstw;
+		c->taps = (end - 1) / dstw - c->src + 1;
+		for (i = 0; i < c->taps; i++) {
+			unsigned l = max(start, (c->src + i) * dstw);
+			unsigned r = min(end, (c->src + i + 1) * dstw);
+
+			c->weight[i] = ((r - l) * 256) / srcw;
+			sum += c->weight[i];
+		}
+		/* make sure the weights add up to exactly 256 */
+		c->weight[c->taps - 1] += 256 - sum;
+		return;
+	}
+
+	/* Bilinear: interpolate between the two nearest pixel centers */
+	pos = (u64)(2 * x + 1) * srcw * 256;
+	do_div(pos, 2 * dstw);
+	i = pos > 128 ? pos - 128 : 0;
+	c->src = i / 256;
+	c->weight[1] = i % 256;
+	if (c->src >= srcw - 1 || c->weight[1] == 0) {
+		c->src = min_t(unsigned, c->src, srcw - 1);
+		c->taps = 1;
+		c->weight[0] = 256;
+		return;
+	}
+	c->taps = 2;
+	c->weight[0] = 256 - c->weight[1];
+}
+
+/*
+ * Return the cached per-column coefficient table for scaling 'srcw' to
+ * 'dstw' (two)pixels, calculating it if needed.
+ */
+static const struct vivid_scaler_coeff *
+vivid_scaler_get_coeffs(struct vivid_dev *dev, unsigned srcw, unsigned dstw)
+{
+	struct vivid_scaler_table *t;
+	unsigned x;
+	unsigned i;
+
+	for (i = 0; i < VIVID_SCALER_TABLES; i++) {
+		t = &dev->scaler_tables[i];
+		if (t->coeffs && t->mode == dev->loop_scaler &&
+		    t->srcw == srcw && t->dstw == dstw)
+			return t->coeffs;
+	}
+
+	t = &dev->scaler_tables[dev->scaler_next_table];
+	dev->scaler_next_table = (dev->scaler_next_table + 1) % VIVID_SCALER_TABLES;
+	if (!t->coeffs || t->dstw < dstw) {
+		vfree(t->coeffs);
+		t->coeffs = vmalloc(dstw * sizeof(*t->coeffs));
+		if (!t->coeffs)
+			return NULL;
+	}
+	t->mode = dev->loop_scaler;
+	t->srcw = srcw;
+	t->dstw = dstw;
+	for (x = 0; x < dstw; x++)
+		vivid_scaler_calc(t->mode, srcw, dstw, x, &t->coeffs[x]);
+	return t->coeffs;
+}
+
+/*
+ * dst[i] = sum(weight[t] * src[t][i]) / 256 for all 'len' bytes. The
+ * weights add up to 256, so two bytes out of every 32-bit word can be
+ * accumulated in 16-bit lanes without overflowing into each other.
+ */
+static void vivid_blend_bytes(u8 *dst, const u8 * const *src,
+			      const u16 *weight, unsigned taps, unsigned len)
+{
+	unsigned i = 0;
+	unsigned t;
+
+	for (; i + 4 <= len; i += 4) {
+		u32 lo = 0x00800080;
+		u32 hi = 0x00800080;
+
+		for (t = 0; t < taps; t++) {
+			u32 v = get_unaligned((const u32 *)(src[t] + i));
+
+			lo += weight[t] * (v & 0x00ff00ff);
+			hi += weight[t] * ((v >> 8) & 0x00ff00ff);
+		}
+		put_unaligned(((lo >> 8) & 0x00ff00ff) | (hi & 0xff00ff00),
+			      (u32 *)(dst + i));
+	}
+	for (; i < len; i++) {
+		unsigned v = 0x80;
+
+		for (t = 0; t < taps; t++)
+			v += weight[t] * src[t][i];
+		dst[i] = v >> 8;
+	}
+}
+
+/* Filtered horizontal scaling, srcw and dstw are in two-pixel units */
+static void scale_line_filtered(struct vivid_dev *dev, const u8 *src, u8 *dst,
+				unsigned srcw, unsigned dstw, unsigned twopixsize)
+{
+	const struct vivid_scaler_coeff *c;
+	const u8 *srcs[VIVID_SCALER_TAPS];
+	unsigned x;
+	unsigned t;
+
+	if (srcw == dstw) {
+		memcpy(dst, src, dstw * twopixsize);
+		return;
+	}
+	c = vivid_scaler_get_coeffs(dev, srcw, dstw);
+	if (!c) {
+		scale_line(src, dst, srcw * 2, dstw * 2, twopixsize);
+		return;
+	}
+	for (x = 0; x < dstw; x++, c++, dst += twopixsize) {
+		if (c->taps == 1) {
+			memcpy(dst, src + c->src * twopixsize, twopixsize);
+			continue;
+		}
+		for (t = 0; t < c->taps; t++)
+			srcs[t] = src + (c->src + t) * twopixsize;
+		vivid_blend_bytes(dst, srcs, c->weight, c->taps, twopixsize);
+	}
+}
+
+/*
+ * Filtered scaling of line 'row' of the loop_vid_cap rectangle from the
+ * 'src_rows' lines of the loop_vid_out rectangle. The contributing
+ * source lines are scaled horizontally into the scaler line cache, so
+ * each source line is scaled only once per plane, and then combined.
+ */
+static void vivid_scale_line_2d(struct vivid_dev *dev, u8 *dst,
+				const u8 *voutbuf, unsigned stride_out,
+				unsigned row, unsigned src_rows, unsigned dst_rows,
+				unsigned srcw, unsigned dstw, unsigned twopixsize)
+{
+	struct vivid_scaler_coeff c;
+	const u8 *lines[VIVID_SCALER_TAPS];
+	unsigned t;
+
+	vivid_scaler_calc(dev->loop_scaler, src_rows, dst_rows, row, &c);
+	if (c.taps == 1) {
+		scale_line_filtered(dev, voutbuf + c.src * stride_out, dst,
+				    srcw, dstw, twopixsize);
+		return;
+	}
+	for (t = 0; t < c.taps; t++) {
+		unsigned y = c.src + t;
+		unsigned i = y % VIVID_SCALER_TAPS;
+		u8 *line = dev->scaler_lines + i * MAX_ZOOM * MAX_WIDTH;
+
+		if (srcw == dstw) {
+			lines[t] = voutbuf + y * stride_out;
+			continue;
+		}
+		if (dev->scaler_line_y[i] != y) {
+			scale_line_filtered(dev, voutbuf + y * stride_out, line,
+					    srcw, dstw, twopixsize);
+			dev->scaler_line_y[i] = y;
+		}
+		lines[t] = line;
+	}
+	vivid_blend_bytes(dst, lines, c.weight, c.taps, dstw * twopixsize);
+}
+
+/* Scale a line, using the filtered scaler if selected */
+static void vivid_scale_line(struct vivid_dev *dev, bool filter,
+			     const u8 *src, u8 *dst, unsigned srcw,
+			     unsigned dstw, unsigned twopixsize)
+{
+	if (filter)
+		scale_line_filtered(dev, src, dst, srcw / 2, dstw / 2, twopixsize);
+	else
+		scale_line(src, dst, srcw, dstw, twopixsize);
+}
+
 /*
  * Precalculate the rectangles needed to perform video looping:
  *
@@ -273,6 +517,12 @@ static int vivid_copy_buffer(struct vivid_dev *dev, unsigned p, u8 *vcapbuf,
 	unsigned vid_cap_left = tpg_hdiv(tpg, p, dev->loop_vid_cap.left);
 	unsigned vid_cap_right;
 	bool quick;
+	/* filter is true if the selected filtered scaler can be used */
+	bool filter = dev->loop_scaler != VIVID_SCALER_NEAREST &&
+		      vivid_scaler_can_filter(dev->fmt_out->fourcc);
+	/* vfilter is true if lines are also filtered vertically */
+	bool vfilter = filter && !V4L2_FIELD_HAS_BOTH(dev->field_cap) &&
+		       dev->loop_vid_out.height != dev->loop_vid_cap.height;
 
 	vid_out_int_part = dev->loop_vid_out.height / dev->loop_vid_cap.height;
 	vid_out_fract_part = dev->loop_vid_out.height % dev->loop_vid_cap.height;
@@ -320,6 +570,7 @@ static int vivid_copy_buffer(struct vivid_dev *dev, unsigned p, u8 *vcapbuf,
 	quick = dev->loop_vid_out.width == dev->loop_vid_cap.width;
 
 	dev->cur_scaled_line = dev->loop_vid_out.height;
+	memset(dev->scaler_line_y, 0xff, sizeof(dev->scaler_line_y));
 	for (y = 0; y < hmax; y += vdiv, vcapbuf += stride_cap) {
 		/* osdline is true if this line requires overlay blending */
 		bool osdline = vosdbuf && y >= dev->loop_vid_overlay_cap.top &&
@@ -344,6 +595,17 @@ static int vivid_copy_buffer(struct vivid_dev *dev, unsigned p, u8 *vcapbuf,
 			memcpy(vcapbuf + vid_cap_right, tpg->black_line[p],
 				img_width - vid_cap_right);
 
+		if (vfilter && !osdline) {
+			vivid_scale_line_2d(dev, vcapbuf + vid_cap_left,
+				voutbuf, stride_out,
+				(y - dev->loop_vid_cap.top) / vdiv,
+				dev->loop_vid_out.height / vdiv,
+				dev->loop_vid_cap.height / vdiv,
+				tpg_hdiv(tpg, p, dev->loop_vid_out.width) / twopixsize,
+				tpg_hdiv(tpg, p, dev->loop_vid_cap.width) / twopixsize,
+				twopixsize);
+			goto update_vid_out_y;
+		}
 		if (quick && !osdline) {
 			memcpy(vcapbuf + vid_cap_left,
 			       voutbuf + vid_out_y * stride_out,
@@ -355,7 +617,13 @@ static int vivid_copy_buffer(struct vivid_dev *dev, unsigned p, u8 *vcapbuf,
 			       tpg_hdiv(tpg, p, dev->loop_vid_cap.width));
 			goto update_vid_out_y;
 		}
-		if (!osdline) {
+		if (!osdline && filter) {
+			scale_line_filtered(dev, voutbuf + vid_out_y * stride_out,
+				dev->scaled_line,
+				tpg_hdiv(tpg, p, dev->loop_vid_out.width) / twopixsize,
+				tpg_hdiv(tpg, p, dev->loop_vid_cap.width) / twopixsize,
+				twopixsize);
+		} else if (!osdline) {
 			scale_line(voutbuf + vid_out_y * stride_out, dev->scaled_line,
 				tpg_hdiv(tpg, p, dev->loop_vid_out.width),
 				tpg_hdiv(tpg, p, dev->loop_vid_cap.width),
@@ -370,7 +638,8 @@ static int vivid_copy_buffer(struct vivid_dev *dev, unsigned p, u8 *vcapbuf,
 				 twopixsize) / 2;
 			u8 *osd = vosdbuf + vid_overlay_y * stride_osd;
 
-			scale_line(voutbuf + vid_out_y * stride_out, dev->blended_line,
+			vivid_scale_line(dev, filter,
+				voutbuf + vid_out_y * stride_out, dev->blended_line,
 				dev->loop_vid_out.width, dev->loop_vid_copy.width,
 				tpg_g_twopixelsize(tpg, p));
 			if (blend)
@@ -381,7 +650,8 @@ static int vivid_copy_buffer(struct vivid_dev *dev, unsigned p, u8 *vcapbuf,
 			else
 				memcpy(dev->blended_line + offset,
 				       osd, (dev->loop_vid_overlay.width * twopixsize) / 2);
-			scale_line(dev->blended_line, dev->scaled_line,
+			vivid_scale_line(dev, filter,
+					dev->blended_line, dev->scaled_line,
 					dev->loop_vid_copy.width, dev->loop_vid_cap.width,
 					tpg_g_twopixelsize(tpg, p));
 		}
@@ -413,6 +683,60 @@ update_vid_out_y:
 	return 0;
 }
 
+void vivid_frame_ring_free(struct vivid_dev *dev)
+{
+	unsigned i;
+
+	for (i = 0; i < VIVID_FRAME_RING_SIZE; i++) {
+		struct vivid_frame_ring_entry *e = &dev->frame_ring_entries[i];
+
+		vfree(e->vbuf);
+		e->vbuf = NULL;
+		e->size = 0;
+		e->valid = false;
+	}
+}
+
+/*
+ * Return the frame ring entry to use for this field, or NULL if the
+ * current frame cannot be cached. Only patterns that are identical from
+ * frame to frame can be cached: moving or noisy patterns and looped
+ * video are always generated from scratch.
+ */
+static struct vivid_frame_ring_entry *
+vivid_frame_ring_get(struct vivid_dev *dev, enum v4l2_field field, bool is_loop)
+{
+	struct tpg_data *tpg = &dev->tpg;
+	struct vivid_frame_ring_entry *e;
+	unsigned size = 0;
+	unsigned p;
+
+	if (!dev->frame_ring || is_loop || !tpg_pattern_is_static(tpg) ||
+	    tpg_g_quality(tpg) == TPG_QUAL_NOISE)
+		return NULL;
+
+	e = &dev->frame_ring_entries[field == V4L2_FIELD_BOTTOM];
+	for (p = 0; p < tpg_g_planes(tpg); p++)
+		size += tpg_calc_plane_size(tpg, p);
+	if (e->size != size) {
+		vfree(e->vbuf);
+		e->valid = false;
+		e->size = 0;
+		e->vbuf = vmalloc(size);
+		if (!e->vbuf)
+			return NULL;
+		e->size = size;
+	}
+	/*
+	 * Any change to the pattern generator state, including a pending
+	 * recalculation, invalidates the cached frame.
+	 */
+	if (e->valid && (e->std != vivid_get_std_cap(dev) ||
+			 memcmp(&e->tpg, tpg, sizeof(*tpg))))
+		e->valid = false;
+	return e;
+}
+
 static void vivid_fillbuff(struct vivid_dev *dev, struct vivid_buffer *buf)
 {
 	struct tpg_data *tpg = &dev->tpg;
@@ -427,6 +751,8 @@ static void vivid_fillbuff(struct vivid_dev *dev, struct vivid_buffer *buf)
 	char str[100];
 	s32 gain;
 	bool is_loop = false;
+	struct vivid_frame_ring_entry *ring;
+	unsigned ring_offset = 0;
 
 	if (dev->loop_video && dev->can_loop_video &&
 		((vivid_is_svid_cap(dev) &&
@@ -465,9 +791,14 @@ static void vivid_fillbuff(struct vivid_dev *dev, struct vivid_buffer *buf)
 
 	vivid_precalc_copy_rects(dev);
 
+	/* Blanked frames are never cached, nor served from the cache */
+	ring = dev->must_blank[buf->vb.vb2_buf.index] ? NULL :
+		vivid_frame_ring_get(dev, buf->vb.field, is_loop);
+
 	for (p = 0; p < tpg_g_planes(tpg); p++) {
 		void *vbuf = plane_vaddr(tpg, buf, p,
 					 tpg->bytesperline, tpg->buf_height);
+		unsigned size = tpg_calc_plane_size(tpg, p);
 
 		/*
 		 * The first plane of a multiplanar format has a non-zero
@@ -480,9 +811,21 @@ static void vivid_fillbuff(struct vivid_dev *dev, struct vivid_buffer *buf)
 			vbuf += dev->fmt_cap->data_offset[p];
 		}
 		tpg_calc_text_basep(tpg, basep, p, vbuf);
-		if (!is_loop || vivid_copy_buffer(dev, p, vbuf, buf))
-			tpg_fill_plane_buffer(tpg, vivid_get_std_cap(dev),
-					p, vbuf);
+		if (ring && ring->valid) {
+			memcpy(vbuf, ring->vbuf + ring_offset, size);
+		} else {
+			if (!is_loop || vivid_copy_buffer(dev, p, vbuf, buf))
+				tpg_fill_plane_buffer(tpg,
+					vivid_get_std_cap(dev), p, vbuf);
+			if (ring)
+				memcpy(ring->vbuf + ring_offset, vbuf, size);
+		}
+		ring_offset += size;
+	}
+	if (ring && !ring->valid) {
+		memcpy(&ring->tpg, tpg, sizeof(*tpg));
+		ring->std = vivid_get_std_cap(dev);
+		ring->valid = true;
 	}
 	dev->must_blank[buf->vb.vb2_buf.index] = false;
 
@@ -740,10 +1083,11 @@ static int vivid_thread_vid_cap(void *data)
 	struct vivid_dev *dev = data;
 	u64 numerators_since_start;
 	u64 buffers_since_start;
-	u64 next_jiffies_since_start;
+	u64 next_ns_since_start;
 	unsigned long jiffies_since_start;
 	unsigned long cur_jiffies;
-	unsigned wait_jiffies;
+	u64 cur_ns;
+	ktime_t next;
 	unsigned numerator;
 	unsigned denominator;
 	int dropped_bufs;
@@ -757,6 +1101,11 @@ static int vivid_thread_vid_cap(void *data)
 	dev->cap_seq_count = 0;
 	dev->cap_seq_resync = false;
 	dev->jiffies_vid_cap = jiffies;
+	dev->ns_vid_cap = ktime_get_ns();
+	vivid_pacing_reset(&dev->pacing_vid_cap,
+			   dev->timeperframe_vid_cap.numerator,
+			   dev->timeperframe_vid_cap.denominator *
+			   (dev->field_cap == V4L2_FIELD_ALTERNATE ? 2 : 1));
 
 	for (;;) {
 		try_to_freeze();
@@ -765,24 +1114,31 @@ static int vivid_thread_vid_cap(void *data)
 
 		mutex_lock(&dev->mutex);
 		cur_jiffies = jiffies;
+		cur_ns = ktime_get_ns();
+		numerator = dev->timeperframe_vid_cap.numerator;
+		denominator = dev->timeperframe_vid_cap.denominator;
+
+		if (dev->field_cap == V4L2_FIELD_ALTERNATE)
+			denominator *= 2;
+
 		if (dev->cap_seq_resync) {
 			dev->jiffies_vid_cap = cur_jiffies;
+			dev->ns_vid_cap = cur_ns;
 			dev->cap_seq_offset = dev->cap_seq_count + 1;
 			dev->cap_seq_count = 0;
 			dev->cap_seq_resync = false;
+			vivid_pacing_reset(&dev->pacing_vid_cap,
+					   numerator, denominator);
 		}
-		numerator = dev->timeperframe_vid_cap.numerator;
-		denominator = dev->timeperframe_vid_cap.denominator;
-
-		if (dev->field_cap == V4L2_FIELD_ALTERNATE)
-			denominator *= 2;
+		vivid_pacing_update(&dev->pacing_vid_cap, cur_ns);
 
 		/* Calculate the number of jiffies since we started streaming */
 		jiffies_since_start = cur_jiffies - dev->jiffies_vid_cap;
 		/* Get the number of buffers streamed since the start */
-		buffers_since_start = (u64)jiffies_since_start * denominator +
-				      (HZ * numerator) / 2;
-		do_div(buffers_since_start, HZ * numerator);
+		buffers_since_start = vivid_ns_to_numerators(cur_ns - dev->ns_vid_cap,
+							     denominator) +
+				      numerator / 2;
+		do_div(buffers_since_start, numerator);
 
 		/*
 		 * After more than 0xf0000000 (rounded down to a multiple of
@@ -792,6 +1148,7 @@ static int vivid_thread_vid_cap(void *data)
 		 */
 		if (jiffies_since_start > JIFFIES_RESYNC) {
 			dev->jiffies_vid_cap = cur_jiffies;
+			dev->ns_vid_cap = cur_ns;
 			dev->cap_seq_offset = buffers_since_start;
 			buffers_since_start = 0;
 		}
@@ -808,24 +1165,22 @@ static int vivid_thread_vid_cap(void *data)
 		 */
 		numerators_since_start = ++buffers_since_start * numerator;
 
-		/* And the number of jiffies since we started */
-		jiffies_since_start = jiffies - dev->jiffies_vid_cap;
-
-		mutex_unlock(&dev->mutex);
-
 		/*
 		 * Calculate when that next buffer is supposed to start
-		 * in jiffies since we started streaming.
+		 * in nanoseconds since we started streaming.
 		 */
-		next_jiffies_since_start = numerators_since_start * HZ +
-					   denominator / 2;
-		do_div(next_jiffies_since_start, denominator);
-		/* If it is in the past, then just schedule asap */
-		if (next_jiffies_since_start < jiffies_since_start)
-			next_jiffies_since_start = jiffies_since_start;
+		next_ns_since_start = vivid_numerators_to_ns(numerators_since_start,
+							     denominator);
+		dev->pacing_vid_cap.target_ns = dev->ns_vid_cap + next_ns_since_start;
+		next = ns_to_ktime(dev->pacing_vid_cap.target_ns);
+
+		mutex_unlock(&dev->mutex);
 
-		wait_jiffies = next_jiffies_since_start - jiffies_since_start;
-		schedule_timeout_interruptible(wait_jiffies ? wait_jiffies : 1);
+		/* If it is in the past, then this returns immediately */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+		__set_current_state(TASK_RUNNING);
 	}
 	dprintk(dev, 1, "Video Capture Thread End\n");
 	return 0;
@@ -917,4 +1272,5 @@ void vivid_stop_generating_vid_cap(struct vivid_dev *dev, bool *pstreaming)
 	kthread_stop(dev->kthread_vid_cap);
 	dev->kthread_vid_cap = NULL;
 	mutex_lock(&dev->mutex);
+	vivid_frame_ring_free(dev);
 }
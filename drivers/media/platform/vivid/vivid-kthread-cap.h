@@ -22,5 +22,6 @@
 
 int vivid_start_generating_vid_cap(struct vivid_dev *dev, bool *pstreaming);
 void vivid_stop_generating_vid_cap(struct vivid_dev *dev, bool *pstreaming);
+void vivid_frame_ring_free(struct vivid_dev *dev);
 
 #endif
@@ -28,6 +28,7 @@
 #include <linux/videodev2.h>
 #include <linux/kthread.h>
 #include <linux/freezer.h>
+#include <linux/hrtimer.h>
 #include <linux/random.h>
 #include <linux/v4l2-dv-timings.h>
 #include <asm/div64.h>
@@ -123,10 +124,11 @@ static int vivid_thread_vid_out(void *data)
 	struct vivid_dev *dev = data;
 	u64 numerators_since_start;
 	u64 buffers_since_start;
-	u64 next_jiffies_since_start;
+	u64 next_ns_since_start;
 	unsigned long jiffies_since_start;
 	unsigned long cur_jiffies;
-	unsigned wait_jiffies;
+	u64 cur_ns;
+	ktime_t next;
 	unsigned numerator;
 	unsigned denominator;
 
@@ -139,8 +141,13 @@ static int vivid_thread_vid_out(void *data)
 	if (dev->seq_wrap)
 		dev->out_seq_count = 0xffffff80U;
 	dev->jiffies_vid_out = jiffies;
+	dev->ns_vid_out = ktime_get_ns();
 	dev->vid_out_seq_start = dev->vbi_out_seq_start = 0;
 	dev->out_seq_resync = false;
+	vivid_pacing_reset(&dev->pacing_vid_out,
+			   dev->timeperframe_vid_out.numerator,
+			   dev->timeperframe_vid_out.denominator *
+			   (dev->field_out == V4L2_FIELD_ALTERNATE ? 2 : 1));
 
 	for (;;) {
 		try_to_freeze();
@@ -149,24 +156,31 @@ static int vivid_thread_vid_out(void *data)
 
 		mutex_lock(&dev->mutex);
 		cur_jiffies = jiffies;
+		cur_ns = ktime_get_ns();
+		numerator = dev->timeperframe_vid_out.numerator;
+		denominator = dev->timeperframe_vid_out.denominator;
+
+		if (dev->field_out == V4L2_FIELD_ALTERNATE)
+			denominator *= 2;
+
 		if (dev->out_seq_resync) {
 			dev->jiffies_vid_out = cur_jiffies;
+			dev->ns_vid_out = cur_ns;
 			dev->out_seq_offset = dev->out_seq_count + 1;
 			dev->out_seq_count = 0;
 			dev->out_seq_resync = false;
+			vivid_pacing_reset(&dev->pacing_vid_out,
+					   numerator, denominator);
 		}
-		numerator = dev->timeperframe_vid_out.numerator;
-		denominator = dev->timeperframe_vid_out.denominator;
-
-		if (dev->field_out == V4L2_FIELD_ALTERNATE)
-			denominator *= 2;
+		vivid_pacing_update(&dev->pacing_vid_out, cur_ns);
 
 		/* Calculate the number of jiffies since we started streaming */
 		jiffies_since_start = cur_jiffies - dev->jiffies_vid_out;
 		/* Get the number of buffers streamed since the start */
-		buffers_since_start = (u64)jiffies_since_start * denominator +
-				      (HZ * numerator) / 2;
-		do_div(buffers_since_start, HZ * numerator);
+		buffers_since_start = vivid_ns_to_numerators(cur_ns - dev->ns_vid_out,
+							     denominator) +
+				      numerator / 2;
+		do_div(buffers_since_start, numerator);
 
 		/*
 		 * After more than 0xf0000000 (rounded down to a multiple of
@@ -176,6 +190,7 @@ static int vivid_thread_vid_out(void *data)
 		 */
 		if (jiffies_since_start > JIFFIES_RESYNC) {
 			dev->jiffies_vid_out = cur_jiffies;
+			dev->ns_vid_out = cur_ns;
 			dev->out_seq_offset = buffers_since_start;
 			buffers_since_start = 0;
 		}
@@ -184,32 +199,29 @@ static int vivid_thread_vid_out(void *data)
 		dev->vbi_out_seq_count = dev->out_seq_count - dev->vbi_out_seq_start;
 
 		vivid_thread_vid_out_tick(dev);
-		mutex_unlock(&dev->mutex);
 
 		/*
 		 * Calculate the number of 'numerators' streamed since we started,
-		 * not including the current buffer.
+		 * including the current buffer.
 		 */
-		numerators_since_start = buffers_since_start * numerator;
+		numerators_since_start = ++buffers_since_start * numerator;
 
-		/* And the number of jiffies since we started */
-		jiffies_since_start = jiffies - dev->jiffies_vid_out;
-
-		/* Increase by the 'numerator' of one buffer */
-		numerators_since_start += numerator;
 		/*
 		 * Calculate when that next buffer is supposed to start
-		 * in jiffies since we started streaming.
+		 * in nanoseconds since we started streaming.
 		 */
-		next_jiffies_since_start = numerators_since_start * HZ +
-					   denominator / 2;
-		do_div(next_jiffies_since_start, denominator);
-		/* If it is in the past, then just schedule asap */
-		if (next_jiffies_since_start < jiffies_since_start)
-			next_jiffies_since_start = jiffies_since_start;
-
-		wait_jiffies = next_jiffies_since_start - jiffies_since_start;
-		schedule_timeout_interruptible(wait_jiffies ? wait_jiffies : 1);
+		next_ns_since_start = vivid_numerators_to_ns(numerators_since_start,
+							     denominator);
+		dev->pacing_vid_out.target_ns = dev->ns_vid_out + next_ns_since_start;
+		next = ns_to_ktime(dev->pacing_vid_out.target_ns);
+
+		mutex_unlock(&dev->mutex);
+
+		/* If it is in the past, then this returns immediately */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+		__set_current_state(TASK_RUNNING);
 	}
 	dprintk(dev, 1, "Video Output Thread End\n");
 	return 0;
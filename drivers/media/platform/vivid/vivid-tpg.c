@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <linux/workqueue.h>
+
 #include "vivid-tpg.h"
 
 /* Must remain in sync with enum tpg_pattern */
@@ -113,6 +115,7 @@ void tpg_init(struct tpg_data *tpg, unsigned w, unsigned h)
 	tpg_s_fourcc(tpg, V4L2_PIX_FMT_RGB24);
 	tpg->colorspace = V4L2_COLORSPACE_SRGB;
 	tpg->perc_fill = 100;
+	tpg->workers = 1;
 }
 
 int tpg_alloc(struct tpg_data *tpg, unsigned max_w)
@@ -1464,6 +1467,9 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 		unsigned fract_part = tpg->src_width % tpg->scaled_width;
 		unsigned src_x = 0;
 		unsigned error = 0;
+		/* Colors of the last generated pixel pair */
+		enum tpg_color last1 = TPG_COLOR_MAX;
+		enum tpg_color last2 = TPG_COLOR_MAX;
 
 		for (x = 0; x < tpg->scaled_width * 2; x += 2) {
 			unsigned real_x = src_x;
@@ -1490,8 +1496,18 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 				src_x++;
 			}
 
-			gen_twopix(tpg, pix, tpg->hflip ? color2 : color1, 0);
-			gen_twopix(tpg, pix, tpg->hflip ? color1 : color2, 1);
+			/*
+			 * Most patterns consist of long runs of the same
+			 * pixel pair, so only convert when the colors change.
+			 */
+			if (color1 != last1 || color2 != last2 ||
+			    color1 == TPG_COLOR_RANDOM ||
+			    color2 == TPG_COLOR_RANDOM) {
+				gen_twopix(tpg, pix, tpg->hflip ? color2 : color1, 0);
+				gen_twopix(tpg, pix, tpg->hflip ? color1 : color2, 1);
+				last1 = color1;
+				last2 = color2;
+			}
 			for (p = 0; p < tpg->planes; p++) {
 				unsigned twopixsize = tpg->twopixelsize[p];
 				unsigned hdiv = tpg->hdownsampling[p];
@@ -1858,6 +1874,7 @@ void tpg_log_status(struct tpg_data *tpg)
 	pr_info("tpg Y'CbCr encoding: %d/%d\n", tpg->ycbcr_enc, tpg->real_ycbcr_enc);
 	pr_info("tpg quantization: %d/%d\n", tpg->quantization, tpg->real_quantization);
 	pr_info("tpg RGB range: %d/%d\n", tpg->rgb_range, tpg->real_rgb_range);
+	pr_info("tpg workers: %u\n", tpg->workers);
 }
 
 /*
@@ -2039,12 +2056,15 @@ static void tpg_fill_plane_extras(const struct tpg_data *tpg,
 	}
 }
 
-static void tpg_fill_plane_pattern(const struct tpg_data *tpg,
-				   const struct tpg_draw_params *params,
-				   unsigned p, unsigned h, u8 *vbuf)
+/*
+ * Return the line that has to be copied to buffer line h, or NULL if
+ * nothing but the extras has to be drawn.
+ */
+static const u8 *tpg_get_pattern_line(const struct tpg_data *tpg,
+				      const struct tpg_draw_params *params,
+				      unsigned p, unsigned h)
 {
 	unsigned twopixsize = params->twopixsize;
-	unsigned img_width = params->img_width;
 	unsigned mv_hor_old = params->mv_hor_old;
 	unsigned mv_hor_new = params->mv_hor_new;
 	unsigned mv_vert_old = params->mv_vert_old;
@@ -2065,9 +2085,9 @@ static void tpg_fill_plane_pattern(const struct tpg_data *tpg,
 
 	if (h >= params->hmax) {
 		if (params->hmax == tpg->compose.height)
-			return;
+			return NULL;
 		if (!tpg->perc_fill_blank)
-			return;
+			return NULL;
 		fill_blank = true;
 	}
 
@@ -2158,59 +2178,79 @@ static void tpg_fill_plane_pattern(const struct tpg_data *tpg,
 	case V4L2_FIELD_INTERLACED_TB:
 	case V4L2_FIELD_SEQ_TB:
 	case V4L2_FIELD_SEQ_BT:
-		if (even)
-			memcpy(vbuf, linestart_top, img_width);
-		else
-			memcpy(vbuf, linestart_bottom, img_width);
-		break;
+		return even ? linestart_top : linestart_bottom;
 	case V4L2_FIELD_INTERLACED_BT:
-		if (even)
-			memcpy(vbuf, linestart_bottom, img_width);
-		else
-			memcpy(vbuf, linestart_top, img_width);
-		break;
+		return even ? linestart_bottom : linestart_top;
 	case V4L2_FIELD_TOP:
-		memcpy(vbuf, linestart_top, img_width);
-		break;
+		return linestart_top;
 	case V4L2_FIELD_BOTTOM:
-		memcpy(vbuf, linestart_bottom, img_width);
-		break;
+		return linestart_bottom;
 	case V4L2_FIELD_NONE:
 	default:
-		memcpy(vbuf, linestart_older, img_width);
-		break;
+		return linestart_older;
 	}
 }
 
-void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
-			   unsigned p, u8 *vbuf)
+/* Bits describing which extras tpg_fill_plane_extras() draws on a line */
+#define TPG_EXTRAS_WSS		(1 << 0)
+#define TPG_EXTRAS_IN_BORDER	(1 << 1)
+#define TPG_EXTRAS_BORDER_EDGE	(1 << 2)
+#define TPG_EXTRAS_SQUARE	(1 << 3)
+
+static unsigned tpg_get_extras_mask(const struct tpg_data *tpg,
+				    const struct tpg_draw_params *params)
 {
-	struct tpg_draw_params params;
+	unsigned frame_line = params->frame_line;
+	const struct v4l2_rect *sq = &tpg->square;
+	const struct v4l2_rect *b = &tpg->border;
+	unsigned mask = 0;
+
+	if (params->is_tv && !params->is_60hz &&
+	    frame_line == 0 && params->wss_width)
+		mask |= TPG_EXTRAS_WSS;
+	if (frame_line >= b->top && frame_line < b->top + b->height) {
+		mask |= TPG_EXTRAS_IN_BORDER;
+		if (frame_line <= b->top + 1 ||
+		    frame_line + 2 >= b->top + b->height)
+			mask |= TPG_EXTRAS_BORDER_EDGE;
+	}
+	if (frame_line >= sq->top && frame_line < sq->top + sq->height)
+		mask |= TPG_EXTRAS_SQUARE;
+	return mask;
+}
+
+/*
+ * Fill lines [h_start, h_end) of the compose rectangle.
+ *
+ * Every composed line is fully determined by the pattern line it is copied
+ * from and by the extras that are drawn on top of it. If both are the same
+ * as for the previous line of this plane, then that line is used as a
+ * template and copied as a whole.
+ */
+static void tpg_fill_plane_lines(const struct tpg_data *tpg,
+				 const struct tpg_draw_params *frame_params,
+				 unsigned p, u8 *vbuf,
+				 unsigned h_start, unsigned h_end)
+{
+	struct tpg_draw_params params = *frame_params;
 	unsigned factor = V4L2_FIELD_HAS_T_OR_B(tpg->field) ? 2 : 1;
 
-	/* Coarse scaling with Bresenham */
+	/* Coarse scaling with Bresenham, starting at line h_start */
 	unsigned int_part = (tpg->crop.height / factor) / tpg->compose.height;
 	unsigned fract_part = (tpg->crop.height / factor) % tpg->compose.height;
-	unsigned src_y = 0;
-	unsigned error = 0;
+	unsigned src_y = h_start * int_part +
+			 h_start * fract_part / tpg->compose.height;
+	unsigned error = h_start * fract_part % tpg->compose.height;
+	const u8 *tmpl_src[TPG_MAX_PLANES] = { NULL };
+	unsigned tmpl_extras[TPG_MAX_PLANES] = { 0 };
+	u8 *tmpl_line[TPG_MAX_PLANES] = { NULL };
 	unsigned h;
 
-	tpg_recalc(tpg);
-
-	params.is_tv = std;
-	params.is_60hz = std & V4L2_STD_525_60;
-	params.twopixsize = tpg->twopixelsize[p];
-	params.img_width = tpg_hdiv(tpg, p, tpg->compose.width);
-	params.stride = tpg->bytesperline[p];
-	params.hmax = (tpg->compose.height * tpg->perc_fill) / 100;
-
-	tpg_fill_params_pattern(tpg, p, &params);
-	tpg_fill_params_extras(tpg, p, &params);
-
-	vbuf += tpg_hdiv(tpg, p, tpg->compose.left);
-
-	for (h = 0; h < tpg->compose.height; h++) {
+	for (h = h_start; h < h_end; h++) {
+		const u8 *src;
+		unsigned extras;
 		unsigned buf_line;
+		u8 *line;
 
 		params.frame_line = tpg_calc_frameline(tpg, src_y, tpg->field);
 		params.frame_line_next = params.frame_line;
@@ -2258,10 +2298,97 @@ void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
 
 			buf_line /= tpg->vdownsampling[p];
 		}
-		tpg_fill_plane_pattern(tpg, &params, p, h,
-				vbuf + buf_line * params.stride);
-		tpg_fill_plane_extras(tpg, &params, p, h,
-				vbuf + buf_line * params.stride);
+
+		line = vbuf + buf_line * params.stride;
+		src = tpg_get_pattern_line(tpg, &params, p, h);
+		extras = tpg_get_extras_mask(tpg, &params);
+
+		if (src && src == tmpl_src[p] && extras == tmpl_extras[p]) {
+			memcpy(line, tmpl_line[p], params.img_width);
+			continue;
+		}
+
+		if (src)
+			memcpy(line, src, params.img_width);
+		tpg_fill_plane_extras(tpg, &params, p, h, line);
+
+		tmpl_src[p] = src;
+		tmpl_extras[p] = extras;
+		tmpl_line[p] = line;
+	}
+}
+
+struct tpg_fill_work {
+	struct work_struct work;
+	const struct tpg_data *tpg;
+	const struct tpg_draw_params *params;
+	unsigned p;
+	u8 *vbuf;
+	unsigned h_start;
+	unsigned h_end;
+};
+
+static void tpg_fill_work_func(struct work_struct *work)
+{
+	struct tpg_fill_work *fw = container_of(work, struct tpg_fill_work, work);
+
+	tpg_fill_plane_lines(fw->tpg, fw->params, fw->p, fw->vbuf,
+			     fw->h_start, fw->h_end);
+}
+
+void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
+			   unsigned p, u8 *vbuf)
+{
+	struct tpg_fill_work fw[TPG_MAX_WORKERS - 1];
+	struct tpg_draw_params params;
+	unsigned workers = tpg->workers;
+	unsigned chunk;
+	unsigned i;
+
+	tpg_recalc(tpg);
+
+	params.is_tv = std;
+	params.is_60hz = std & V4L2_STD_525_60;
+	params.twopixsize = tpg->twopixelsize[p];
+	params.img_width = tpg_hdiv(tpg, p, tpg->compose.width);
+	params.stride = tpg->bytesperline[p];
+	params.hmax = (tpg->compose.height * tpg->perc_fill) / 100;
+
+	tpg_fill_params_pattern(tpg, p, &params);
+	tpg_fill_params_extras(tpg, p, &params);
+
+	vbuf += tpg_hdiv(tpg, p, tpg->compose.left);
+
+	if (workers > tpg->compose.height / TPG_MIN_WORKER_LINES)
+		workers = tpg->compose.height / TPG_MIN_WORKER_LINES;
+	if (workers <= 1) {
+		tpg_fill_plane_lines(tpg, &params, p, vbuf,
+				     0, tpg->compose.height);
+		return;
+	}
+
+	/*
+	 * Split the compose rectangle in bands of lines, keep the first
+	 * band for ourselves and hand the others to unbound workers.
+	 */
+	chunk = DIV_ROUND_UP(tpg->compose.height, workers);
+	for (i = 0; i < workers - 1; i++) {
+		fw[i].tpg = tpg;
+		fw[i].params = &params;
+		fw[i].p = p;
+		fw[i].vbuf = vbuf;
+		fw[i].h_start = min(tpg->compose.height, (i + 1) * chunk);
+		fw[i].h_end = min(tpg->compose.height, (i + 2) * chunk);
+		INIT_WORK_ONSTACK(&fw[i].work, tpg_fill_work_func);
+		queue_work(system_unbound_wq, &fw[i].work);
+	}
+
+	tpg_fill_plane_lines(tpg, &params, p, vbuf,
+			     0, min(tpg->compose.height, chunk));
+
+	for (i = 0; i < workers - 1; i++) {
+		flush_work(&fw[i].work);
+		destroy_work_on_stack(&fw[i].work);
 	}
 }
 
@@ -92,6 +92,10 @@ extern const char * const tpg_aspect_strings[];
 
 #define TPG_MAX_PLANES 3
 #define TPG_MAX_PAT_LINES 8
+/* Maximum number of CPUs a single plane is generated on */
+#define TPG_MAX_WORKERS 8
+/* Don't bother splitting up planes with fewer lines per worker */
+#define TPG_MIN_WORKER_LINES 64
 
 struct tpg_data {
 	/* Source frame size */
@@ -184,6 +188,9 @@ struct tpg_data {
 	bool				recalc_lines;
 	bool				recalc_square_border;
 
+	/* Number of CPUs used to generate a plane */
+	unsigned			workers;
+
 	/* Used to store TPG_MAX_PAT_LINES lines, each with up to two planes */
 	unsigned			max_line_width;
 	u8				*lines[TPG_MAX_PAT_LINES][TPG_MAX_PLANES];
@@ -535,6 +542,16 @@ static inline void tpg_s_insert_eav(struct tpg_data *tpg, bool insert_eav)
 	tpg->insert_eav = insert_eav;
 }
 
+static inline void tpg_s_workers(struct tpg_data *tpg, unsigned workers)
+{
+	tpg->workers = clamp_t(unsigned, workers, 1, TPG_MAX_WORKERS);
+}
+
+static inline unsigned tpg_g_workers(const struct tpg_data *tpg)
+{
+	return tpg->workers;
+}
+
 void tpg_update_mv_step(struct tpg_data *tpg);
 
 static inline void tpg_s_mv_hor_mode(struct tpg_data *tpg,
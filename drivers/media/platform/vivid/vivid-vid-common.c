@@ -20,6 +20,8 @@
 #include <linux/errno.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/videodev2.h>
 #include <linux/v4l2-dv-timings.h>
 #include <media/v4l2-common.h>
@@ -515,6 +517,100 @@ const struct vivid_fmt *vivid_get_format(struct vivid_dev *dev, u32 pixelformat)
 	return NULL;
 }
 
+/* Number of frames generated per format by vivid_tpg_benchmark() */
+#define VIVID_TPG_BENCH_FRAMES 16
+
+/*
+ * Measure the test pattern generator throughput in megapixels per second
+ * for every format at the source resolution, using the test pattern and
+ * number of workers saved by vivid_tpg_benchmark(). This uses a private tpg
+ * instance so that it can run while streaming, and runs without dev->mutex
+ * held so that it doesn't block the other ioctls.
+ */
+void vivid_tpg_benchmark_work(struct work_struct *work)
+{
+	struct vivid_dev *dev = container_of(work, struct vivid_dev,
+					     tpg_bench_work);
+	unsigned w = dev->tpg_bench_width;
+	unsigned h = dev->tpg_bench_height;
+	struct tpg_data *tpg;
+	unsigned k;
+
+	tpg = kzalloc(sizeof(*tpg), GFP_KERNEL);
+	if (!tpg)
+		return;
+	tpg_init(tpg, w, h);
+	if (tpg_alloc(tpg, w))
+		goto free_tpg;
+	tpg_s_pattern(tpg, dev->tpg_bench_pattern);
+	tpg_s_workers(tpg, dev->tpg_bench_workers);
+
+	v4l2_info(&dev->v4l2_dev, "tpg benchmark: %ux%u, %u worker(s)\n",
+		  w, h, tpg_g_workers(tpg));
+
+	for (k = 0; k < ARRAY_SIZE(vivid_formats); k++) {
+		u32 fourcc = vivid_formats[k].fourcc;
+		unsigned size = 0;
+		u64 start, ns, mpps;
+		unsigned i, p;
+		u8 *vbuf;
+
+		if (!tpg_s_fourcc(tpg, fourcc))
+			continue;
+		tpg_reset_source(tpg, w, h, V4L2_FIELD_NONE);
+		for (p = 0; p < tpg_g_planes(tpg); p++)
+			size += tpg_calc_plane_size(tpg, p);
+		vbuf = vmalloc(size);
+		if (!vbuf)
+			break;
+
+		/* The first frame also precalculates the colors and lines */
+		tpg_fillbuffer(tpg, 0, 0, vbuf);
+
+		start = ktime_get_ns();
+		for (i = 0; i < VIVID_TPG_BENCH_FRAMES; i++) {
+			unsigned offset = 0;
+
+			for (p = 0; p < tpg_g_buffers(tpg); p++) {
+				tpg_fillbuffer(tpg, 0, p, vbuf + offset);
+				offset += tpg_calc_plane_size(tpg, p);
+			}
+		}
+		ns = ktime_get_ns() - start;
+		vfree(vbuf);
+
+		/* megapixels per second, times 1000 */
+		mpps = div64_u64((u64)w * h * VIVID_TPG_BENCH_FRAMES * 1000000,
+				 ns ? ns : 1);
+		v4l2_info(&dev->v4l2_dev, "tpg benchmark: %c%c%c%c: %llu.%03llu MP/s\n",
+			  fourcc & 0xff, (fourcc >> 8) & 0xff,
+			  (fourcc >> 16) & 0xff, (fourcc >> 24) & 0xff,
+			  mpps / 1000, mpps % 1000);
+		cond_resched();
+	}
+
+free_tpg:
+	tpg_free(tpg);
+	kfree(tpg);
+}
+
+/*
+ * Start a benchmark with the current capture settings. Called with dev->mutex
+ * held, returns -EBUSY if the previous benchmark is still running.
+ */
+int vivid_tpg_benchmark(struct vivid_dev *dev)
+{
+	if (work_busy(&dev->tpg_bench_work))
+		return -EBUSY;
+
+	dev->tpg_bench_width = dev->src_rect.width;
+	dev->tpg_bench_height = dev->src_rect.height;
+	dev->tpg_bench_pattern = dev->tpg.pattern;
+	dev->tpg_bench_workers = tpg_g_workers(&dev->tpg);
+	queue_work(system_long_wq, &dev->tpg_bench_work);
+	return 0;
+}
+
 bool vivid_vid_can_loop(struct vivid_dev *dev)
 {
 	if (dev->src_rect.width != dev->sink_rect.width ||
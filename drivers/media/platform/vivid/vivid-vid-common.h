@@ -34,6 +34,8 @@ extern const struct v4l2_dv_timings_cap vivid_dv_timings_cap;
 
 const struct vivid_fmt *vivid_get_format(struct vivid_dev *dev, u32 pixelformat);
 
+int vivid_tpg_benchmark(struct vivid_dev *dev);
+void vivid_tpg_benchmark_work(struct work_struct *work);
 bool vivid_vid_can_loop(struct vivid_dev *dev);
 void vivid_send_source_change(struct vivid_dev *dev, unsigned type);
 
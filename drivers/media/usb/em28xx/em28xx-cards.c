@@ -3064,7 +3064,6 @@ static int em28xx_init_dev(struct em28xx *dev, struct usb_device *udev,
 
 	dev->udev = udev;
 	mutex_init(&dev->ctrl_urb_lock);
-	spin_lock_init(&dev->slock);
 
 	dev->em28xx_write_regs = em28xx_write_regs;
 	dev->em28xx_read_reg = em28xx_read_reg;
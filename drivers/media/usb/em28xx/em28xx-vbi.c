@@ -89,9 +89,9 @@ vbi_buffer_queue(struct vb2_buffer *vb)
 	buf->mem = vb2_plane_vaddr(vb, 0);
 	buf->length = vb2_plane_size(vb, 0);
 
-	spin_lock_irqsave(&dev->slock, flags);
+	spin_lock_irqsave(&vbiq->lock, flags);
 	list_add_tail(&buf->list, &vbiq->active);
-	spin_unlock_irqrestore(&dev->slock, flags);
+	spin_unlock_irqrestore(&vbiq->lock, flags);
 }
 
 struct vb2_ops em28xx_vbi_qops = {
@@ -452,74 +452,17 @@ static void em28xx_copy_video(struct em28xx *dev,
 			      unsigned long len)
 {
 	struct em28xx_v4l2 *v4l2 = dev->v4l2;
-	void *fieldstart, *startwrite, *startread;
-	int  linesdone, currlinedone, offset, lencopy, remain;
-	int bytesperline = v4l2->width << 1;
+	size_t copied;
 
 	if (buf->pos + len > buf->length)
 		len = buf->length - buf->pos;
 
-	startread = usb_buf;
-	remain = len;
-
-	if (v4l2->progressive || buf->top_field)
-		fieldstart = buf->vb_buf;
-	else /* interlaced mode, even nr. of lines */
-		fieldstart = buf->vb_buf + bytesperline;
-
-	linesdone = buf->pos / bytesperline;
-	currlinedone = buf->pos % bytesperline;
-
-	if (v4l2->progressive)
-		offset = linesdone * bytesperline + currlinedone;
-	else
-		offset = linesdone * bytesperline * 2 + currlinedone;
-
-	startwrite = fieldstart + offset;
-	lencopy = bytesperline - currlinedone;
-	lencopy = lencopy > remain ? remain : lencopy;
-
-	if ((char *)startwrite + lencopy > (char *)buf->vb_buf + buf->length) {
-		em28xx_isocdbg("Overflow of %zu bytes past buffer end (1)\n",
-			       ((char *)startwrite + lencopy) -
-			      ((char *)buf->vb_buf + buf->length));
-		remain = (char *)buf->vb_buf + buf->length -
-			 (char *)startwrite;
-		lencopy = remain;
-	}
-	if (lencopy <= 0)
-		return;
-	memcpy(startwrite, startread, lencopy);
-
-	remain -= lencopy;
-
-	while (remain > 0) {
-		if (v4l2->progressive)
-			startwrite += lencopy;
-		else
-			startwrite += lencopy + bytesperline;
-		startread += lencopy;
-		if (bytesperline > remain)
-			lencopy = remain;
-		else
-			lencopy = bytesperline;
-
-		if ((char *)startwrite + lencopy > (char *)buf->vb_buf +
-		    buf->length) {
-			em28xx_isocdbg("Overflow of %zu bytes past buffer end"
-				       "(2)\n",
-				       ((char *)startwrite + lencopy) -
-				       ((char *)buf->vb_buf + buf->length));
-			lencopy = remain = (char *)buf->vb_buf + buf->length -
-				(char *)startwrite;
-		}
-		if (lencopy <= 0)
-			break;
-
-		memcpy(startwrite, startread, lencopy);
-
-		remain -= lencopy;
-	}
+	copied = v4l2_field_weave(buf->vb_buf, buf->length, v4l2->width << 1,
+				  !v4l2->progressive, !buf->top_field,
+				  buf->pos, usb_buf, len);
+	if (copied < len)
+		em28xx_isocdbg("Overflow of %zu bytes past buffer end\n",
+			       len - copied);
 
 	buf->pos += len;
 }
@@ -592,8 +535,11 @@ static inline struct em28xx_buffer *get_next_buf(struct em28xx *dev,
 						 struct em28xx_dmaqueue *dma_q)
 {
 	struct em28xx_buffer *buf;
+	unsigned long flags;
 
+	spin_lock_irqsave(&dma_q->lock, flags);
 	if (list_empty(&dma_q->active)) {
+		spin_unlock_irqrestore(&dma_q->lock, flags);
 		em28xx_isocdbg("No active queue to serve\n");
 		return NULL;
 	}
@@ -602,6 +548,7 @@ static inline struct em28xx_buffer *get_next_buf(struct em28xx *dev,
 	buf = list_entry(dma_q->active.next, struct em28xx_buffer, list);
 	/* Cleans up buffer - Useful for testing for frame/URB loss */
 	list_del(&buf->list);
+	spin_unlock_irqrestore(&dma_q->lock, flags);
 	buf->pos = 0;
 	buf->vb_buf = buf->mem;
 
@@ -639,10 +586,13 @@ static inline void process_frame_data_em28xx(struct em28xx *dev,
 					     unsigned int  data_len)
 {
 	struct em28xx_v4l2      *v4l2 = dev->v4l2;
-	struct em28xx_buffer    *buf = dev->usb_ctl.vid_buf;
-	struct em28xx_buffer    *vbi_buf = dev->usb_ctl.vbi_buf;
 	struct em28xx_dmaqueue  *dma_q = &dev->vidq;
 	struct em28xx_dmaqueue  *vbi_dma_q = &dev->vbiq;
+	bool                    vid_on = READ_ONCE(dma_q->streaming);
+	bool                    vbi_on = READ_ONCE(vbi_dma_q->streaming);
+	struct em28xx_buffer    *buf = vid_on ? dev->usb_ctl.vid_buf : NULL;
+	struct em28xx_buffer    *vbi_buf = vbi_on ? dev->usb_ctl.vbi_buf
+						  : NULL;
 
 	/* capture type 0 = vbi start
 	   capture type 1 = vbi in progress
@@ -677,8 +627,11 @@ static inline void process_frame_data_em28xx(struct em28xx *dev,
 	 * have no continuation header */
 
 	if (v4l2->capture_type == 0) {
-		vbi_buf = finish_field_prepare_next(dev, vbi_buf, vbi_dma_q);
-		dev->usb_ctl.vbi_buf = vbi_buf;
+		if (vbi_on) {
+			vbi_buf = finish_field_prepare_next(dev, vbi_buf,
+							    vbi_dma_q);
+			dev->usb_ctl.vbi_buf = vbi_buf;
+		}
 		v4l2->capture_type = 1;
 	}
 
@@ -701,8 +654,10 @@ static inline void process_frame_data_em28xx(struct em28xx *dev,
 	}
 
 	if (v4l2->capture_type == 2) {
-		buf = finish_field_prepare_next(dev, buf, dma_q);
-		dev->usb_ctl.vid_buf = buf;
+		if (vid_on) {
+			buf = finish_field_prepare_next(dev, buf, dma_q);
+			dev->usb_ctl.vid_buf = buf;
+		}
 		v4l2->capture_type = 3;
 	}
 
@@ -717,11 +672,15 @@ static inline void process_frame_data_em25xx(struct em28xx *dev,
 					     unsigned char *data_pkt,
 					     unsigned int  data_len)
 {
-	struct em28xx_buffer    *buf = dev->usb_ctl.vid_buf;
 	struct em28xx_dmaqueue  *dmaq = &dev->vidq;
+	struct em28xx_buffer    *buf;
 	struct em28xx_v4l2      *v4l2 = dev->v4l2;
 	bool frame_end = false;
 
+	if (!READ_ONCE(dmaq->streaming))
+		return;
+	buf = dev->usb_ctl.vid_buf;
+
 	/* Check for header */
 	/* NOTE: at least with bulk transfers, only the first packet
 	 * has a header and has always set the FRAME_END bit         */
@@ -924,6 +883,7 @@ int em28xx_start_analog_streaming(struct vb2_queue *vq, unsigned int count)
 {
 	struct em28xx *dev = vb2_get_drv_priv(vq);
 	struct em28xx_v4l2 *v4l2 = dev->v4l2;
+	struct em28xx_dmaqueue *dma_q;
 	struct v4l2_frequency f;
 	struct v4l2_fh *owner;
 	int rc = 0;
@@ -936,6 +896,9 @@ int em28xx_start_analog_streaming(struct vb2_queue *vq, unsigned int count)
 	if (rc)
 		return rc;
 
+	dma_q = vq->type == V4L2_BUF_TYPE_VBI_CAPTURE ? &dev->vbiq : &dev->vidq;
+	WRITE_ONCE(dma_q->streaming, true);
+
 	if (v4l2->streaming_users == 0) {
 		/* First active streaming user, so allocate all the URBs */
 
@@ -954,8 +917,10 @@ int em28xx_start_analog_streaming(struct vb2_queue *vq, unsigned int count)
 					  dev->max_pkt_size,
 					  dev->packet_multiplier,
 					  em28xx_urb_data_copy);
-		if (rc < 0)
+		if (rc < 0) {
+			WRITE_ONCE(dma_q->streaming, false);
 			return rc;
+		}
 
 		/*
 		 * djh: it's not clear whether this code is still needed.  I'm
@@ -980,12 +945,41 @@ int em28xx_start_analog_streaming(struct vb2_queue *vq, unsigned int count)
 	return rc;
 }
 
+/*
+ * Give back the buffers of a stopping stream. The URBs keep running when the
+ * other stream (video or VBI) is still in use: once the streaming flag is
+ * cleared, wait for the completion handlers in progress, which run with
+ * preemption disabled, to let go of the current buffer.
+ */
+static void em28xx_stop_dmaqueue(struct em28xx_dmaqueue *dma_q,
+				 struct em28xx_buffer **cur_buf)
+{
+	unsigned long flags = 0;
+
+	WRITE_ONCE(dma_q->streaming, false);
+	synchronize_sched();
+
+	if (*cur_buf != NULL) {
+		vb2_buffer_done(&(*cur_buf)->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+		*cur_buf = NULL;
+	}
+
+	spin_lock_irqsave(&dma_q->lock, flags);
+	while (!list_empty(&dma_q->active)) {
+		struct em28xx_buffer *buf;
+
+		buf = list_entry(dma_q->active.next, struct em28xx_buffer,
+				 list);
+		list_del(&buf->list);
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+	spin_unlock_irqrestore(&dma_q->lock, flags);
+}
+
 static void em28xx_stop_streaming(struct vb2_queue *vq)
 {
 	struct em28xx *dev = vb2_get_drv_priv(vq);
 	struct em28xx_v4l2 *v4l2 = dev->v4l2;
-	struct em28xx_dmaqueue *vidq = &dev->vidq;
-	unsigned long flags = 0;
 
 	em28xx_videodbg("%s\n", __func__);
 
@@ -996,28 +990,13 @@ static void em28xx_stop_streaming(struct vb2_queue *vq)
 		em28xx_uninit_usb_xfer(dev, EM28XX_ANALOG_MODE);
 	}
 
-	spin_lock_irqsave(&dev->slock, flags);
-	if (dev->usb_ctl.vid_buf != NULL) {
-		vb2_buffer_done(&dev->usb_ctl.vid_buf->vb.vb2_buf,
-				VB2_BUF_STATE_ERROR);
-		dev->usb_ctl.vid_buf = NULL;
-	}
-	while (!list_empty(&vidq->active)) {
-		struct em28xx_buffer *buf;
-
-		buf = list_entry(vidq->active.next, struct em28xx_buffer, list);
-		list_del(&buf->list);
-		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
-	}
-	spin_unlock_irqrestore(&dev->slock, flags);
+	em28xx_stop_dmaqueue(&dev->vidq, &dev->usb_ctl.vid_buf);
 }
 
 void em28xx_stop_vbi_streaming(struct vb2_queue *vq)
 {
 	struct em28xx *dev = vb2_get_drv_priv(vq);
 	struct em28xx_v4l2 *v4l2 = dev->v4l2;
-	struct em28xx_dmaqueue *vbiq = &dev->vbiq;
-	unsigned long flags = 0;
 
 	em28xx_videodbg("%s\n", __func__);
 
@@ -1028,20 +1007,7 @@ void em28xx_stop_vbi_streaming(struct vb2_queue *vq)
 		em28xx_uninit_usb_xfer(dev, EM28XX_ANALOG_MODE);
 	}
 
-	spin_lock_irqsave(&dev->slock, flags);
-	if (dev->usb_ctl.vbi_buf != NULL) {
-		vb2_buffer_done(&dev->usb_ctl.vbi_buf->vb.vb2_buf,
-				VB2_BUF_STATE_ERROR);
-		dev->usb_ctl.vbi_buf = NULL;
-	}
-	while (!list_empty(&vbiq->active)) {
-		struct em28xx_buffer *buf;
-
-		buf = list_entry(vbiq->active.next, struct em28xx_buffer, list);
-		list_del(&buf->list);
-		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
-	}
-	spin_unlock_irqrestore(&dev->slock, flags);
+	em28xx_stop_dmaqueue(&dev->vbiq, &dev->usb_ctl.vbi_buf);
 }
 
 static void
@@ -1058,9 +1024,9 @@ buffer_queue(struct vb2_buffer *vb)
 	buf->mem = vb2_plane_vaddr(vb, 0);
 	buf->length = vb2_plane_size(vb, 0);
 
-	spin_lock_irqsave(&dev->slock, flags);
+	spin_lock_irqsave(&vidq->lock, flags);
 	list_add_tail(&buf->list, &vidq->active);
-	spin_unlock_irqrestore(&dev->slock, flags);
+	spin_unlock_irqrestore(&vidq->lock, flags);
 }
 
 static struct vb2_ops em28xx_video_qops = {
@@ -2404,6 +2370,8 @@ static int em28xx_v4l2_init(struct em28xx *dev)
 	/* init video dma queues */
 	INIT_LIST_HEAD(&dev->vidq.active);
 	INIT_LIST_HEAD(&dev->vbiq.active);
+	spin_lock_init(&dev->vidq.lock);
+	spin_lock_init(&dev->vbiq.lock);
 
 	if (dev->board.has_msp34xx) {
 		/* Send a reset to other chips via gpio */
@@ -245,7 +245,7 @@ struct em28xx_usb_ctl {
 		/* isoc/bulk transfer buffers for digital mode */
 	struct em28xx_usb_bufs		digital_bufs;
 
-		/* Stores already requested buffers */
+		/* Stores already requested buffers, see em28xx_dmaqueue */
 	struct em28xx_buffer	*vid_buf;
 	struct em28xx_buffer	*vbi_buf;
 
@@ -283,6 +283,11 @@ struct em28xx_buffer {
 
 struct em28xx_dmaqueue {
 	struct list_head       active;
+	spinlock_t             lock;	/* protects active */
+
+	/* The current buffer of the stream (usb_ctl.vid_buf or vbi_buf) is
+	 * only touched by the URB completion handler while this is set */
+	bool                   streaming;
 
 	wait_queue_head_t          wq;
 };
@@ -673,7 +678,6 @@ struct em28xx {
 	struct em28xx_dmaqueue vidq;
 	struct em28xx_dmaqueue vbiq;
 	struct em28xx_usb_ctl usb_ctl;
-	spinlock_t slock;
 
 	/* usb transfer */
 	struct usb_device *udev;	/* the usb device */
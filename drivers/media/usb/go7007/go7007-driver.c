@@ -26,6 +26,7 @@
 #include <linux/uaccess.h>
 #include <linux/slab.h>
 #include <linux/videodev2.h>
+#include <linux/workqueue.h>
 #include <media/tuner.h>
 #include <media/v4l2-common.h>
 #include <media/v4l2-event.h>
@@ -767,4 +768,27 @@ void go7007_update_board(struct go7007 *go)
 }
 EXPORT_SYMBOL(go7007_update_board);
 
+/*
+ * Requeues buffers released by splice pipes. The pipes can outlive the device
+ * and its file handles, destroying the workqueue waits for the pending
+ * requeues before the module goes away.
+ */
+struct workqueue_struct *go7007_splice_wq;
+
+static int __init go7007_init(void)
+{
+	go7007_splice_wq = alloc_workqueue("go7007_splice", 0, 0);
+	if (!go7007_splice_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+static void __exit go7007_exit(void)
+{
+	destroy_workqueue(go7007_splice_wq);
+}
+
+module_init(go7007_init);
+module_exit(go7007_exit);
+
 MODULE_LICENSE("GPL v2");
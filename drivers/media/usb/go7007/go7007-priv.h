@@ -142,6 +142,19 @@ struct go7007_buffer {
 	u32 modet_active;
 };
 
+/*
+ * A frame whose buffer pages were handed to a pipe by splice. The buffer is
+ * queued again once the pipe has released all of its pages.
+ */
+struct go7007_splice_frame {
+	struct kref ref;
+	struct work_struct work;
+	struct go7007 *go;
+	unsigned int index;
+	unsigned int length;
+	unsigned int generation;
+};
+
 #define GO7007_RATIO_1_1	0
 #define GO7007_RATIO_4_3	1
 #define GO7007_RATIO_16_9	2
@@ -241,6 +254,12 @@ struct go7007 {
 	wait_queue_head_t frame_waitq;
 	struct go7007_buffer *active_buf;
 
+	/* splice state, the frame is protected by queue_lock */
+	struct mutex splice_lock;
+	struct go7007_splice_frame *splice_frame;
+	unsigned int splice_pos;
+	unsigned int splice_generation;
+
 	/* Audio streaming */
 	void (*audio_deliver)(struct go7007 *go, u8 *buf, int length);
 	void *snd_context;
@@ -278,6 +297,7 @@ static inline struct go7007 *to_go7007(struct v4l2_device *v4l2_dev)
 			((go)->hpi_ops->write_interrupt)((go), (x)|0x8000, (y))
 
 /* go7007-driver.c */
+extern struct workqueue_struct *go7007_splice_wq;
 int go7007_read_addr(struct go7007 *go, u16 addr, u16 *data);
 int go7007_read_interrupt(struct go7007 *go, u16 *value, u16 *data);
 int go7007_boot_encoder(struct go7007 *go, int init_i2c);
@@ -21,6 +21,8 @@
 #include <linux/time.h>
 #include <linux/vmalloc.h>
 #include <linux/pagemap.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 #include <linux/i2c.h>
 #include <linux/mutex.h>
 #include <linux/uaccess.h>
@@ -423,6 +425,267 @@ static void go7007_buf_finish(struct vb2_buffer *vb)
 	vbuf->field = V4L2_FIELD_NONE;
 }
 
+/*
+ * splice support
+ *
+ * The pages of a dequeued frame are linked into the pipe instead of being
+ * copied, and the buffer is only queued again once the pipe released them.
+ * Each splice call ends at a frame boundary.
+ */
+#define GO7007_SPLICE_BUFS	8
+
+static void go7007_splice_requeue(struct work_struct *work)
+{
+	struct go7007_splice_frame *frame =
+		container_of(work, struct go7007_splice_frame, work);
+	struct go7007 *go = frame->go;
+	struct v4l2_buffer b = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		.memory = V4L2_MEMORY_MMAP,
+		.index = frame->index,
+	};
+
+	mutex_lock(&go->queue_lock);
+	if (frame->generation == go->splice_generation &&
+	    vb2_is_streaming(&go->vidq))
+		vb2_qbuf(&go->vidq, &b);
+	mutex_unlock(&go->queue_lock);
+
+	kfree(frame);
+	v4l2_device_put(&go->v4l2_dev);
+}
+
+/* may be called from the pipe code, defer the requeue to process context */
+static void go7007_splice_frame_release(struct kref *ref)
+{
+	struct go7007_splice_frame *frame =
+		container_of(ref, struct go7007_splice_frame, ref);
+
+	INIT_WORK(&frame->work, go7007_splice_requeue);
+	queue_work(go7007_splice_wq, &frame->work);
+}
+
+static void go7007_pipe_buf_release(struct pipe_inode_info *pipe,
+				    struct pipe_buffer *buf)
+{
+	struct go7007_splice_frame *frame = (void *)buf->private;
+
+	put_page(buf->page);
+	kref_put(&frame->ref, go7007_splice_frame_release);
+}
+
+static void go7007_pipe_buf_get(struct pipe_inode_info *pipe,
+				struct pipe_buffer *buf)
+{
+	struct go7007_splice_frame *frame = (void *)buf->private;
+
+	get_page(buf->page);
+	kref_get(&frame->ref);
+}
+
+/* the pages belong to a vb2 buffer, they can't be stolen */
+static int go7007_pipe_buf_steal(struct pipe_inode_info *pipe,
+				 struct pipe_buffer *buf)
+{
+	return 1;
+}
+
+static const struct pipe_buf_operations go7007_pipe_buf_ops = {
+	.can_merge = 0,
+	.confirm = generic_pipe_buf_confirm,
+	.release = go7007_pipe_buf_release,
+	.steal = go7007_pipe_buf_steal,
+	.get = go7007_pipe_buf_get,
+};
+
+static void go7007_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	struct go7007_splice_frame *frame = (void *)spd->partial[i].private;
+
+	put_page(spd->pages[i]);
+	kref_put(&frame->ref, go7007_splice_frame_release);
+}
+
+/* function expects go->queue_lock to be held by caller */
+static void go7007_splice_stop(struct go7007 *go)
+{
+	go->splice_generation++;
+	if (go->splice_frame) {
+		kref_put(&go->splice_frame->ref, go7007_splice_frame_release);
+		go->splice_frame = NULL;
+	}
+}
+
+/* function expects go->queue_lock to be held by caller */
+static int go7007_splice_start(struct go7007 *go, struct file *file)
+{
+	struct vb2_queue *q = &go->vidq;
+	struct v4l2_requestbuffers req = {
+		.count = GO7007_SPLICE_BUFS,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	unsigned int i;
+	int ret;
+
+	ret = vb2_reqbufs(q, &req);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < q->num_buffers; i++) {
+		struct v4l2_buffer b = {
+			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			.memory = V4L2_MEMORY_MMAP,
+			.index = i,
+		};
+
+		ret = vb2_qbuf(q, &b);
+		if (ret)
+			goto err;
+	}
+
+	ret = vb2_streamon(q, V4L2_BUF_TYPE_VIDEO_CAPTURE);
+	if (ret)
+		goto err;
+
+	q->owner = file->private_data;
+	return 0;
+
+err:
+	req.count = 0;
+	vb2_reqbufs(q, &req);
+	return ret;
+}
+
+/* function expects go->queue_lock to be held by caller */
+static int go7007_splice_next_frame(struct go7007 *go, struct file *file,
+				    bool nonblock)
+{
+	struct vb2_queue *q = &go->vidq;
+	struct go7007_splice_frame *frame;
+	struct v4l2_buffer b;
+	int ret;
+
+	if (go->splice_frame)
+		return 0;
+
+	if (q->fileio || (q->owner && q->owner != file->private_data))
+		return -EBUSY;
+	if (!vb2_is_busy(q)) {
+		ret = go7007_splice_start(go, file);
+		if (ret)
+			return ret;
+	}
+	if (!vb2_is_streaming(q) || q->memory != V4L2_MEMORY_MMAP)
+		return -EINVAL;
+
+	frame = kzalloc(sizeof(*frame), GFP_KERNEL);
+	if (!frame)
+		return -ENOMEM;
+
+	for (;;) {
+		memset(&b, 0, sizeof(b));
+		b.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		b.memory = V4L2_MEMORY_MMAP;
+		ret = vb2_dqbuf(q, &b, nonblock);
+		if (ret) {
+			kfree(frame);
+			return ret;
+		}
+		if (b.bytesused && !(b.flags & V4L2_BUF_FLAG_ERROR))
+			break;
+		vb2_qbuf(q, &b);
+	}
+
+	kref_init(&frame->ref);
+	frame->go = go;
+	frame->index = b.index;
+	frame->length = b.bytesused;
+	frame->generation = go->splice_generation;
+	v4l2_device_get(&go->v4l2_dev);
+
+	go->splice_frame = frame;
+	go->splice_pos = 0;
+	return 0;
+}
+
+static ssize_t go7007_splice_read(struct file *file, loff_t *ppos,
+				  struct pipe_inode_info *pipe, size_t len,
+				  unsigned int flags)
+{
+	struct go7007 *go = video_drvdata(file);
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.flags = flags,
+		.ops = &go7007_pipe_buf_ops,
+		.spd_release = go7007_spd_release,
+	};
+	bool nonblock = (file->f_flags & O_NONBLOCK) ||
+			(flags & SPLICE_F_NONBLOCK);
+	struct go7007_splice_frame *frame;
+	unsigned int pos, end;
+	void *vaddr;
+	ssize_t ret;
+
+	if (!len)
+		return 0;
+	if (mutex_lock_interruptible(&go->splice_lock))
+		return -ERESTARTSYS;
+	if (mutex_lock_interruptible(&go->queue_lock)) {
+		mutex_unlock(&go->splice_lock);
+		return -ERESTARTSYS;
+	}
+
+	ret = go7007_splice_next_frame(go, file, nonblock);
+	if (ret)
+		goto unlock;
+
+	frame = go->splice_frame;
+	vaddr = vb2_plane_vaddr(go->vidq.bufs[frame->index], 0);
+	pos = go->splice_pos;
+	end = min_t(size_t, frame->length, pos + len);
+
+	spd.nr_pages = 0;
+	while (pos < end && spd.nr_pages < spd.nr_pages_max) {
+		void *p = vaddr + pos;
+		unsigned int off = offset_in_page(p);
+		unsigned int cnt = min_t(unsigned int, PAGE_SIZE - off,
+					 end - pos);
+
+		pages[spd.nr_pages] = vmalloc_to_page(p);
+		get_page(pages[spd.nr_pages]);
+		kref_get(&frame->ref);
+		partial[spd.nr_pages].offset = off;
+		partial[spd.nr_pages].len = cnt;
+		partial[spd.nr_pages].private = (unsigned long)frame;
+		spd.nr_pages++;
+		pos += cnt;
+	}
+
+	/* don't hold up the queue while waiting for room in the pipe */
+	mutex_unlock(&go->queue_lock);
+	ret = splice_to_pipe(pipe, &spd);
+	mutex_lock(&go->queue_lock);
+
+	/* the frame may have been dropped by a streamoff in the meantime */
+	if (ret > 0 && go->splice_frame == frame) {
+		go->splice_pos += ret;
+		if (go->splice_pos == frame->length) {
+			go->splice_frame = NULL;
+			kref_put(&frame->ref, go7007_splice_frame_release);
+		}
+	}
+
+unlock:
+	mutex_unlock(&go->queue_lock);
+	mutex_unlock(&go->splice_lock);
+	return ret;
+}
+
 static int go7007_start_streaming(struct vb2_queue *q, unsigned int count)
 {
 	struct go7007 *go = vb2_get_drv_priv(q);
@@ -469,6 +732,7 @@ static void go7007_stop_streaming(struct vb2_queue *q)
 	spin_lock_irqsave(&go->spinlock, flags);
 	INIT_LIST_HEAD(&go->vidq_active);
 	spin_unlock_irqrestore(&go->spinlock, flags);
+	go7007_splice_stop(go);
 	v4l2_ctrl_grab(go->mpeg_video_gop_size, false);
 	v4l2_ctrl_grab(go->mpeg_video_gop_closure, false);
 	v4l2_ctrl_grab(go->mpeg_video_bitrate, false);
@@ -865,6 +1129,7 @@ static struct v4l2_file_operations go7007_fops = {
 	.release	= vb2_fop_release,
 	.unlocked_ioctl	= video_ioctl2,
 	.read		= vb2_fop_read,
+	.splice_read	= go7007_splice_read,
 	.mmap		= vb2_fop_mmap,
 	.poll		= vb2_fop_poll,
 };
@@ -1108,6 +1373,7 @@ int go7007_v4l2_init(struct go7007 *go)
 
 	mutex_init(&go->serialize_lock);
 	mutex_init(&go->queue_lock);
+	mutex_init(&go->splice_lock);
 
 	INIT_LIST_HEAD(&go->vidq_active);
 	go->vidq.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
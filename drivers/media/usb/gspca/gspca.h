@@ -8,6 +8,7 @@
 #include <media/v4l2-common.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
+#include <media/videobuf2-v4l2.h>
 #include <linux/mutex.h>
 
 
@@ -31,9 +32,9 @@ extern int gspca_debug;
 #define PERR(fmt, ...) \
 	v4l2_err(&gspca_dev->v4l2_dev, fmt, ##__VA_ARGS__)
 
-#define GSPCA_MAX_FRAMES 16	/* maximum number of video frame buffers */
 /* image transfers */
 #define MAX_NURBS 4		/* max number of URBs */
+#define GSPCA_MAX_URBS (2 * MAX_NURBS)	/* with deferred decoding spares */
 
 
 /* used to list framerates supported by a camera mode (resolution) */
@@ -64,7 +65,6 @@ struct cam {
 };
 
 struct gspca_dev;
-struct gspca_frame;
 
 /* subdriver operations */
 typedef int (*cam_op) (struct gspca_dev *);
@@ -136,19 +136,21 @@ enum gspca_packet_type {
 	LAST_PACKET
 };
 
-struct gspca_frame {
-	__u8 *data;			/* frame buffer */
-	int vma_use_count;
-	struct v4l2_buffer v4l2_buf;
+struct gspca_buffer {
+	struct vb2_v4l2_buffer vb;
+	struct list_head list;
 };
 
+static inline struct gspca_buffer *to_gspca_buffer(struct vb2_buffer *vb2)
+{
+	return container_of(vb2, struct gspca_buffer, vb.vb2_buf);
+}
+
 struct gspca_dev {
 	struct video_device vdev;	/* !! must be the first item */
 	struct module *module;		/* subdriver handling the device */
 	struct v4l2_device v4l2_dev;
 	struct usb_device *dev;
-	struct file *capt_file;		/* file doing video capture */
-					/* protected by queue_lock */
 #if IS_ENABLED(CONFIG_INPUT)
 	struct input_dev *input_dev;
 	char phys[64];			/* physical device path */
@@ -169,48 +171,44 @@ struct gspca_dev {
 
 #define USB_BUF_SZ 64
 	__u8 *usb_buf;				/* buffer for USB exchanges */
-	struct urb *urb[MAX_NURBS];
+	struct urb *urb[GSPCA_MAX_URBS];
 #if IS_ENABLED(CONFIG_INPUT)
 	struct urb *int_urb;
 #endif
 
-	__u8 *frbuf;				/* buffer for nframes */
-	struct gspca_frame frame[GSPCA_MAX_FRAMES];
+	/* deferred decoding of the transfer URBs */
+	spinlock_t urb_lock;			/* protects the lists below */
+	struct list_head urb_done;		/* URBs waiting for decoding */
+	struct list_head urb_idle;		/* spare URBs */
+	struct work_struct urb_work;
+	u8 urb_deferred;			/* decoding is deferred */
+	u8 urb_target;				/* number of URBs in flight */
+	u8 urb_inflight;
+
+	struct vb2_queue queue;			/* video buffer queue */
+	spinlock_t qlock;			/* protects buf_list */
+	struct list_head buf_list;		/* queued buffers */
 	u8 *image;				/* image beeing filled */
-	__u32 frsz;				/* frame size */
 	u32 image_len;				/* current length of image */
-	atomic_t fr_q;				/* next frame to queue */
-	atomic_t fr_i;				/* frame being filled */
-	signed char fr_queue[GSPCA_MAX_FRAMES];	/* frame queue */
-	char nframes;				/* number of frames */
-	u8 fr_o;				/* next frame to dequeue */
 	__u8 last_packet_type;
 	__s8 empty_packet;		/* if (-1) don't check empty packets */
-	__u8 streaming;			/* protected by both mutexes (*) */
+	__u8 streaming;			/* protected by usb_lock */
 
 	__u8 curr_mode;			/* current camera mode */
 	struct v4l2_pix_format pixfmt;	/* current mode parameters */
 	__u32 sequence;			/* frame sequence number */
 
-	wait_queue_head_t wq;		/* wait queue */
-	struct mutex usb_lock;		/* usb exchange protection */
-	struct mutex queue_lock;	/* ISOC queue protection */
+	struct mutex usb_lock;		/* usb exchange and queue protection */
 	int usb_err;			/* USB error - protected by usb_lock */
 	u16 pkt_size;			/* ISOC packet size */
 #ifdef CONFIG_PM
 	char frozen;			/* suspend - resume */
 #endif
 	char present;			/* device connected */
-	char nbufread;			/* number of buffers for read() */
-	char memory;			/* memory type (V4L2_MEMORY_xxx) */
 	__u8 iface;			/* USB interface number */
 	__u8 alt;			/* USB alternate setting */
 	int xfer_ep;			/* USB transfer endpoint address */
 	u8 audio;			/* presence of audio device */
-
-	/* (*) These variables are proteced by both usb_lock and queue_lock,
-	   that is any code setting them is holding *both*, which means that
-	   any code getting them needs to hold at least one of them */
 };
 
 int gspca_dev_probe(struct usb_interface *intf,
@@ -19,6 +19,8 @@
 #include <linux/usb.h>
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
 #include <linux/videodev2.h>
 #include <linux/v4l2-dv-timings.h>
@@ -84,18 +86,72 @@ static void hdpvr_read_bulk_callback(struct urb *urb)
 /*=========================================================================*/
 /* buffer bits */
 
+/*
+ * The transfer buffers are built from individually refcounted pages, so that
+ * splice can hand them to a pipe without copying. A buffer whose pages went to
+ * a pipe gets fresh pages before it is submitted again.
+ */
+static void *hdpvr_alloc_transfer_mem(struct hdpvr_device *dev)
+{
+	unsigned int order = get_order(dev->bulk_in_size);
+	struct page *page;
+
+	page = alloc_pages(GFP_KERNEL, order);
+	if (!page)
+		return NULL;
+	split_page(page, order);
+
+	return page_address(page);
+}
+
+static void hdpvr_free_transfer_mem(struct hdpvr_device *dev, void *mem)
+{
+	struct page *page = virt_to_page(mem);
+	unsigned int i;
+
+	for (i = 0; i < 1U << get_order(dev->bulk_in_size); i++)
+		put_page(page + i);
+}
+
+/* function expects dev->io_mutex to be hold by caller */
+static void hdpvr_recycle_buffer(struct hdpvr_device *dev,
+				 struct hdpvr_buffer *buf)
+{
+	struct urb *urb = buf->urb;
+	void *mem;
+
+	buf->pos = 0;
+	buf->status = BUFSTAT_AVAILABLE;
+
+	if (buf->spliced) {
+		mem = hdpvr_alloc_transfer_mem(dev);
+		if (!mem) {
+			v4l2_err(&dev->v4l2_dev,
+				 "cannot reallocate usb transfer buffer\n");
+			list_del(&buf->buff_list);
+			hdpvr_free_transfer_mem(dev, urb->transfer_buffer);
+			usb_free_urb(urb);
+			kfree(buf);
+			return;
+		}
+		hdpvr_free_transfer_mem(dev, urb->transfer_buffer);
+		urb->transfer_buffer = mem;
+		buf->spliced = false;
+	}
+
+	list_move_tail(&buf->buff_list, &dev->free_buff_list);
+}
+
 /* function expects dev->io_mutex to be hold by caller */
 int hdpvr_cancel_queue(struct hdpvr_device *dev)
 {
-	struct hdpvr_buffer *buf;
+	struct hdpvr_buffer *buf, *tmp;
 
-	list_for_each_entry(buf, &dev->rec_buff_list, buff_list) {
+	list_for_each_entry_safe(buf, tmp, &dev->rec_buff_list, buff_list) {
 		usb_kill_urb(buf->urb);
-		buf->status = BUFSTAT_AVAILABLE;
+		hdpvr_recycle_buffer(dev, buf);
 	}
 
-	list_splice_init(&dev->rec_buff_list, dev->free_buff_list.prev);
-
 	return 0;
 }
 
@@ -110,8 +166,7 @@ static int hdpvr_free_queue(struct list_head *q)
 		buf = list_entry(p, struct hdpvr_buffer, buff_list);
 
 		urb = buf->urb;
-		usb_free_coherent(urb->dev, urb->transfer_buffer_length,
-				  urb->transfer_buffer, urb->transfer_dma);
+		hdpvr_free_transfer_mem(buf->dev, urb->transfer_buffer);
 		usb_free_urb(urb);
 		tmp = p->next;
 		list_del(p);
@@ -161,8 +216,7 @@ int hdpvr_alloc_buffers(struct hdpvr_device *dev, uint count)
 		}
 		buf->urb = urb;
 
-		mem = usb_alloc_coherent(dev->udev, dev->bulk_in_size, GFP_KERNEL,
-					 &urb->transfer_dma);
+		mem = hdpvr_alloc_transfer_mem(dev);
 		if (!mem) {
 			v4l2_err(&dev->v4l2_dev,
 				 "cannot allocate usb transfer buffer\n");
@@ -175,7 +229,6 @@ int hdpvr_alloc_buffers(struct hdpvr_device *dev, uint count)
 				  mem, dev->bulk_in_size,
 				  hdpvr_read_bulk_callback, buf);
 
-		buf->urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
 		buf->status = BUFSTAT_AVAILABLE;
 		list_add_tail(&buf->buff_list, &dev->free_buff_list);
 	}
@@ -413,41 +466,62 @@ static int hdpvr_release(struct file *file)
  * hdpvr_v4l2_read()
  * will allocate buffers when called for the first time
  */
-static ssize_t hdpvr_read(struct file *file, char __user *buffer, size_t count,
-			  loff_t *pos)
+/* start streaming on the first read and wait for the first buffer */
+static int hdpvr_read_start(struct hdpvr_device *dev, struct file *file,
+			    bool nonblock)
 {
-	struct hdpvr_device *dev = video_drvdata(file);
-	struct hdpvr_buffer *buf = NULL;
-	struct urb *urb;
-	unsigned int ret = 0;
-	int rem, cnt;
-
-	if (*pos)
-		return -ESPIPE;
-
 	mutex_lock(&dev->io_mutex);
 	if (dev->status == STATUS_IDLE) {
 		if (hdpvr_start_streaming(dev)) {
 			v4l2_dbg(MSG_INFO, hdpvr_debug, &dev->v4l2_dev,
 				 "start_streaming failed\n");
-			ret = -EIO;
 			msleep(200);
 			dev->status = STATUS_IDLE;
 			mutex_unlock(&dev->io_mutex);
-			goto err;
+			return -EIO;
 		}
 		dev->owner = file->private_data;
 		print_buffer_status();
 	}
 	mutex_unlock(&dev->io_mutex);
 
-	/* wait for the first buffer */
-	if (!(file->f_flags & O_NONBLOCK)) {
+	if (!nonblock) {
 		if (wait_event_interruptible(dev->wait_data,
 					     hdpvr_get_next_buffer(dev)))
 			return -ERESTARTSYS;
 	}
 
+	return 0;
+}
+
+/* the buffer has been consumed, give it back to the urb worker */
+static void hdpvr_release_buffer(struct hdpvr_device *dev,
+				 struct hdpvr_buffer *buf)
+{
+	mutex_lock(&dev->io_mutex);
+	hdpvr_recycle_buffer(dev, buf);
+	print_buffer_status();
+	mutex_unlock(&dev->io_mutex);
+
+	wake_up_interruptible(&dev->wait_buffer);
+}
+
+static ssize_t hdpvr_read(struct file *file, char __user *buffer, size_t count,
+			  loff_t *pos)
+{
+	struct hdpvr_device *dev = video_drvdata(file);
+	struct hdpvr_buffer *buf = NULL;
+	struct urb *urb;
+	unsigned int ret = 0;
+	int rem, cnt, err;
+
+	if (*pos)
+		return -ESPIPE;
+
+	err = hdpvr_read_start(dev, file, file->f_flags & O_NONBLOCK);
+	if (err)
+		return err;
+
 	buf = hdpvr_get_next_buffer(dev);
 
 	while (count > 0 && buf) {
@@ -491,22 +565,133 @@ static ssize_t hdpvr_read(struct file *file, char __user *buffer, size_t count,
 
 		/* finished, take next buffer */
 		if (buf->pos == urb->actual_length) {
-			mutex_lock(&dev->io_mutex);
-			buf->pos = 0;
-			buf->status = BUFSTAT_AVAILABLE;
+			hdpvr_release_buffer(dev, buf);
+			buf = hdpvr_get_next_buffer(dev);
+		}
+	}
+err:
+	if (!ret && !buf)
+		ret = -EAGAIN;
+	return ret;
+}
 
-			list_move_tail(&buf->buff_list, &dev->free_buff_list);
+/*
+ * splice support
+ *
+ * The pages of the received transfers are linked into the pipe as they are.
+ * The stream is only cut at page boundaries when the pipe fills up, so the
+ * transport stream packets keep the layout the device sent them with.
+ */
+static const struct pipe_buf_operations hdpvr_pipe_buf_ops = {
+	.can_merge = 0,
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = generic_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
 
-			print_buffer_status();
+static void hdpvr_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	put_page(spd->pages[i]);
+}
 
-			mutex_unlock(&dev->io_mutex);
+static ssize_t hdpvr_splice_buffer(struct hdpvr_device *dev,
+				   struct hdpvr_buffer *buf,
+				   struct pipe_inode_info *pipe,
+				   struct splice_pipe_desc *spd, size_t len)
+{
+	struct urb *urb = buf->urb;
+	uint pos = buf->pos;
+	uint end = min_t(size_t, urb->actual_length, pos + len);
+	ssize_t ret;
+
+	spd->nr_pages = 0;
+	while (pos < end && spd->nr_pages < spd->nr_pages_max) {
+		void *p = urb->transfer_buffer + pos;
+		unsigned int off = offset_in_page(p);
+		unsigned int cnt = min_t(uint, PAGE_SIZE - off, end - pos);
+
+		get_page(virt_to_page(p));
+		spd->pages[spd->nr_pages] = virt_to_page(p);
+		spd->partial[spd->nr_pages].offset = off;
+		spd->partial[spd->nr_pages].len = cnt;
+		spd->partial[spd->nr_pages].private = 0;
+		spd->nr_pages++;
+		pos += cnt;
+	}
 
-			wake_up_interruptible(&dev->wait_buffer);
+	ret = splice_to_pipe(pipe, spd);
+	if (ret > 0) {
+		buf->spliced = true;
+		buf->pos += ret;
+	}
 
-			buf = hdpvr_get_next_buffer(dev);
+	return ret;
+}
+
+static ssize_t hdpvr_splice_read(struct file *file, loff_t *ppos,
+				 struct pipe_inode_info *pipe, size_t len,
+				 unsigned int flags)
+{
+	struct hdpvr_device *dev = video_drvdata(file);
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.flags = flags,
+		.ops = &hdpvr_pipe_buf_ops,
+		.spd_release = hdpvr_spd_release,
+	};
+	bool nonblock = (file->f_flags & O_NONBLOCK) ||
+			(flags & SPLICE_F_NONBLOCK);
+	struct hdpvr_buffer *buf;
+	ssize_t ret = 0, cnt;
+
+	cnt = hdpvr_read_start(dev, file, nonblock);
+	if (cnt)
+		return cnt;
+
+	buf = hdpvr_get_next_buffer(dev);
+
+	while (len > 0 && buf) {
+
+		if (buf->status != BUFSTAT_READY &&
+		    dev->status != STATUS_DISCONNECTED) {
+			/* hand over what we have rather than waiting */
+			if (ret)
+				break;
+			if (nonblock)
+				return -EAGAIN;
+
+			if (wait_event_interruptible(dev->wait_data,
+					      buf->status == BUFSTAT_READY))
+				return -ERESTARTSYS;
 		}
+
+		if (buf->status != BUFSTAT_READY)
+			break;
+
+		if (buf->pos < buf->urb->actual_length) {
+			cnt = hdpvr_splice_buffer(dev, buf, pipe, &spd, len);
+			if (cnt <= 0) {
+				if (!ret)
+					ret = cnt;
+				break;
+			}
+			len -= cnt;
+			ret += cnt;
+
+			/* the pipe is full or the request is complete */
+			if (buf->pos != buf->urb->actual_length)
+				break;
+		}
+
+		hdpvr_release_buffer(dev, buf);
+		buf = hdpvr_get_next_buffer(dev);
 	}
-err:
+
 	if (!ret && !buf)
 		ret = -EAGAIN;
 	return ret;
@@ -555,6 +740,7 @@ static const struct v4l2_file_operations hdpvr_fops = {
 	.open		= hdpvr_open,
 	.release	= hdpvr_release,
 	.read		= hdpvr_read,
+	.splice_read	= hdpvr_splice_read,
 	.poll		= hdpvr_poll,
 	.unlocked_ioctl	= video_ioctl2,
 };
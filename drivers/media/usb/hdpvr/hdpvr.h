@@ -146,6 +146,8 @@ struct hdpvr_buffer {
 	uint			pos;
 
 	__u8			status;
+	/* pages of the transfer buffer were handed to a pipe */
+	bool			spliced;
 };
 
 /* */
@@ -30,6 +30,8 @@
 
 #include <linux/string.h>
 #include <linux/slab.h>
+#include <linux/cpumask.h>
+#include <linux/workqueue.h>
 
 /*
  * USE_LOOKUP_TABLE_TO_CLAMP
@@ -466,37 +468,38 @@ static void copy_image_block_CrCb(const int *src, unsigned char *dst, unsigned i
  * __get_nbits(n): faster version of get_bits(n), but asumes that the reservoir
  *                 contains at least n bits. bits returned is discarded.
  */
-#define fill_nbits(pdec, nbits_wanted) do { \
-   while (pdec->nbits_in_reservoir<(nbits_wanted)) \
+#define fill_nbits(band, nbits_wanted) do { \
+   while (band->nbits_in_reservoir<(nbits_wanted)) \
     { \
-      pdec->reservoir |= (*(pdec->stream)++) << (pdec->nbits_in_reservoir); \
-      pdec->nbits_in_reservoir += 8; \
+      band->reservoir |= (*(band->stream)++) << (band->nbits_in_reservoir); \
+      band->nbits_in_reservoir += 8; \
     } \
 }  while(0);
 
-#define skip_nbits(pdec, nbits_to_skip) do { \
-   pdec->reservoir >>= (nbits_to_skip); \
-   pdec->nbits_in_reservoir -= (nbits_to_skip); \
+#define skip_nbits(band, nbits_to_skip) do { \
+   band->reservoir >>= (nbits_to_skip); \
+   band->nbits_in_reservoir -= (nbits_to_skip); \
 }  while(0);
 
-#define get_nbits(pdec, nbits_wanted, result) do { \
-   fill_nbits(pdec, nbits_wanted); \
-   result = (pdec->reservoir) & ((1U<<(nbits_wanted))-1); \
-   skip_nbits(pdec, nbits_wanted); \
+#define get_nbits(band, nbits_wanted, result) do { \
+   fill_nbits(band, nbits_wanted); \
+   result = (band->reservoir) & ((1U<<(nbits_wanted))-1); \
+   skip_nbits(band, nbits_wanted); \
 }  while(0);
 
-#define __get_nbits(pdec, nbits_wanted, result) do { \
-   result = (pdec->reservoir) & ((1U<<(nbits_wanted))-1); \
-   skip_nbits(pdec, nbits_wanted); \
+#define __get_nbits(band, nbits_wanted, result) do { \
+   result = (band->reservoir) & ((1U<<(nbits_wanted))-1); \
+   skip_nbits(band, nbits_wanted); \
 }  while(0);
 
-#define look_nbits(pdec, nbits_wanted) \
-   ((pdec->reservoir) & ((1U<<(nbits_wanted))-1))
+#define look_nbits(band, nbits_wanted) \
+   ((band->reservoir) & ((1U<<(nbits_wanted))-1))
 
 /*
  * Decode a 4x4 pixel block
  */
-static void decode_block(struct pwc_dec23_private *pdec,
+static void decode_block(const struct pwc_dec23_private *pdec,
+			 struct pwc_dec23_band *band,
 			 const unsigned char *ptable0004,
 			 const unsigned char *ptable8004)
 {
@@ -504,23 +507,23 @@ static void decode_block(struct pwc_dec23_private *pdec,
 	unsigned int channel_v, offset1, op;
 	int i;
 
-	fill_nbits(pdec, 16);
-	__get_nbits(pdec, pdec->nbits, primary_color);
+	fill_nbits(band, 16);
+	__get_nbits(band, pdec->nbits, primary_color);
 
-	if (look_nbits(pdec,2) == 0) {
-		skip_nbits(pdec, 2);
+	if (look_nbits(band,2) == 0) {
+		skip_nbits(band, 2);
 		/* Very simple, the color is the same for all pixels of the square */
 		for (i = 0; i < 16; i++)
-			pdec->temp_colors[i] = pdec->table_dc00[primary_color];
+			band->temp_colors[i] = pdec->table_dc00[primary_color];
 
 		return;
 	}
 
 	/* This block is encoded with small pattern */
 	for (i = 0; i < 16; i++)
-		pdec->temp_colors[i] = pdec->table_d800[primary_color];
+		band->temp_colors[i] = pdec->table_d800[primary_color];
 
-	__get_nbits(pdec, 3, channel_v);
+	__get_nbits(band, 3, channel_v);
 	channel_v = ((channel_v & 1) << 2) | (channel_v & 2) | ((channel_v & 4) >> 2);
 
 	ptable0004 += (channel_v * 128);
@@ -538,12 +541,12 @@ static void decode_block(struct pwc_dec23_private *pdec,
 		 *    yxx == any other value
 		 *
 		 */
-		fill_nbits(pdec, 16);
-		htable_idx = look_nbits(pdec, 6);
+		fill_nbits(band, 16);
+		htable_idx = look_nbits(band, 6);
 		op = hash_table_ops[htable_idx * 4];
 
 		if (op == 2) {
-			skip_nbits(pdec, 2);
+			skip_nbits(band, 2);
 
 		} else if (op == 1) {
 			/* 15bits [ xxxx xxxx yyyy 111 ]
@@ -554,15 +557,15 @@ static void decode_block(struct pwc_dec23_private *pdec,
 			unsigned int nbits, col1;
 			unsigned int yyyy;
 
-			skip_nbits(pdec, 3);
+			skip_nbits(band, 3);
 			/* offset1 += yyyy */
-			__get_nbits(pdec, 4, yyyy);
+			__get_nbits(band, 4, yyyy);
 			offset1 += 1 + yyyy;
 			offset1 &= 0x0F;
 			nbits = ptable8004[offset1 * 2];
 
 			/* col1 = xxxx xxxx */
-			__get_nbits(pdec, nbits+1, col1);
+			__get_nbits(band, nbits+1, col1);
 
 			/* Bit mask table */
 			mask = pdec->table_bitpowermask[nbits][col1];
@@ -571,7 +574,7 @@ static void decode_block(struct pwc_dec23_private *pdec,
 
 			block = pdec->table_subblock[rows];
 			for (i = 0; i < 16; i++)
-				pdec->temp_colors[i] += block[MulIdx[offset1][i]];
+				band->temp_colors[i] += block[MulIdx[offset1][i]];
 
 		} else {
 			/* op == 0
@@ -585,17 +588,18 @@ static void decode_block(struct pwc_dec23_private *pdec,
 			rows = ptable0004[offset1 + hash_table_ops [htable_idx * 4 + 3]];
 			block = pdec->table_subblock[rows];
 			for (i = 0; i < 16; i++)
-				pdec->temp_colors[i] += block[MulIdx[offset1][i]];
+				band->temp_colors[i] += block[MulIdx[offset1][i]];
 
 			shift = hash_table_ops[htable_idx * 4 + 1];
-			skip_nbits(pdec, shift);
+			skip_nbits(band, shift);
 		}
 
 	} while (op != 2);
 
 }
 
-static void DecompressBand23(struct pwc_dec23_private *pdec,
+static void DecompressBand23(const struct pwc_dec23_private *pdec,
+			     struct pwc_dec23_band *band,
 			     const unsigned char *rawyuv,
 			     unsigned char *planar_y,
 			     unsigned char *planar_u,
@@ -607,11 +611,11 @@ static void DecompressBand23(struct pwc_dec23_private *pdec,
 	const unsigned char *ptable0004;
 	const unsigned char *ptable8004;
 
-	pdec->reservoir = 0;
-	pdec->nbits_in_reservoir = 0;
-	pdec->stream = rawyuv + 1;	/* The first byte of the stream is skipped */
+	band->reservoir = 0;
+	band->nbits_in_reservoir = 0;
+	band->stream = rawyuv + 1;	/* The first byte of the stream is skipped */
 
-	get_nbits(pdec, 4, compression_index);
+	get_nbits(band, 4, compression_index);
 
 	/* pass 1: uncompress Y component */
 	nblocks = compressed_image_width / 4;
@@ -621,8 +625,8 @@ static void DecompressBand23(struct pwc_dec23_private *pdec,
 
 	/* Each block decode a square of 4x4 */
 	while (nblocks) {
-		decode_block(pdec, ptable0004, ptable8004);
-		copy_image_block_Y(pdec->temp_colors, planar_y, real_image_width, pdec->scalebits);
+		decode_block(pdec, band, ptable0004, ptable8004);
+		copy_image_block_Y(band->temp_colors, planar_y, real_image_width, pdec->scalebits);
 		planar_y += 4;
 		nblocks--;
 	}
@@ -635,11 +639,11 @@ static void DecompressBand23(struct pwc_dec23_private *pdec,
 
 	/* Each block decode a square of 4x4 */
 	while (nblocks) {
-		decode_block(pdec, ptable0004, ptable8004);
-		copy_image_block_CrCb(pdec->temp_colors, planar_u, real_image_width/2, pdec->scalebits);
+		decode_block(pdec, band, ptable0004, ptable8004);
+		copy_image_block_CrCb(band->temp_colors, planar_u, real_image_width/2, pdec->scalebits);
 
-		decode_block(pdec, ptable0004, ptable8004);
-		copy_image_block_CrCb(pdec->temp_colors, planar_v, real_image_width/2, pdec->scalebits);
+		decode_block(pdec, band, ptable0004, ptable8004);
+		copy_image_block_CrCb(band->temp_colors, planar_v, real_image_width/2, pdec->scalebits);
 
 		planar_v += 8;
 		planar_u += 8;
@@ -648,44 +652,84 @@ static void DecompressBand23(struct pwc_dec23_private *pdec,
 
 }
 
+/*
+ * Decompress the bands of a slice, one after the other.
+ */
+static void pwc_dec23_decompress_slice(struct pwc_dec23_slice *slice)
+{
+	struct pwc_dec23_band band;
+	const unsigned char *src = slice->src;
+	unsigned char *pout_planar_y = slice->planar_y;
+	unsigned char *pout_planar_u = slice->planar_u;
+	unsigned char *pout_planar_v = slice->planar_v;
+	unsigned int n;
+
+	for (n = 0; n < slice->nbands; n++) {
+		DecompressBand23(slice->pdec, &band, src,
+				 pout_planar_y, pout_planar_u, pout_planar_v,
+				 slice->width, slice->width);
+		src += slice->vbandlength;
+		pout_planar_y += slice->width * 4;
+		pout_planar_u += slice->width;
+		pout_planar_v += slice->width;
+	}
+}
+
+static void pwc_dec23_slice_work(struct work_struct *work)
+{
+	pwc_dec23_decompress_slice(container_of(work, struct pwc_dec23_slice,
+						work));
+}
+
 /**
  *
  * Uncompress a pwc23 buffer.
  *
  * src: raw data
  * dst: image output
+ *
+ * Each band starts on a byte boundary of the stream and is decoded
+ * independently, so the bands are split into slices which are decompressed
+ * in parallel on the online cpus.
  */
 void pwc_dec23_decompress(struct pwc_device *pdev,
 			  const void *src,
 			  void *dst)
 {
-	int bandlines_left, bytes_per_block;
 	struct pwc_dec23_private *pdec = &pdev->dec23;
-
-	/* YUV420P image format */
-	unsigned char *pout_planar_y;
-	unsigned char *pout_planar_u;
-	unsigned char *pout_planar_v;
-	unsigned int   plane_size;
+	unsigned int nbands, nslices, first, i;
+	unsigned int plane_size;
 
 	mutex_lock(&pdec->lock);
 
-	bandlines_left = pdev->height / 4;
-	bytes_per_block = pdev->width * 4;
+	nbands = pdev->height / 4;
 	plane_size = pdev->height * pdev->width;
+	nslices = min3(num_online_cpus(), nbands, PWC_DEC23_MAX_SLICES);
+	if (nslices == 0)
+		nslices = 1;
+
+	for (i = 0, first = 0; i < nslices; i++) {
+		struct pwc_dec23_slice *slice = &pdec->slices[i];
+
+		slice->pdec = pdec;
+		slice->nbands = (nbands - first) / (nslices - i);
+		slice->width = pdev->width;
+		slice->vbandlength = pdev->vbandlength;
+		slice->src = src + first * pdev->vbandlength;
+		slice->planar_y = dst + first * pdev->width * 4;
+		slice->planar_u = dst + plane_size + first * pdev->width;
+		slice->planar_v = dst + plane_size + plane_size / 4
+				+ first * pdev->width;
+		first += slice->nbands;
+	}
 
-	pout_planar_y = dst;
-	pout_planar_u = dst + plane_size;
-	pout_planar_v = dst + plane_size + plane_size / 4;
-
-	while (bandlines_left--) {
-		DecompressBand23(pdec, src,
-				 pout_planar_y, pout_planar_u, pout_planar_v,
-				 pdev->width, pdev->width);
-		src += pdev->vbandlength;
-		pout_planar_y += bytes_per_block;
-		pout_planar_u += pdev->width;
-		pout_planar_v += pdev->width;
+	for (i = 1; i < nslices; i++) {
+		INIT_WORK(&pdec->slices[i].work, pwc_dec23_slice_work);
+		queue_work(system_unbound_wq, &pdec->slices[i].work);
 	}
+	pwc_dec23_decompress_slice(&pdec->slices[0]);
+	for (i = 1; i < nslices; i++)
+		flush_work(&pdec->slices[i].work);
+
 	mutex_unlock(&pdec->lock);
 }
@@ -26,6 +26,32 @@
 #define PWC_DEC23_H
 
 struct pwc_device;
+struct pwc_dec23_private;
+
+/* Number of slices decompressed in parallel */
+#define PWC_DEC23_MAX_SLICES	4U
+
+/* Stream state, private to the band being decoded */
+struct pwc_dec23_band
+{
+	unsigned int reservoir;
+	unsigned int nbits_in_reservoir;
+
+	const unsigned char *stream;
+	int temp_colors[16];
+};
+
+/* Consecutive bands decompressed by one cpu */
+struct pwc_dec23_slice
+{
+	struct work_struct work;
+	const struct pwc_dec23_private *pdec;
+
+	const unsigned char *src;
+	unsigned char *planar_y, *planar_u, *planar_v;
+	unsigned int nbands;
+	unsigned int width, vbandlength;
+};
 
 struct pwc_dec23_private
 {
@@ -36,12 +62,6 @@ struct pwc_dec23_private
   unsigned int scalebits;
   unsigned int nbitsmask, nbits; /* Number of bits of a color in the compressed stream */
 
-  unsigned int reservoir;
-  unsigned int nbits_in_reservoir;
-
-  const unsigned char *stream;
-  int temp_colors[16];
-
   unsigned char table_0004_pass1[16][1024];
   unsigned char table_0004_pass2[16][1024];
   unsigned char table_8004_pass1[16][256];
@@ -52,6 +72,7 @@ struct pwc_dec23_private
   unsigned int  table_d800[256];
   unsigned int  table_dc00[256];
 
+  struct pwc_dec23_slice slices[PWC_DEC23_MAX_SLICES];
 };
 
 void pwc_dec23_init(struct pwc_device *pdev, const unsigned char *cmd);
@@ -172,6 +172,40 @@ leave:
 	return buf;
 }
 
+static struct pwc_frame_buf *pwc_get_next_decode_buf(struct pwc_device *pdev)
+{
+	unsigned long flags = 0;
+	struct pwc_frame_buf *buf = NULL;
+
+	spin_lock_irqsave(&pdev->queued_bufs_lock, flags);
+	if (list_empty(&pdev->decode_bufs))
+		goto leave;
+
+	buf = list_entry(pdev->decode_bufs.next, struct pwc_frame_buf, list);
+	list_del(&buf->list);
+leave:
+	spin_unlock_irqrestore(&pdev->queued_bufs_lock, flags);
+	return buf;
+}
+
+/*
+ * Decompress the complete frames in process context, in the order they were
+ * received, and hand them to videobuf2 once they are ready.
+ */
+static void pwc_decode_work(struct work_struct *work)
+{
+	struct pwc_device *pdev =
+		container_of(work, struct pwc_device, decode_work);
+	struct pwc_frame_buf *fbuf;
+	int ret;
+
+	while ((fbuf = pwc_get_next_decode_buf(pdev)) != NULL) {
+		ret = pwc_decompress(pdev, fbuf);
+		vb2_buffer_done(&fbuf->vb.vb2_buf, ret ? VB2_BUF_STATE_ERROR
+						       : VB2_BUF_STATE_DONE);
+	}
+}
+
 static void pwc_snapshot_button(struct pwc_device *pdev, int down)
 {
 	if (down) {
@@ -243,7 +277,10 @@ static void pwc_frame_complete(struct pwc_device *pdev)
 		} else {
 			fbuf->vb.field = V4L2_FIELD_NONE;
 			fbuf->vb.sequence = pdev->vframe_count;
-			vb2_buffer_done(&fbuf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+			spin_lock(&pdev->queued_bufs_lock);
+			list_add_tail(&fbuf->list, &pdev->decode_bufs);
+			spin_unlock(&pdev->queued_bufs_lock);
+			queue_work(system_unbound_wq, &pdev->decode_work);
 			pdev->fill_buf = NULL;
 			pdev->vsync = 0;
 		}
@@ -526,6 +563,25 @@ static void pwc_cleanup_queued_bufs(struct pwc_device *pdev,
 	spin_unlock_irqrestore(&pdev->queued_bufs_lock, flags);
 }
 
+/* The urbs must be killed before calling this */
+static void pwc_cleanup_decode_bufs(struct pwc_device *pdev)
+{
+	unsigned long flags = 0;
+
+	cancel_work_sync(&pdev->decode_work);
+
+	spin_lock_irqsave(&pdev->queued_bufs_lock, flags);
+	while (!list_empty(&pdev->decode_bufs)) {
+		struct pwc_frame_buf *buf;
+
+		buf = list_entry(pdev->decode_bufs.next, struct pwc_frame_buf,
+				 list);
+		list_del(&buf->list);
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+	spin_unlock_irqrestore(&pdev->queued_bufs_lock, flags);
+}
+
 #ifdef CONFIG_USB_PWC_DEBUG
 static const char *pwc_sensor_type_to_string(unsigned int sensor_type)
 {
@@ -618,24 +674,6 @@ static int buffer_prepare(struct vb2_buffer *vb)
 	return 0;
 }
 
-static void buffer_finish(struct vb2_buffer *vb)
-{
-	struct pwc_device *pdev = vb2_get_drv_priv(vb->vb2_queue);
-	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
-	struct pwc_frame_buf *buf =
-		container_of(vbuf, struct pwc_frame_buf, vb);
-
-	if (vb->state == VB2_BUF_STATE_DONE) {
-		/*
-		 * Application has called dqbuf and is getting back a buffer
-		 * we've filled, take the pwc data we've stored in buf->data
-		 * and decompress it into a usable format, storing the result
-		 * in the vb2_buffer.
-		 */
-		pwc_decompress(pdev, buf);
-	}
-}
-
 static void buffer_cleanup(struct vb2_buffer *vb)
 {
 	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
@@ -702,6 +740,7 @@ static void stop_streaming(struct vb2_queue *vq)
 		pwc_isoc_cleanup(pdev);
 	}
 
+	pwc_cleanup_decode_bufs(pdev);
 	pwc_cleanup_queued_bufs(pdev, VB2_BUF_STATE_ERROR);
 	if (pdev->fill_buf)
 		vb2_buffer_done(&pdev->fill_buf->vb.vb2_buf,
@@ -713,7 +752,6 @@ static struct vb2_ops pwc_vb_queue_ops = {
 	.queue_setup		= queue_setup,
 	.buf_init		= buffer_init,
 	.buf_prepare		= buffer_prepare,
-	.buf_finish		= buffer_finish,
 	.buf_cleanup		= buffer_cleanup,
 	.buf_queue		= buffer_queue,
 	.start_streaming	= start_streaming,
@@ -1008,6 +1046,8 @@ static int usb_pwc_probe(struct usb_interface *intf, const struct usb_device_id
 	mutex_init(&pdev->vb_queue_lock);
 	spin_lock_init(&pdev->queued_bufs_lock);
 	INIT_LIST_HEAD(&pdev->queued_bufs);
+	INIT_LIST_HEAD(&pdev->decode_bufs);
+	INIT_WORK(&pdev->decode_work, pwc_decode_work);
 
 	pdev->udev = udev;
 	pdev->power_save = my_power_save;
@@ -226,7 +226,9 @@ struct pwc_device
 	/* videobuf2 queue and queued buffers list */
 	struct vb2_queue vb_queue;
 	struct list_head queued_bufs;
-	spinlock_t queued_bufs_lock; /* Protects queued_bufs */
+	struct list_head decode_bufs; /* complete frames to decompress */
+	spinlock_t queued_bufs_lock; /* Protects queued_bufs, decode_bufs */
+	struct work_struct decode_work;
 
 	/* If taking both locks vb_queue_lock must always be locked first! */
 	struct mutex v4l2_lock;      /* Protects everything else */
@@ -160,11 +160,12 @@ struct s2255_mode {
 
 #define S2255_READ_IDLE		0
 #define S2255_READ_FRAME	1
+#define S2255_READ_CONVERT	2	/* waiting for the conversion worker */
 
 /* frame structure */
 struct s2255_framei {
 	unsigned long size;
-	unsigned long ulState;	/* ulState:S2255_READ_IDLE, S2255_READ_FRAME*/
+	unsigned long ulState;	/* ulState:S2255_READ_IDLE, _FRAME, _CONVERT */
 	void *lpvbits;		/* image data */
 	unsigned long cur_size;	/* current data copied to it */
 };
@@ -254,6 +255,10 @@ struct s2255_vc {
 	struct vb2_queue vb_vidq;
 	struct mutex vb_lock; /* streaming lock */
 	spinlock_t qlock;
+	/* filled buffers waiting for the format conversion */
+	struct list_head conv_list;
+	struct work_struct conv_work;
+	unsigned int conv_pending;
 };
 
 
@@ -296,6 +301,9 @@ struct s2255_buffer {
 	/* common v4l buffer stuff -- must be first */
 	struct vb2_v4l2_buffer vb;
 	struct list_head list;
+	/* raw frame to convert into the buffer */
+	int frame;
+	int jpg_size;
 };
 
 
@@ -350,8 +358,7 @@ static int s2255_start_readpipe(struct s2255_dev *dev);
 static void s2255_stop_readpipe(struct s2255_dev *dev);
 static int s2255_start_acquire(struct s2255_vc *vc);
 static int s2255_stop_acquire(struct s2255_vc *vc);
-static void s2255_fillbuff(struct s2255_vc *vc, struct s2255_buffer *buf,
-			   int jpgsize);
+static void s2255_fillbuff(struct s2255_vc *vc, struct s2255_buffer *buf);
 static int s2255_set_mode(struct s2255_vc *vc, struct s2255_mode *mode);
 static int s2255_board_shutdown(struct s2255_dev *dev);
 static void s2255_fwload_start(struct s2255_dev *dev, int reset);
@@ -454,27 +461,33 @@ static int norm_minh(struct s2255_vc *vc)
 /*
  * TODO: fixme: move YUV reordering to hardware
  * converts 2255 planar format to yuyv or uyvy
+ *
+ * The format is tested once per frame, and each pair of pixels is
+ * assembled in a register and written with a single store.
  */
 static void planar422p_to_yuv_packed(const unsigned char *in,
 				     unsigned char *out,
 				     int width, int height,
 				     int fmt)
 {
-	unsigned char *pY;
-	unsigned char *pCb;
-	unsigned char *pCr;
-	unsigned long size = height * width;
-	unsigned int i;
-	pY = (unsigned char *)in;
-	pCr = (unsigned char *)in + height * width;
-	pCb = (unsigned char *)in + height * width + (height * width / 2);
-	for (i = 0; i < size * 2; i += 4) {
-		out[i] = (fmt == V4L2_PIX_FMT_YUYV) ? *pY++ : *pCr++;
-		out[i + 1] = (fmt == V4L2_PIX_FMT_YUYV) ? *pCr++ : *pY++;
-		out[i + 2] = (fmt == V4L2_PIX_FMT_YUYV) ? *pY++ : *pCb++;
-		out[i + 3] = (fmt == V4L2_PIX_FMT_YUYV) ? *pCb++ : *pY++;
+	const unsigned char *pY = in;
+	const unsigned char *pCr = in + height * width;
+	const unsigned char *pCb = pCr + height * width / 2;
+	__le32 *dst = (__le32 *)out;
+	unsigned long pairs = height * width / 2;
+	unsigned long i;
+
+	if (fmt == V4L2_PIX_FMT_YUYV) {
+		for (i = 0; i < pairs; i++, pY += 2)
+			dst[i] = cpu_to_le32(pY[0] | (u32)pCr[i] << 8 |
+					     (u32)pY[1] << 16 |
+					     (u32)pCb[i] << 24);
+	} else {
+		for (i = 0; i < pairs; i++, pY += 2)
+			dst[i] = cpu_to_le32(pCr[i] | (u32)pY[0] << 8 |
+					     (u32)pCb[i] << 16 |
+					     (u32)pY[1] << 24);
 	}
-	return;
 }
 
 static void s2255_reset_dsppower(struct s2255_dev *dev)
@@ -559,6 +572,11 @@ static void s2255_fwchunk_complete(struct urb *urb)
 
 }
 
+/*
+ * Called from the read completion handler with a complete raw frame in
+ * the last_frame slot. The conversion into the buffer is done by the
+ * channel worker; the raw frame slot is skipped by the reader until then.
+ */
 static void s2255_got_frame(struct s2255_vc *vc, int jpgsize)
 {
 	struct s2255_buffer *buf;
@@ -571,20 +589,54 @@ static void s2255_got_frame(struct s2255_vc *vc, int jpgsize)
 		spin_unlock_irqrestore(&vc->qlock, flags);
 		return;
 	}
+	/* keep a raw frame slot for the reader */
+	if (vc->conv_pending >= vc->buffer.dwFrames - 1) {
+		dprintk(dev, 1, "conversion too slow, frame dropped\n");
+		spin_unlock_irqrestore(&vc->qlock, flags);
+		return;
+	}
 	buf = list_entry(vc->buf_list.next,
 			 struct s2255_buffer, list);
 	list_del(&buf->list);
 	v4l2_get_timestamp(&buf->vb.timestamp);
 	buf->vb.field = vc->field;
 	buf->vb.sequence = vc->frame_count;
+	buf->frame = vc->last_frame;
+	buf->jpg_size = jpgsize;
+	vc->buffer.frame[vc->last_frame].ulState = S2255_READ_CONVERT;
+	vc->conv_pending++;
+	list_add_tail(&buf->list, &vc->conv_list);
 	spin_unlock_irqrestore(&vc->qlock, flags);
 
-	s2255_fillbuff(vc, buf, jpgsize);
-	/* tell v4l buffer was filled */
-	vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+	queue_work(system_unbound_wq, &vc->conv_work);
 	dprintk(dev, 2, "%s: [buf] [%p]\n", __func__, buf);
 }
 
+/* converts the raw frames into the queued buffers, in order */
+static void s2255_conv_work(struct work_struct *work)
+{
+	struct s2255_vc *vc = container_of(work, struct s2255_vc, conv_work);
+	struct s2255_buffer *buf;
+	unsigned long flags = 0;
+
+	spin_lock_irqsave(&vc->qlock, flags);
+	while (!list_empty(&vc->conv_list)) {
+		buf = list_first_entry(&vc->conv_list, struct s2255_buffer,
+				       list);
+		list_del(&buf->list);
+		spin_unlock_irqrestore(&vc->qlock, flags);
+
+		s2255_fillbuff(vc, buf);
+		/* tell v4l buffer was filled */
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+
+		spin_lock_irqsave(&vc->qlock, flags);
+		vc->buffer.frame[buf->frame].ulState = S2255_READ_IDLE;
+		vc->conv_pending--;
+	}
+	spin_unlock_irqrestore(&vc->qlock, flags);
+}
+
 static const struct s2255_fmt *format_by_fourcc(int fourcc)
 {
 	unsigned int i;
@@ -609,20 +661,19 @@ static const struct s2255_fmt *format_by_fourcc(int fourcc)
  *
  */
 static void s2255_fillbuff(struct s2255_vc *vc,
-			   struct s2255_buffer *buf, int jpgsize)
+			   struct s2255_buffer *buf)
 {
 	int pos = 0;
 	const char *tmpbuf;
 	char *vbuf = vb2_plane_vaddr(&buf->vb.vb2_buf, 0);
-	unsigned long last_frame;
+	int jpgsize = buf->jpg_size;
 	struct s2255_dev *dev = vc->dev;
 
 	if (!vbuf)
 		return;
-	last_frame = vc->last_frame;
-	if (last_frame != -1) {
+	if (buf->frame != -1) {
 		tmpbuf =
-		    (const char *)vc->buffer.frame[last_frame].lpvbits;
+		    (const char *)vc->buffer.frame[buf->frame].lpvbits;
 		switch (vc->fmt->fourcc) {
 		case V4L2_PIX_FMT_YUYV:
 		case V4L2_PIX_FMT_UYVY:
@@ -646,7 +697,6 @@ static void s2255_fillbuff(struct s2255_vc *vc,
 		default:
 			pr_info("s2255: unknown format?\n");
 		}
-		vc->last_frame = -1;
 	} else {
 		pr_err("s2255: =======no frame\n");
 		return;
@@ -1102,6 +1152,7 @@ static int start_streaming(struct vb2_queue *vq, unsigned int count)
 	vc->bad_payload = 0;
 	vc->cur_frame = 0;
 	vc->frame_count = 0;
+	vc->conv_pending = 0;
 	for (j = 0; j < SYS_FRAMES; j++) {
 		vc->buffer.frame[j].ulState = S2255_READ_IDLE;
 		vc->buffer.frame[j].cur_size = 0;
@@ -1124,6 +1175,17 @@ static void stop_streaming(struct vb2_queue *vq)
 			buf, buf->vb.vb2_buf.index);
 	}
 	spin_unlock_irqrestore(&vc->qlock, flags);
+
+	/* no more frames can be queued for conversion */
+	cancel_work_sync(&vc->conv_work);
+	spin_lock_irqsave(&vc->qlock, flags);
+	list_for_each_entry_safe(buf, node, &vc->conv_list, list) {
+		list_del(&buf->list);
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+		vc->buffer.frame[buf->frame].ulState = S2255_READ_IDLE;
+	}
+	vc->conv_pending = 0;
+	spin_unlock_irqrestore(&vc->qlock, flags);
 }
 
 static int vidioc_s_std(struct file *file, void *priv, v4l2_std_id i)
@@ -1560,6 +1622,7 @@ static const struct v4l2_ioctl_ops s2255_ioctl_ops = {
 	.vidioc_querybuf = vb2_ioctl_querybuf,
 	.vidioc_qbuf = vb2_ioctl_qbuf,
 	.vidioc_dqbuf = vb2_ioctl_dqbuf,
+	.vidioc_expbuf = vb2_ioctl_expbuf,
 	.vidioc_s_std = vidioc_s_std,
 	.vidioc_g_std = vidioc_g_std,
 	.vidioc_enum_input = vidioc_enum_input,
@@ -1632,6 +1695,8 @@ static int s2255_probe_v4l(struct s2255_dev *dev)
 	for (i = 0; i < MAX_CHANNELS; i++) {
 		vc = &dev->vc[i];
 		INIT_LIST_HEAD(&vc->buf_list);
+		INIT_LIST_HEAD(&vc->conv_list);
+		INIT_WORK(&vc->conv_work, s2255_conv_work);
 
 		v4l2_ctrl_handler_init(&vc->hdl, 6);
 		v4l2_ctrl_new_std(&vc->hdl, &s2255_ctrl_ops,
@@ -1658,7 +1723,7 @@ static int s2255_probe_v4l(struct s2255_dev *dev)
 		}
 		q = &vc->vb_vidq;
 		q->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		q->io_modes = VB2_MMAP | VB2_READ | VB2_USERPTR;
+		q->io_modes = VB2_MMAP | VB2_READ | VB2_USERPTR | VB2_DMABUF;
 		q->drv_priv = vc;
 		q->lock = &vc->vb_lock;
 		q->buf_struct_size = sizeof(struct s2255_buffer);
@@ -1856,21 +1921,32 @@ static int save_frame(struct s2255_dev *dev, struct s2255_pipeinfo *pipe_info)
 	dprintk(dev, 4, "cur_size: %lu, size: %lu\n", frm->cur_size, size);
 
 	if (frm->cur_size >= size) {
+		unsigned long flags;
+		int i;
+
 		dprintk(dev, 2, "******[%d]Buffer[%d]full*******\n",
 			dev->cc, idx);
 		vc->last_frame = vc->cur_frame;
-		vc->cur_frame++;
-		/* end of system frame ring buffer, start at zero */
-		if ((vc->cur_frame == SYS_FRAMES) ||
-		    (vc->cur_frame == vc->buffer.dwFrames))
-			vc->cur_frame = 0;
+		frm->ulState = S2255_READ_IDLE;
+		frm->cur_size = 0;
 		/* frame ready */
 		if (vb2_is_streaming(&vc->vb_vidq))
 			s2255_got_frame(vc, vc->jpg_size);
 		vc->frame_count++;
-		frm->ulState = S2255_READ_IDLE;
-		frm->cur_size = 0;
 
+		/* next frame slot not waiting for its conversion */
+		spin_lock_irqsave(&vc->qlock, flags);
+		for (i = 0; i < SYS_FRAMES; i++) {
+			vc->cur_frame++;
+			/* end of system frame ring buffer, start at zero */
+			if ((vc->cur_frame == SYS_FRAMES) ||
+			    (vc->cur_frame == vc->buffer.dwFrames))
+				vc->cur_frame = 0;
+			if (vc->buffer.frame[vc->cur_frame].ulState !=
+			    S2255_READ_CONVERT)
+				break;
+		}
+		spin_unlock_irqrestore(&vc->qlock, flags);
 	}
 	/* done successfully */
 	return 0;
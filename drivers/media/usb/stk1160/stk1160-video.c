@@ -110,14 +110,11 @@ void stk1160_buffer_done(struct stk1160 *dev)
 static inline
 void stk1160_copy_video(struct stk1160 *dev, u8 *src, int len)
 {
-	int linesdone, lineoff, lencopy;
-	int bytesperline = dev->width * 2;
 	struct stk1160_buffer *buf = dev->isoc_ctl.buf;
-	u8 *dst = buf->mem;
-	int remain;
+	size_t copied;
 
 	/*
-	 * TODO: These stk1160_dbg are very spammy!
+	 * TODO: These buffer overflows are very spammy!
 	 * We should 1) check why we are getting them
 	 * and 2) add ratelimit.
 	 *
@@ -130,96 +127,14 @@ void stk1160_copy_video(struct stk1160 *dev, u8 *src, int len)
 	len -= 4;
 	src += 4;
 
-	remain = len;
-
-	linesdone = buf->pos / bytesperline;
-	lineoff = buf->pos % bytesperline; /* offset in current line */
-
-	if (!buf->odd)
-		dst += bytesperline;
-
-	/* Multiply linesdone by two, to take account of the other field */
-	dst += linesdone * bytesperline * 2 + lineoff;
-
-	/* Copy the remaining of current line */
-	if (remain < (bytesperline - lineoff))
-		lencopy = remain;
-	else
-		lencopy = bytesperline - lineoff;
-
-	/*
-	 * Check if we have enough space left in the buffer.
-	 * In that case, we force loop exit after copy.
-	 */
-	if (lencopy > buf->bytesused - buf->length) {
-		lencopy = buf->bytesused - buf->length;
-		remain = lencopy;
-	}
-
-	/* Check if the copy is done */
-	if (lencopy == 0 || remain == 0)
-		return;
-
-	/* Let the bug hunt begin! sanity checks! */
-	if (lencopy < 0) {
-		stk1160_dbg("copy skipped: negative lencopy\n");
-		return;
-	}
-
-	if ((unsigned long)dst + lencopy >
-		(unsigned long)buf->mem + buf->length) {
+	/* Copy the field, interlacing with the other field */
+	copied = v4l2_field_weave(buf->mem, buf->length, dev->width * 2,
+				  true, !buf->odd, buf->pos, src, len);
+	if (copied < len)
 		printk_ratelimited(KERN_WARNING "stk1160: buffer overflow detected\n");
-		return;
-	}
 
-	memcpy(dst, src, lencopy);
-
-	buf->bytesused += lencopy;
-	buf->pos += lencopy;
-	remain -= lencopy;
-
-	/* Copy current field line by line, interlacing with the other field */
-	while (remain > 0) {
-
-		dst += lencopy + bytesperline;
-		src += lencopy;
-
-		/* Copy one line at a time */
-		if (remain < bytesperline)
-			lencopy = remain;
-		else
-			lencopy = bytesperline;
-
-		/*
-		 * Check if we have enough space left in the buffer.
-		 * In that case, we force loop exit after copy.
-		 */
-		if (lencopy > buf->bytesused - buf->length) {
-			lencopy = buf->bytesused - buf->length;
-			remain = lencopy;
-		}
-
-		/* Check if the copy is done */
-		if (lencopy == 0 || remain == 0)
-			return;
-
-		if (lencopy < 0) {
-			printk_ratelimited(KERN_WARNING "stk1160: negative lencopy detected\n");
-			return;
-		}
-
-		if ((unsigned long)dst + lencopy >
-			(unsigned long)buf->mem + buf->length) {
-			printk_ratelimited(KERN_WARNING "stk1160: buffer overflow detected\n");
-			return;
-		}
-
-		memcpy(dst, src, lencopy);
-		remain -= lencopy;
-
-		buf->bytesused += lencopy;
-		buf->pos += lencopy;
-	}
+	buf->bytesused += copied;
+	buf->pos += copied;
 }
 
 /*
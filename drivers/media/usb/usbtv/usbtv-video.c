@@ -249,24 +249,19 @@ static int usbtv_setup_capture(struct usbtv *usbtv)
 }
 
 /* Copy data from chunk into a frame buffer, deinterlacing the data
- * into every second line. Unfortunately, they don't align nicely into
- * 720 pixel lines, as the chunk is 240 words long, which is 480 pixels.
- * Therefore, we break down the chunk into two halves before copyting,
- * so that we can interleave a line if needed. */
-static void usbtv_chunk_to_vbuf(u32 *frame, __be32 *src, int chunk_no, int odd)
+ * into every second line. Chunks are 240 words long, which is 480 pixels,
+ * so they don't align with the 720 pixel lines. v4l2_field_weave() takes
+ * the position of the chunk within the field and splits the copy at the
+ * line boundaries of the selected field. */
+static void usbtv_chunk_to_vbuf(struct usbtv *usbtv, struct usbtv_buf *buf,
+				__be32 *src, int chunk_no, int odd)
 {
-	int half;
+	const size_t chunk_len = USBTV_CHUNK * sizeof(*src);
 
-	for (half = 0; half < 2; half++) {
-		int part_no = chunk_no * 2 + half;
-		int line = part_no / 3;
-		int part_index = (line * 2 + !odd) * 3 + (part_no % 3);
-
-		u32 *dst = &frame[part_index * USBTV_CHUNK/2];
-
-		memcpy(dst, src, USBTV_CHUNK/2 * sizeof(*src));
-		src += USBTV_CHUNK/2;
-	}
+	v4l2_field_weave(vb2_plane_vaddr(&buf->vb.vb2_buf, 0),
+			 vb2_plane_size(&buf->vb.vb2_buf, 0),
+			 usbtv->width * 2, true, !odd,
+			 chunk_no * chunk_len, src, chunk_len);
 }
 
 /* Called for each 256-byte image chunk.
@@ -275,7 +270,6 @@ static void usbtv_chunk_to_vbuf(u32 *frame, __be32 *src, int chunk_no, int odd)
 static void usbtv_image_chunk(struct usbtv *usbtv, __be32 *chunk)
 {
 	int frame_id, odd, chunk_no;
-	u32 *frame;
 	struct usbtv_buf *buf;
 	unsigned long flags;
 
@@ -306,10 +300,9 @@ static void usbtv_image_chunk(struct usbtv *usbtv, __be32 *chunk)
 
 	/* First available buffer. */
 	buf = list_first_entry(&usbtv->bufs, struct usbtv_buf, list);
-	frame = vb2_plane_vaddr(&buf->vb.vb2_buf, 0);
 
 	/* Copy the chunk data. */
-	usbtv_chunk_to_vbuf(frame, &chunk[1], chunk_no, odd);
+	usbtv_chunk_to_vbuf(usbtv, buf, &chunk[1], chunk_no, odd);
 	usbtv->chunks_done++;
 
 	/* Last chunk in a frame, signalling an end */
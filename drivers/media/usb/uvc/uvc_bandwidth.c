@@ -0,0 +1,285 @@
+/*
+ *      uvc_bandwidth.c  --  USB Video Class driver - Bandwidth planning
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/usb.h>
+
+#include "uvcvideo.h"
+
+/* -----------------------------------------------------------------------------
+ * Isochronous bandwidth planning
+ *
+ * The host controller only tells us that an alternate setting doesn't fit by
+ * failing the SET_INTERFACE request, and devices commonly request much more
+ * bandwidth than they need for compressed formats. With several cameras on the
+ * same bus, whether a stream can start then depends on the order in which
+ * streams are started.
+ *
+ * To make this predictable, the bandwidth reserved by all active isochronous
+ * UVC streams is accounted per bus and device speed against the periodic
+ * bandwidth budget defined by the USB specifications. An alternate setting
+ * that covers the bandwidth requested by the device is selected when it fits
+ * in the remaining budget. Otherwise, compressed streams fall back to the
+ * largest alternate setting that fits, as their actual bandwidth is usually
+ * well below the requested value. The host controller has the final word, and
+ * compressed streams step down further when it rejects an alternate setting.
+ *
+ * Bandwidths are expressed in bytes per millisecond. Devices behind the
+ * transaction translators of high-speed hubs are accounted against the full
+ * speed budget of their bus.
+ */
+
+/* 90% of a full-speed frame and 80% of a high-speed microframe. */
+#define UVC_BW_BUDGET_FULL	1350
+#define UVC_BW_BUDGET_HIGH	(6000 * 8)
+/* 90% of a SuperSpeed bus interval. */
+#define UVC_BW_BUDGET_SUPER	(56250 * 8)
+
+static LIST_HEAD(uvc_bw_streams);
+static DEFINE_MUTEX(uvc_bw_lock);
+
+static unsigned int uvc_bw_budget(struct usb_device *udev)
+{
+	switch (udev->speed) {
+	case USB_SPEED_SUPER:
+		return UVC_BW_BUDGET_SUPER;
+	case USB_SPEED_HIGH:
+		return UVC_BW_BUDGET_HIGH;
+	default:
+		return UVC_BW_BUDGET_FULL;
+	}
+}
+
+/*
+ * Convert a number of bytes per service interval to bytes per millisecond.
+ */
+static unsigned int uvc_bw_rate(struct usb_device *udev,
+	struct usb_host_endpoint *ep, unsigned int bpi)
+{
+	unsigned int period = 1 << (clamp_t(unsigned int, ep->desc.bInterval,
+					    1, 16) - 1);
+
+	switch (udev->speed) {
+	case USB_SPEED_SUPER:
+	case USB_SPEED_HIGH:
+		return bpi * 8 / period;
+	default:
+		return bpi / period;
+	}
+}
+
+static bool uvc_bw_same_pool(struct usb_device *a, struct usb_device *b)
+{
+	return a->bus == b->bus && a->speed == b->speed;
+}
+
+/*
+ * Return the bandwidth reserved by the other active streams sharing the
+ * stream bus. Must be called with the bandwidth lock held.
+ */
+static unsigned int uvc_bw_used(struct uvc_streaming *stream)
+{
+	struct uvc_streaming *other;
+	unsigned int used = 0;
+
+	list_for_each_entry(other, &uvc_bw_streams, bandwidth.list) {
+		if (other != stream &&
+		    uvc_bw_same_pool(other->dev->udev, stream->dev->udev))
+			used += other->bandwidth.allocated;
+	}
+
+	return used;
+}
+
+/*
+ * Find the alternate setting with the smallest bandwidth above min, or the
+ * largest bandwidth below max when max is non-zero.
+ */
+static struct usb_host_interface *uvc_bw_find_alt(
+	struct uvc_streaming *stream, unsigned int min, unsigned int max,
+	struct usb_host_endpoint **best_ep)
+{
+	struct usb_device *udev = stream->dev->udev;
+	struct usb_interface *intf = stream->intf;
+	struct usb_host_interface *best = NULL;
+	unsigned int best_rate = 0;
+	unsigned int i;
+
+	for (i = 0; i < intf->num_altsetting; ++i) {
+		struct usb_host_interface *alts = &intf->altsetting[i];
+		struct usb_host_endpoint *ep;
+		unsigned int rate;
+
+		ep = uvc_find_endpoint(alts, stream->header.bEndpointAddress);
+		if (ep == NULL)
+			continue;
+
+		rate = uvc_bw_rate(udev, ep, uvc_endpoint_max_bpi(udev, ep));
+		if (rate == 0 || rate < min || (max && rate > max))
+			continue;
+
+		if (best != NULL &&
+		    (max ? rate <= best_rate : rate >= best_rate))
+			continue;
+
+		best = alts;
+		best_rate = rate;
+		*best_ep = ep;
+	}
+
+	return best;
+}
+
+static void uvc_bandwidth_release_locked(struct uvc_streaming *stream)
+{
+	struct uvc_bandwidth *bw = &stream->bandwidth;
+
+	if (bw->allocated == 0)
+		return;
+
+	list_del(&bw->list);
+	bw->allocated = 0;
+}
+
+/*
+ * Select and set the alternate setting for an isochronous stream, and reserve
+ * its bandwidth. Return the selected endpoint, or an ERR_PTR on failure.
+ */
+struct usb_host_endpoint *uvc_bandwidth_select(struct uvc_streaming *stream)
+{
+	struct usb_device *udev = stream->dev->udev;
+	struct uvc_bandwidth *bw = &stream->bandwidth;
+	struct usb_host_interface *alts, *fallback;
+	struct usb_host_endpoint *ep = NULL, *fallback_ep = NULL;
+	unsigned int available;
+	unsigned int required;
+	unsigned int budget;
+	unsigned int used;
+	bool compressed;
+	int ret;
+
+	compressed = stream->cur_format &&
+		     (stream->cur_format->flags & UVC_FMT_FLAG_COMPRESSED);
+
+	mutex_lock(&uvc_bw_lock);
+
+	uvc_bandwidth_release_locked(stream);
+
+	/* The bandwidth requested by the device is expressed in bytes per
+	 * service interval of its isochronous endpoint, which is the same for
+	 * all alternate settings.
+	 */
+	alts = uvc_bw_find_alt(stream, 1, 0, &ep);
+	if (alts == NULL) {
+		ret = -EIO;
+		goto done;
+	}
+
+	required = uvc_bw_rate(udev, ep,
+			       max_t(u32, stream->ctrl.dwMaxPayloadTransferSize,
+				     1));
+	budget = uvc_bw_budget(udev);
+	used = uvc_bw_used(stream);
+	available = budget > used ? budget - used : 0;
+
+	bw->required = required;
+	bw->budget = budget;
+
+	alts = uvc_bw_find_alt(stream, required, 0, &ep);
+	fallback = compressed && available
+		 ? uvc_bw_find_alt(stream, 1, available, &fallback_ep) : NULL;
+
+	if (alts != NULL && uvc_bw_rate(udev, ep,
+			uvc_endpoint_max_bpi(udev, ep)) <= available) {
+		bw->reason = "fits";
+	} else if (fallback != NULL) {
+		alts = fallback;
+		ep = fallback_ep;
+		bw->reason = "compressed fallback";
+	} else if (alts != NULL) {
+		/* Our estimate of the bus usage doesn't include other drivers,
+		 * it can be pessimistic too. Let the host controller decide.
+		 */
+		bw->reason = "over budget";
+	} else {
+		uvc_trace(UVC_TRACE_VIDEO, "No fast enough alt setting "
+			"for requested bandwidth.\n");
+		bw->reason = "no alt setting";
+		ret = -EIO;
+		goto done;
+	}
+
+	while (1) {
+		unsigned int rate = uvc_bw_rate(udev, ep,
+						uvc_endpoint_max_bpi(udev, ep));
+
+		uvc_trace(UVC_TRACE_VIDEO, "Selecting alternate setting %u "
+			"(%u/%u B/ms bandwidth, %u B/ms available, %s).\n",
+			alts->desc.bAlternateSetting, rate, required,
+			available, bw->reason);
+
+		ret = usb_set_interface(udev, stream->intfnum,
+					alts->desc.bAlternateSetting);
+		if (ret == 0) {
+			bw->altsetting = alts->desc.bAlternateSetting;
+			bw->allocated = rate;
+			list_add_tail(&bw->list, &uvc_bw_streams);
+			break;
+		}
+
+		if (ret != -ENOSPC || !compressed || rate <= 1)
+			break;
+
+		alts = uvc_bw_find_alt(stream, 1, rate - 1, &ep);
+		if (alts == NULL)
+			break;
+
+		bw->reason = "host controller fallback";
+	}
+
+done:
+	mutex_unlock(&uvc_bw_lock);
+	return ret < 0 ? ERR_PTR(ret) : ep;
+}
+
+void uvc_bandwidth_release(struct uvc_streaming *stream)
+{
+	mutex_lock(&uvc_bw_lock);
+	uvc_bandwidth_release_locked(stream);
+	mutex_unlock(&uvc_bw_lock);
+}
+
+size_t uvc_bandwidth_dump(char *buf, size_t size)
+{
+	struct uvc_streaming *stream;
+	size_t count = 0;
+
+	mutex_lock(&uvc_bw_lock);
+
+	list_for_each_entry(stream, &uvc_bw_streams, bandwidth.list) {
+		struct usb_device *udev = stream->dev->udev;
+		struct uvc_bandwidth *bw = &stream->bandwidth;
+
+		count += scnprintf(buf + count, size - count,
+				   "bus %u dev %u intf %u: alt %u, "
+				   "%u/%u B/ms, pool %u/%u B/ms (%s)\n",
+				   udev->bus->busnum, udev->devnum,
+				   stream->intfnum, bw->altsetting,
+				   bw->allocated, bw->required,
+				   uvc_bw_used(stream) + bw->allocated,
+				   bw->budget, bw->reason);
+	}
+
+	mutex_unlock(&uvc_bw_lock);
+
+	return count;
+}
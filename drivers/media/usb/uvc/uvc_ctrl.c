@@ -21,6 +21,7 @@
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/atomic.h>
+#include <linux/delay.h>
 #include <media/v4l2-ctrls.h>
 
 #include "uvcvideo.h"
@@ -914,6 +915,60 @@ static struct uvc_control *uvc_find_control(struct uvc_video_chain *chain,
 	return ctrl;
 }
 
+/* --------------------------------------------------------------------------
+ * Control cache
+ *
+ * Control values are read from the device on first access and cached. Values
+ * of auto-update controls can be changed by the device at any time and are
+ * read from the device for every access by default. When the uvc_ctrl_cache
+ * module parameter is set and the device reports control changes through its
+ * status interrupt endpoint, they are cached for the given number of
+ * milliseconds instead. Cached values are updated or invalidated by control
+ * status events, and values in use are refreshed in the background before they
+ * expire.
+ */
+static bool uvc_ctrl_cacheable(struct uvc_device *dev,
+	struct uvc_control *ctrl)
+{
+	if (!(ctrl->info.flags & UVC_CTRL_FLAG_AUTO_UPDATE))
+		return true;
+
+	return uvc_ctrl_cache_param && dev->int_ep;
+}
+
+static bool uvc_ctrl_expired(struct uvc_device *dev, struct uvc_control *ctrl)
+{
+	return ctrl->loaded && (ctrl->info.flags & UVC_CTRL_FLAG_AUTO_UPDATE) &&
+	       uvc_ctrl_cacheable(dev, ctrl) &&
+	       time_after_eq(jiffies, ctrl->expires);
+}
+
+static void uvc_ctrl_set_loaded(struct uvc_control *ctrl)
+{
+	ctrl->loaded = 1;
+	ctrl->refresh = 0;
+	ctrl->expires = jiffies + msecs_to_jiffies(uvc_ctrl_cache_param);
+}
+
+/*
+ * Schedule a background refresh of a cached auto-update control value that
+ * has reached half of its lifetime.
+ */
+static void uvc_ctrl_schedule_refresh(struct uvc_device *dev,
+	struct uvc_control *ctrl)
+{
+	unsigned long lifetime = msecs_to_jiffies(uvc_ctrl_cache_param);
+
+	if (!ctrl->loaded || ctrl->refresh ||
+	    !(ctrl->info.flags & UVC_CTRL_FLAG_AUTO_UPDATE) ||
+	    !uvc_ctrl_cacheable(dev, ctrl) ||
+	    time_before(jiffies, ctrl->expires - lifetime / 2))
+		return;
+
+	ctrl->refresh = 1;
+	schedule_work(&dev->ctrl_status.work);
+}
+
 static int uvc_ctrl_populate_cache(struct uvc_video_chain *chain,
 	struct uvc_control *ctrl)
 {
@@ -981,6 +1036,9 @@ static int __uvc_ctrl_get(struct uvc_video_chain *chain,
 	if ((ctrl->info.flags & UVC_CTRL_FLAG_GET_CUR) == 0)
 		return -EACCES;
 
+	if (uvc_ctrl_expired(chain->dev, ctrl))
+		ctrl->loaded = 0;
+
 	if (!ctrl->loaded) {
 		ret = uvc_query_ctrl(chain->dev, UVC_GET_CUR, ctrl->entity->id,
 				chain->dev->intfnum, ctrl->info.selector,
@@ -989,7 +1047,9 @@ static int __uvc_ctrl_get(struct uvc_video_chain *chain,
 		if (ret < 0)
 			return ret;
 
-		ctrl->loaded = 1;
+		uvc_ctrl_set_loaded(ctrl);
+	} else {
+		uvc_ctrl_schedule_refresh(chain->dev, ctrl);
 	}
 
 	*value = mapping->get(mapping, UVC_GET_CUR,
@@ -1215,9 +1275,14 @@ static void uvc_ctrl_fill_event(struct uvc_video_chain *chain,
 	ev->u.ctrl.default_value = v4l2_ctrl.default_value;
 }
 
-static void uvc_ctrl_send_event(struct uvc_fh *handle,
-	struct uvc_control *ctrl, struct uvc_control_mapping *mapping,
-	s32 value, u32 changes)
+/*
+ * Send a control event to all subscribers. The handle that originated the
+ * change is skipped unless feedback has been requested, it is NULL for changes
+ * originating from the device.
+ */
+static void uvc_ctrl_send_event(struct uvc_video_chain *chain,
+	struct uvc_fh *handle, struct uvc_control *ctrl,
+	struct uvc_control_mapping *mapping, s32 value, u32 changes)
 {
 	struct v4l2_subscribed_event *sev;
 	struct v4l2_event ev;
@@ -1225,10 +1290,10 @@ static void uvc_ctrl_send_event(struct uvc_fh *handle,
 	if (list_empty(&mapping->ev_subs))
 		return;
 
-	uvc_ctrl_fill_event(handle->chain, &ev, ctrl, mapping, value, changes);
+	uvc_ctrl_fill_event(chain, &ev, ctrl, mapping, value, changes);
 
 	list_for_each_entry(sev, &mapping->ev_subs, node) {
-		if (sev->fh && (sev->fh != &handle->vfh ||
+		if (sev->fh && (handle == NULL || sev->fh != &handle->vfh ||
 		    (sev->flags & V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK) ||
 		    (changes & V4L2_EVENT_CTRL_CH_FLAGS)))
 			v4l2_event_queue_fh(sev->fh, &ev);
@@ -1261,7 +1326,8 @@ static void uvc_ctrl_send_slave_event(struct uvc_fh *handle,
 	if (__uvc_ctrl_get(handle->chain, ctrl, mapping, &val) == 0)
 		changes |= V4L2_EVENT_CTRL_CH_VALUE;
 
-	uvc_ctrl_send_event(handle, ctrl, mapping, val, changes);
+	uvc_ctrl_send_event(handle->chain, handle, ctrl, mapping, val,
+			    changes);
 }
 
 static void uvc_ctrl_send_events(struct uvc_fh *handle,
@@ -1297,8 +1363,8 @@ static void uvc_ctrl_send_events(struct uvc_fh *handle,
 			}
 		}
 
-		uvc_ctrl_send_event(handle, ctrl, mapping, xctrls[i].value,
-				    changes);
+		uvc_ctrl_send_event(handle->chain, handle, ctrl, mapping,
+				    xctrls[i].value, changes);
 	}
 }
 
@@ -1357,6 +1423,216 @@ const struct v4l2_subscribed_event_ops uvc_ctrl_sub_ev_ops = {
 	.merge = v4l2_ctrl_merge,
 };
 
+/* --------------------------------------------------------------------------
+ * Control status events
+ */
+
+/*
+ * Queue a control status event received from the status interrupt endpoint.
+ * Events are processed by uvc_ctrl_status_work() as updating the controls
+ * requires the chain control mutex. This function is called in interrupt
+ * context.
+ */
+void uvc_ctrl_status_event(struct uvc_device *dev, const __u8 *data,
+	unsigned int len)
+{
+	struct uvc_ctrl_status *status;
+	unsigned long flags;
+	unsigned int index;
+
+	spin_lock_irqsave(&dev->ctrl_status.lock, flags);
+	if (dev->ctrl_status.count == UVC_CTRL_STATUS_EVENTS) {
+		dev->ctrl_status.overflow = true;
+	} else {
+		index = (dev->ctrl_status.head + dev->ctrl_status.count)
+		      % UVC_CTRL_STATUS_EVENTS;
+		status = &dev->ctrl_status.events[index];
+		status->len = min_t(unsigned int, len, UVC_MAX_STATUS_SIZE);
+		memcpy(status->data, data, status->len);
+		dev->ctrl_status.count++;
+	}
+	spin_unlock_irqrestore(&dev->ctrl_status.lock, flags);
+
+	schedule_work(&dev->ctrl_status.work);
+}
+
+static void uvc_ctrl_status_notify(struct uvc_video_chain *chain,
+	struct uvc_control *ctrl)
+{
+	struct uvc_control_mapping *mapping;
+	s32 value;
+
+	list_for_each_entry(mapping, &ctrl->info.mappings, list) {
+		if (list_empty(&mapping->ev_subs))
+			continue;
+
+		if (__uvc_ctrl_get(chain, ctrl, mapping, &value) < 0)
+			continue;
+
+		uvc_ctrl_send_event(chain, NULL, ctrl, mapping, value,
+				    V4L2_EVENT_CTRL_CH_VALUE);
+	}
+}
+
+static void uvc_ctrl_status_process(struct uvc_device *dev,
+	const struct uvc_ctrl_status *status)
+{
+	const __u8 *data = status->data;
+	struct uvc_video_chain *chain;
+	struct uvc_control *ctrl = NULL;
+	struct uvc_entity *entity;
+	unsigned int i;
+
+	entity = uvc_entity_by_id(dev, data[1]);
+	if (entity == NULL)
+		return;
+
+	for (i = 0; i < entity->ncontrols; ++i) {
+		if (entity->controls[i].initialized &&
+		    entity->controls[i].info.selector == data[3]) {
+			ctrl = &entity->controls[i];
+			break;
+		}
+	}
+
+	if (ctrl == NULL)
+		return;
+
+	list_for_each_entry(chain, &dev->chains, list) {
+		struct uvc_entity *iter;
+
+		list_for_each_entry(iter, &chain->entities, chain) {
+			if (iter == entity)
+				goto found;
+		}
+	}
+
+	return;
+
+found:
+	mutex_lock(&chain->ctrl_mutex);
+
+	switch (data[4]) {
+	case 0:
+		/* Value change, the new value follows the event header. */
+		if (status->len - 5 >= ctrl->info.size &&
+		    (ctrl->info.flags & UVC_CTRL_FLAG_GET_CUR)) {
+			memcpy(uvc_ctrl_data(ctrl, UVC_CTRL_DATA_CURRENT),
+			       &data[5], ctrl->info.size);
+			uvc_ctrl_set_loaded(ctrl);
+		} else {
+			ctrl->loaded = 0;
+		}
+
+		uvc_ctrl_status_notify(chain, ctrl);
+		break;
+
+	case 1:
+		/* Info change, the minimum, maximum and resolution might have
+		 * changed too.
+		 */
+		ctrl->cached = 0;
+		ctrl->loaded = 0;
+		break;
+
+	case 2:
+		/* Failure change. */
+		ctrl->loaded = 0;
+		break;
+	}
+
+	mutex_unlock(&chain->ctrl_mutex);
+}
+
+/*
+ * Refresh the cached values of the chain auto-update controls marked for
+ * refresh in a single pass, and notify subscribers of the changed values. If
+ * status events have been lost, invalidate all cached values instead.
+ */
+static void uvc_ctrl_refresh_chain(struct uvc_video_chain *chain,
+	bool invalidate)
+{
+	struct uvc_device *dev = chain->dev;
+	struct uvc_control *ctrl;
+	struct uvc_entity *entity;
+	unsigned int i;
+	bool changed;
+	int ret;
+
+	mutex_lock(&chain->ctrl_mutex);
+
+	list_for_each_entry(entity, &chain->entities, chain) {
+		for (i = 0; i < entity->ncontrols; ++i) {
+			ctrl = &entity->controls[i];
+			if (!ctrl->initialized || !ctrl->loaded)
+				continue;
+
+			if (invalidate) {
+				ctrl->loaded = 0;
+				continue;
+			}
+
+			if (!ctrl->refresh)
+				continue;
+
+			ctrl->refresh = 0;
+
+			ret = uvc_query_ctrl(dev, UVC_GET_CUR, entity->id,
+				dev->intfnum, ctrl->info.selector,
+				uvc_ctrl_data(ctrl, UVC_CTRL_DATA_BACKUP),
+				ctrl->info.size);
+			if (ret < 0) {
+				ctrl->loaded = 0;
+				continue;
+			}
+
+			changed = memcmp(uvc_ctrl_data(ctrl, UVC_CTRL_DATA_BACKUP),
+					 uvc_ctrl_data(ctrl, UVC_CTRL_DATA_CURRENT),
+					 ctrl->info.size);
+			memcpy(uvc_ctrl_data(ctrl, UVC_CTRL_DATA_CURRENT),
+			       uvc_ctrl_data(ctrl, UVC_CTRL_DATA_BACKUP),
+			       ctrl->info.size);
+			uvc_ctrl_set_loaded(ctrl);
+
+			if (changed)
+				uvc_ctrl_status_notify(chain, ctrl);
+		}
+	}
+
+	mutex_unlock(&chain->ctrl_mutex);
+}
+
+void uvc_ctrl_status_work(struct work_struct *work)
+{
+	struct uvc_device *dev = container_of(work, struct uvc_device,
+					      ctrl_status.work);
+	struct uvc_video_chain *chain;
+	struct uvc_ctrl_status status;
+	unsigned long flags;
+	bool overflow;
+
+	while (1) {
+		spin_lock_irqsave(&dev->ctrl_status.lock, flags);
+		if (dev->ctrl_status.count == 0) {
+			overflow = dev->ctrl_status.overflow;
+			dev->ctrl_status.overflow = false;
+			spin_unlock_irqrestore(&dev->ctrl_status.lock, flags);
+			break;
+		}
+
+		status = dev->ctrl_status.events[dev->ctrl_status.head];
+		dev->ctrl_status.head = (dev->ctrl_status.head + 1)
+				      % UVC_CTRL_STATUS_EVENTS;
+		dev->ctrl_status.count--;
+		spin_unlock_irqrestore(&dev->ctrl_status.lock, flags);
+
+		uvc_ctrl_status_process(dev, &status);
+	}
+
+	list_for_each_entry(chain, &dev->chains, list)
+		uvc_ctrl_refresh_chain(chain, overflow);
+}
+
 /* --------------------------------------------------------------------------
  * Control transactions
  *
@@ -1407,7 +1683,8 @@ static int uvc_ctrl_commit_entity(struct uvc_device *dev,
 		 * controls to prevent uvc_ctrl_set from setting bits not
 		 * explicitly set by the user.
 		 */
-		if (ctrl->info.flags & UVC_CTRL_FLAG_AUTO_UPDATE ||
+		if ((ctrl->info.flags & UVC_CTRL_FLAG_AUTO_UPDATE &&
+		     !uvc_ctrl_cacheable(dev, ctrl)) ||
 		    !(ctrl->info.flags & UVC_CTRL_FLAG_GET_CUR))
 			ctrl->loaded = 0;
 
@@ -1426,6 +1703,8 @@ static int uvc_ctrl_commit_entity(struct uvc_device *dev,
 			memcpy(uvc_ctrl_data(ctrl, UVC_CTRL_DATA_CURRENT),
 			       uvc_ctrl_data(ctrl, UVC_CTRL_DATA_BACKUP),
 			       ctrl->info.size);
+		else if (ctrl->loaded)
+			uvc_ctrl_set_loaded(ctrl);
 
 		ctrl->dirty = 0;
 
@@ -1553,6 +1832,9 @@ int uvc_ctrl_set(struct uvc_video_chain *chain,
 	 * needs to be loaded from the device to perform the read-modify-write
 	 * operation.
 	 */
+	if (uvc_ctrl_expired(chain->dev, ctrl))
+		ctrl->loaded = 0;
+
 	if (!ctrl->loaded && (ctrl->info.size * 8) != mapping->size) {
 		if ((ctrl->info.flags & UVC_CTRL_FLAG_GET_CUR) == 0) {
 			memset(uvc_ctrl_data(ctrl, UVC_CTRL_DATA_CURRENT),
@@ -1567,7 +1849,7 @@ int uvc_ctrl_set(struct uvc_video_chain *chain,
 				return ret;
 		}
 
-		ctrl->loaded = 1;
+		uvc_ctrl_set_loaded(ctrl);
 	}
 
 	/* Backup the current value in case we need to rollback later. */
@@ -1691,6 +1973,103 @@ done:
 	return ret;
 }
 
+/*
+ * XU control information is cached per device model across hotplugs, as
+ * querying it takes two control requests per control and cameras commonly
+ * expose tens of XU controls. Entries are keyed by vendor ID, product ID and
+ * device release number, as firmware updates can change the extension units.
+ */
+#define UVC_CTRL_INFO_CACHE_SIZE	1024
+
+struct uvc_ctrl_info_entry {
+	struct list_head list;
+	u16 idVendor;
+	u16 idProduct;
+	u16 bcdDevice;
+	u8 unit;
+	struct uvc_control_info info;
+};
+
+static LIST_HEAD(uvc_ctrl_info_cache);
+static DEFINE_MUTEX(uvc_ctrl_info_lock);
+static unsigned int uvc_ctrl_info_count;
+
+static bool uvc_ctrl_info_match(struct uvc_device *dev,
+	const struct uvc_control *ctrl, const struct uvc_ctrl_info_entry *entry)
+{
+	const struct usb_device_descriptor *desc = &dev->udev->descriptor;
+
+	return entry->idVendor == le16_to_cpu(desc->idVendor) &&
+	       entry->idProduct == le16_to_cpu(desc->idProduct) &&
+	       entry->bcdDevice == le16_to_cpu(desc->bcdDevice) &&
+	       entry->unit == ctrl->entity->id &&
+	       entry->info.index == ctrl->index;
+}
+
+static bool uvc_ctrl_info_lookup(struct uvc_device *dev,
+	const struct uvc_control *ctrl, struct uvc_control_info *info)
+{
+	struct uvc_ctrl_info_entry *entry;
+	bool found = false;
+
+	mutex_lock(&uvc_ctrl_info_lock);
+	list_for_each_entry(entry, &uvc_ctrl_info_cache, list) {
+		if (uvc_ctrl_info_match(dev, ctrl, entry)) {
+			*info = entry->info;
+			found = true;
+			break;
+		}
+	}
+	mutex_unlock(&uvc_ctrl_info_lock);
+
+	return found;
+}
+
+static void uvc_ctrl_info_store(struct uvc_device *dev,
+	const struct uvc_control *ctrl, const struct uvc_control_info *info)
+{
+	const struct usb_device_descriptor *desc = &dev->udev->descriptor;
+	struct uvc_ctrl_info_entry *entry;
+
+	mutex_lock(&uvc_ctrl_info_lock);
+	if (uvc_ctrl_info_count >= UVC_CTRL_INFO_CACHE_SIZE)
+		goto done;
+
+	list_for_each_entry(entry, &uvc_ctrl_info_cache, list) {
+		if (uvc_ctrl_info_match(dev, ctrl, entry))
+			goto done;
+	}
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (entry == NULL)
+		goto done;
+
+	entry->idVendor = le16_to_cpu(desc->idVendor);
+	entry->idProduct = le16_to_cpu(desc->idProduct);
+	entry->bcdDevice = le16_to_cpu(desc->bcdDevice);
+	entry->unit = ctrl->entity->id;
+	entry->info = *info;
+	INIT_LIST_HEAD(&entry->info.mappings);
+
+	list_add(&entry->list, &uvc_ctrl_info_cache);
+	uvc_ctrl_info_count++;
+
+done:
+	mutex_unlock(&uvc_ctrl_info_lock);
+}
+
+void uvc_ctrl_cleanup_info_cache(void)
+{
+	struct uvc_ctrl_info_entry *entry, *next;
+
+	list_for_each_entry_safe(entry, next, &uvc_ctrl_info_cache, list) {
+		list_del(&entry->list);
+		kfree(entry);
+	}
+
+	uvc_ctrl_info_count = 0;
+}
+
 static int uvc_ctrl_add_info(struct uvc_device *dev, struct uvc_control *ctrl,
 	const struct uvc_control_info *info);
 
@@ -1703,9 +2082,13 @@ static int uvc_ctrl_init_xu_ctrl(struct uvc_device *dev,
 	if (ctrl->initialized)
 		return 0;
 
-	ret = uvc_ctrl_fill_xu_info(dev, ctrl, &info);
-	if (ret < 0)
-		return ret;
+	if (!uvc_ctrl_info_lookup(dev, ctrl, &info)) {
+		ret = uvc_ctrl_fill_xu_info(dev, ctrl, &info);
+		if (ret < 0)
+			return ret;
+
+		uvc_ctrl_info_store(dev, ctrl, &info);
+	}
 
 	ret = uvc_ctrl_add_info(dev, ctrl, &info);
 	if (ret < 0)
@@ -1834,6 +2217,64 @@ done:
 	return ret;
 }
 
+/* --------------------------------------------------------------------------
+ * Control discovery
+ */
+
+/*
+ * Control information and limits are queried from the device on first use.
+ * To avoid delaying the first VIDIOC_QUERYCTRL, the remaining queries are
+ * performed in the background once the video nodes have been registered. The
+ * chain control mutex is released between controls to let userspace requests
+ * through, and the queries are paced as some devices crash when queried
+ * repeatedly in a tight loop.
+ *
+ * The device is kept awake by a runtime PM reference taken by
+ * uvc_ctrl_start_discovery() and released when discovery completes or is
+ * cancelled.
+ */
+void uvc_ctrl_discovery_work(struct work_struct *work)
+{
+	struct uvc_device *dev = container_of(work, struct uvc_device,
+					      ctrl_work);
+	struct uvc_video_chain *chain;
+	struct uvc_entity *entity;
+	struct uvc_control *ctrl;
+	unsigned int i;
+
+	list_for_each_entry(chain, &dev->chains, list) {
+		list_for_each_entry(entity, &chain->entities, chain) {
+			for (i = 0; i < entity->ncontrols; ++i) {
+				ctrl = &entity->controls[i];
+
+				mutex_lock(&chain->ctrl_mutex);
+				if (UVC_ENTITY_TYPE(entity) ==
+				    UVC_VC_EXTENSION_UNIT)
+					uvc_ctrl_init_xu_ctrl(dev, ctrl);
+				if (ctrl->initialized && !ctrl->cached)
+					uvc_ctrl_populate_cache(chain, ctrl);
+				mutex_unlock(&chain->ctrl_mutex);
+
+				usleep_range(1000, 2000);
+			}
+		}
+	}
+
+	usb_autopm_put_interface(dev->intf);
+}
+
+void uvc_ctrl_start_discovery(struct uvc_device *dev)
+{
+	usb_autopm_get_interface_no_resume(dev->intf);
+	schedule_work(&dev->ctrl_work);
+}
+
+void uvc_ctrl_stop_discovery(struct uvc_device *dev)
+{
+	if (cancel_work_sync(&dev->ctrl_work))
+		usb_autopm_put_interface_no_suspend(dev->intf);
+}
+
 /* --------------------------------------------------------------------------
  * Suspend/resume
  */
@@ -1860,9 +2301,17 @@ int uvc_ctrl_restore_values(struct uvc_device *dev)
 		for (i = 0; i < entity->ncontrols; ++i) {
 			ctrl = &entity->controls[i];
 
-			if (!ctrl->initialized || !ctrl->modified ||
-			    (ctrl->info.flags & UVC_CTRL_FLAG_RESTORE) == 0)
+			if (!ctrl->initialized)
+				continue;
+
+			/* The device might have changed the values of the
+			 * controls that are not restored, reload them.
+			 */
+			if (!ctrl->modified ||
+			    (ctrl->info.flags & UVC_CTRL_FLAG_RESTORE) == 0) {
+				ctrl->loaded = 0;
 				continue;
+			}
 
 			printk(KERN_INFO "restoring control %pUl/%u/%u\n",
 				ctrl->info.entity, ctrl->info.index,
@@ -2107,7 +2556,7 @@ static void uvc_ctrl_init_ctrl(struct uvc_device *dev, struct uvc_control *ctrl)
 	/* XU controls initialization requires querying the device for control
 	 * information. As some buggy UVC devices will crash when queried
 	 * repeatedly in a tight loop, delay XU controls initialization until
-	 * first use.
+	 * first use or background discovery.
 	 */
 	if (UVC_ENTITY_TYPE(ctrl->entity) == UVC_VC_EXTENSION_UNIT)
 		return;
@@ -2206,6 +2655,8 @@ void uvc_ctrl_cleanup_device(struct uvc_device *dev)
 	struct uvc_entity *entity;
 	unsigned int i;
 
+	cancel_work_sync(&dev->ctrl_status.work);
+
 	/* Free controls and control mappings for all entities. */
 	list_for_each_entry(entity, &dev->entities, list) {
 		for (i = 0; i < entity->ncontrols; ++i) {
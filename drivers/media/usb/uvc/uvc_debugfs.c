@@ -44,6 +44,35 @@ static int uvc_debugfs_stats_open(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static int uvc_debugfs_clock_open(struct inode *inode, struct file *file)
+{
+	struct uvc_streaming *stream = inode->i_private;
+	struct uvc_debugfs_buffer *buf;
+
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	buf->count = uvc_video_clock_dump(stream, buf->data, sizeof(buf->data));
+
+	file->private_data = buf;
+	return 0;
+}
+
+static int uvc_debugfs_bandwidth_open(struct inode *inode, struct file *file)
+{
+	struct uvc_debugfs_buffer *buf;
+
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	buf->count = uvc_bandwidth_dump(buf->data, sizeof(buf->data));
+
+	file->private_data = buf;
+	return 0;
+}
+
 static ssize_t uvc_debugfs_stats_read(struct file *file, char __user *user_buf,
 				      size_t nbytes, loff_t *ppos)
 {
@@ -69,6 +98,22 @@ static const struct file_operations uvc_debugfs_stats_fops = {
 	.release = uvc_debugfs_stats_release,
 };
 
+static const struct file_operations uvc_debugfs_clock_fops = {
+	.owner = THIS_MODULE,
+	.open = uvc_debugfs_clock_open,
+	.llseek = no_llseek,
+	.read = uvc_debugfs_stats_read,
+	.release = uvc_debugfs_stats_release,
+};
+
+static const struct file_operations uvc_debugfs_bandwidth_fops = {
+	.owner = THIS_MODULE,
+	.open = uvc_debugfs_bandwidth_open,
+	.llseek = no_llseek,
+	.read = uvc_debugfs_stats_read,
+	.release = uvc_debugfs_stats_release,
+};
+
 /* -----------------------------------------------------------------------------
  * Global and stream initialization/cleanup
  */
@@ -103,6 +148,17 @@ int uvc_debugfs_init_stream(struct uvc_streaming *stream)
 		return -ENODEV;
 	}
 
+	debugfs_create_file("clock", 0444, stream->debugfs_dir, stream,
+			    &uvc_debugfs_clock_fops);
+
+	/* URB pool sizing limits, used at the next stream start. */
+	debugfs_create_u32("max_urbs", 0644, stream->debugfs_dir,
+			   &stream->max_urbs);
+	debugfs_create_u32("max_packets", 0644, stream->debugfs_dir,
+			   &stream->max_packets);
+	debugfs_create_u32("inflight_us", 0644, stream->debugfs_dir,
+			   &stream->inflight_us);
+
 	return 0;
 }
 
@@ -126,6 +182,11 @@ int uvc_debugfs_init(void)
 	}
 
 	uvc_debugfs_root_dir = dir;
+
+	/* Isochronous bandwidth reserved by all active streams. */
+	debugfs_create_file("bandwidth", 0444, uvc_debugfs_root_dir, NULL,
+			    &uvc_debugfs_bandwidth_fops);
+
 	return 0;
 }
 
@@ -37,6 +37,10 @@ unsigned int uvc_no_drop_param;
 static unsigned int uvc_quirks_param = -1;
 unsigned int uvc_trace_param;
 unsigned int uvc_timeout_param = UVC_CTRL_STREAMING_TIMEOUT;
+unsigned int uvc_max_urbs_param = UVC_MAX_URBS;
+unsigned int uvc_max_packets_param = UVC_MAX_PACKETS;
+unsigned int uvc_inflight_param = UVC_URBS_INFLIGHT_US;
+unsigned int uvc_ctrl_cache_param;
 
 /* ------------------------------------------------------------------------
  * Video formats
@@ -643,6 +647,8 @@ static int uvc_parse_streaming(struct uvc_device *dev,
 	}
 
 	mutex_init(&streaming->mutex);
+	spin_lock_init(&streaming->progress.lock);
+	INIT_LIST_HEAD(&streaming->progress.subs);
 	streaming->dev = dev;
 	streaming->intf = usb_get_intf(intf);
 	streaming->intfnum = intf->cur_altsetting->desc.bInterfaceNumber;
@@ -1699,6 +1705,9 @@ static void uvc_delete(struct uvc_device *dev)
 		usb_driver_release_interface(&uvc_driver.driver,
 			streaming->intf);
 		usb_put_intf(streaming->intf);
+		uvc_bandwidth_release(streaming);
+		if (streaming->async_wq)
+			destroy_workqueue(streaming->async_wq);
 		kfree(streaming->format);
 		kfree(streaming->header.bmaControls);
 		kfree(streaming);
@@ -1733,11 +1742,15 @@ static void uvc_unregister_video(struct uvc_device *dev)
 	 */
 	atomic_inc(&dev->nstreams);
 
+	uvc_ctrl_stop_discovery(dev);
+
 	list_for_each_entry(stream, &dev->streams, list) {
 		if (!video_is_registered(&stream->vdev))
 			continue;
 
 		video_unregister_device(&stream->vdev);
+		if (video_is_registered(&stream->meta.vdev))
+			video_unregister_device(&stream->meta.vdev);
 
 		uvc_debugfs_cleanup_stream(stream);
 	}
@@ -1749,46 +1762,29 @@ static void uvc_unregister_video(struct uvc_device *dev)
 		uvc_delete(dev);
 }
 
-static int uvc_register_video(struct uvc_device *dev,
-		struct uvc_streaming *stream)
+int uvc_register_video_device(struct uvc_device *dev,
+		struct uvc_streaming *stream, struct video_device *vdev,
+		enum v4l2_buf_type type,
+		const struct v4l2_file_operations *fops,
+		const struct v4l2_ioctl_ops *ioctl_ops)
 {
-	struct video_device *vdev = &stream->vdev;
 	int ret;
 
-	/* Initialize the video buffers queue. */
-	ret = uvc_queue_init(&stream->queue, stream->type, !uvc_no_drop_param);
-	if (ret)
-		return ret;
-
-	/* Initialize the streaming interface with default streaming
-	 * parameters.
-	 */
-	ret = uvc_video_init(stream);
-	if (ret < 0) {
-		uvc_printk(KERN_ERR, "Failed to initialize the device "
-			"(%d).\n", ret);
-		return ret;
-	}
-
-	uvc_debugfs_init_stream(stream);
-
-	/* Register the device with V4L. */
-
 	/* We already hold a reference to dev->udev. The video device will be
 	 * unregistered before the reference is released, so we don't need to
 	 * get another one.
 	 */
 	vdev->v4l2_dev = &dev->vdev;
-	vdev->fops = &uvc_fops;
-	vdev->ioctl_ops = &uvc_ioctl_ops;
+	vdev->fops = fops;
+	vdev->ioctl_ops = ioctl_ops;
 	vdev->release = uvc_release;
 	vdev->prio = &stream->chain->prio;
-	if (stream->type == V4L2_BUF_TYPE_VIDEO_OUTPUT)
+	if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT)
 		vdev->vfl_dir = VFL_DIR_TX;
 	strlcpy(vdev->name, dev->name, sizeof vdev->name);
 
 	/* Set the driver data before calling video_register_device, otherwise
-	 * uvc_v4l2_open might race us.
+	 * the open handler might race us.
 	 */
 	video_set_drvdata(vdev, stream);
 
@@ -1799,15 +1795,59 @@ static int uvc_register_video(struct uvc_device *dev,
 		return ret;
 	}
 
-	if (stream->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+	switch (type) {
+	case V4L2_BUF_TYPE_VIDEO_CAPTURE:
+	default:
 		stream->chain->caps |= V4L2_CAP_VIDEO_CAPTURE;
-	else
+		break;
+	case V4L2_BUF_TYPE_VIDEO_OUTPUT:
 		stream->chain->caps |= V4L2_CAP_VIDEO_OUTPUT;
+		break;
+	case V4L2_BUF_TYPE_META_CAPTURE:
+		stream->chain->caps |= V4L2_CAP_META_CAPTURE;
+		break;
+	}
 
 	atomic_inc(&dev->nstreams);
 	return 0;
 }
 
+static int uvc_register_video(struct uvc_device *dev,
+		struct uvc_streaming *stream)
+{
+	int ret;
+
+	/* Initialize the video buffers queue. */
+	ret = uvc_queue_init(&stream->queue, stream->type, !uvc_no_drop_param);
+	if (ret)
+		return ret;
+
+	/* Initialize the streaming interface with default streaming
+	 * parameters.
+	 */
+	ret = uvc_video_init(stream);
+	if (ret < 0) {
+		uvc_printk(KERN_ERR, "Failed to initialize the device "
+			"(%d).\n", ret);
+		return ret;
+	}
+
+	uvc_debugfs_init_stream(stream);
+
+	/* Register the device with V4L. */
+	ret = uvc_register_video_device(dev, stream, &stream->vdev,
+					stream->type, &uvc_fops,
+					&uvc_ioctl_ops);
+	if (ret < 0)
+		return ret;
+
+	/* Expose the payload headers of capture streams on a metadata node. */
+	if (stream->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return uvc_meta_register(stream);
+
+	return 0;
+}
+
 /*
  * Register all video devices in all chains.
  */
@@ -1891,6 +1931,9 @@ static int uvc_probe(struct usb_interface *intf,
 	atomic_set(&dev->nstreams, 0);
 	atomic_set(&dev->nmappings, 0);
 	mutex_init(&dev->lock);
+	spin_lock_init(&dev->ctrl_status.lock);
+	INIT_WORK(&dev->ctrl_status.work, uvc_ctrl_status_work);
+	INIT_WORK(&dev->ctrl_work, uvc_ctrl_discovery_work);
 
 	dev->udev = usb_get_dev(udev);
 	dev->intf = usb_get_intf(intf);
@@ -1966,6 +2009,9 @@ static int uvc_probe(struct usb_interface *intf,
 			"supported.\n", ret);
 	}
 
+	/* Query the remaining control information in the background. */
+	uvc_ctrl_start_discovery(dev);
+
 	uvc_trace(UVC_TRACE_PROBE, "UVC device initialized.\n");
 	usb_enable_autosuspend(udev);
 	return 0;
@@ -2002,6 +2048,9 @@ static int uvc_suspend(struct usb_interface *intf, pm_message_t message)
 	/* Controls are cached on the fly so they don't need to be saved. */
 	if (intf->cur_altsetting->desc.bInterfaceSubClass ==
 	    UVC_SC_VIDEOCONTROL) {
+		/* Controls not discovered yet will be queried on first use. */
+		uvc_ctrl_stop_discovery(dev);
+
 		mutex_lock(&dev->lock);
 		if (dev->users)
 			uvc_status_stop(dev);
@@ -2109,6 +2158,14 @@ module_param_named(trace, uvc_trace_param, uint, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(trace, "Trace level bitmask");
 module_param_named(timeout, uvc_timeout_param, uint, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(timeout, "Streaming control requests timeout");
+module_param_named(max_urbs, uvc_max_urbs_param, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(max_urbs, "Maximum number of URBs per stream");
+module_param_named(max_packets, uvc_max_packets_param, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(max_packets, "Maximum number of packets per URB");
+module_param_named(inflight, uvc_inflight_param, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(inflight, "Duration of data in flight (us)");
+module_param_named(ctrl_cache, uvc_ctrl_cache_param, uint, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(ctrl_cache, "Auto-update controls cache lifetime (ms)");
 
 /* ------------------------------------------------------------------------
  * Driver initialization and cleanup
@@ -2598,6 +2655,7 @@ static int __init uvc_init(void)
 static void __exit uvc_cleanup(void)
 {
 	usb_deregister(&uvc_driver.driver);
+	uvc_ctrl_cleanup_info_cache();
 	uvc_debugfs_cleanup();
 }
 
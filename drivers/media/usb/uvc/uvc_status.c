@@ -110,6 +110,8 @@ static void uvc_event_control(struct uvc_device *dev, __u8 *data, int len)
 
 	uvc_trace(UVC_TRACE_STATUS, "Control %u/%u %s change len %d.\n",
 		data[1], data[3], attrs[data[4]], len);
+
+	uvc_ctrl_status_event(dev, data, len);
 }
 
 static void uvc_status_complete(struct urb *urb)
@@ -1203,12 +1203,65 @@ static int uvc_ioctl_enum_frameintervals(struct file *file, void *fh,
 	return 0;
 }
 
+static int uvc_progress_add_event(struct v4l2_subscribed_event *sev,
+				  unsigned elems)
+{
+	struct uvc_fh *handle = container_of(sev->fh, struct uvc_fh, vfh);
+	struct uvc_streaming *stream = handle->stream;
+	struct uvc_progress_sub *sub;
+	unsigned long flags;
+
+	sub = kzalloc(sizeof(*sub), GFP_KERNEL);
+	if (sub == NULL)
+		return -ENOMEM;
+
+	sub->sev = sev;
+
+	spin_lock_irqsave(&stream->progress.lock, flags);
+	list_add_tail(&sub->list, &stream->progress.subs);
+	spin_unlock_irqrestore(&stream->progress.lock, flags);
+
+	atomic_inc(&stream->progress.subscribers);
+	return 0;
+}
+
+static void uvc_progress_del_event(struct v4l2_subscribed_event *sev)
+{
+	struct uvc_fh *handle = container_of(sev->fh, struct uvc_fh, vfh);
+	struct uvc_streaming *stream = handle->stream;
+	struct uvc_progress_sub *sub;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stream->progress.lock, flags);
+	list_for_each_entry(sub, &stream->progress.subs, list) {
+		if (sub->sev == sev) {
+			list_del(&sub->list);
+			kfree(sub);
+			atomic_dec(&stream->progress.subscribers);
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&stream->progress.lock, flags);
+}
+
+static const struct v4l2_subscribed_event_ops uvc_progress_sub_ev_ops = {
+	.add = uvc_progress_add_event,
+	.del = uvc_progress_del_event,
+};
+
 static int uvc_ioctl_subscribe_event(struct v4l2_fh *fh,
 				     const struct v4l2_event_subscription *sub)
 {
+	struct uvc_fh *handle = container_of(fh, struct uvc_fh, vfh);
+
 	switch (sub->type) {
 	case V4L2_EVENT_CTRL:
 		return v4l2_event_subscribe(fh, sub, 0, &uvc_ctrl_sub_ev_ops);
+	case UVC_EVENT_FRAME_PROGRESS:
+		if (handle->stream->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			return -EINVAL;
+		return v4l2_event_subscribe(fh, sub, 16,
+					    &uvc_progress_sub_ev_ops);
 	default:
 		return -EINVAL;
 	}
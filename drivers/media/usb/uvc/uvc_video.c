@@ -11,6 +11,7 @@
  *
  */
 
+#include <linux/highmem.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/module.h>
@@ -19,6 +20,7 @@
 #include <linux/videodev2.h>
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/atomic.h>
 #include <asm/unaligned.h>
 
@@ -297,7 +299,7 @@ static int uvc_set_video_ctrl(struct uvc_streaming *stream,
 	return ret;
 }
 
-int uvc_probe_video(struct uvc_streaming *stream,
+static int __uvc_probe_video(struct uvc_streaming *stream,
 	struct uvc_streaming_control *probe)
 {
 	struct uvc_streaming_control probe_min, probe_max;
@@ -359,6 +361,74 @@ done:
 	return ret;
 }
 
+/*
+ * Compare the fields of two probe requests that are set by the host. The
+ * other fields are filled by the device and don't influence negotiation.
+ */
+static bool uvc_probe_cache_match(const struct uvc_streaming_control *a,
+	const struct uvc_streaming_control *b)
+{
+	const size_t tail = offsetof(struct uvc_streaming_control,
+				     bmFramingInfo);
+
+	return !memcmp(a, b, offsetof(struct uvc_streaming_control, wDelay)) &&
+	       !memcmp((const u8 *)a + tail, (const u8 *)b + tail,
+		       sizeof(*a) - tail);
+}
+
+/*
+ * Probe negotiation takes several synchronous control requests, but its result
+ * only depends on the fields of the request set by the host. Negotiated
+ * parameters are cached to make format switches and VIDIOC_TRY_FMT cheap. The
+ * cache is flushed when the device might have lost its state or rejects cached
+ * parameters at commit time.
+ *
+ * Must be called with the stream mutex held.
+ */
+int uvc_probe_video(struct uvc_streaming *stream,
+	struct uvc_streaming_control *probe)
+{
+	struct uvc_probe_cache_entry *entry;
+	struct uvc_streaming_control key = *probe;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < stream->probe_cache.count; ++i) {
+		entry = &stream->probe_cache.entries[i];
+		if (uvc_probe_cache_match(&entry->key, probe)) {
+			uvc_trace(UVC_TRACE_FORMAT, "Using cached streaming "
+				  "parameters for format %u frame %u "
+				  "interval %u.\n", probe->bFormatIndex,
+				  probe->bFrameIndex, probe->dwFrameInterval);
+			*probe = entry->ctrl;
+			return 0;
+		}
+	}
+
+	ret = __uvc_probe_video(stream, probe);
+	if (ret < 0)
+		return ret;
+
+	/* Key the entry with the requested parameters, the device may have
+	 * modified them during negotiation.
+	 */
+	entry = &stream->probe_cache.entries[stream->probe_cache.next];
+	entry->key = key;
+	entry->ctrl = *probe;
+	stream->probe_cache.next = (stream->probe_cache.next + 1)
+				 % UVC_PROBE_CACHE_SIZE;
+	if (stream->probe_cache.count < UVC_PROBE_CACHE_SIZE)
+		stream->probe_cache.count++;
+
+	return 0;
+}
+
+void uvc_probe_cache_flush(struct uvc_streaming *stream)
+{
+	stream->probe_cache.count = 0;
+	stream->probe_cache.next = 0;
+}
+
 static int uvc_commit_video(struct uvc_streaming *stream,
 			    struct uvc_streaming_control *probe)
 {
@@ -377,18 +447,150 @@ static inline void uvc_video_get_ts(struct timespec *ts)
 		ktime_get_real_ts(ts);
 }
 
+/*
+ * Timestamps are recovered with two running least-squares fits. The first one
+ * relates the device clock (STC) to the USB SOF clock using the SCR samples,
+ * the second one relates the USB SOF clock to the host clock using the host SOF
+ * counter and system time sampled when the SCR is received.
+ *
+ * Each fit keeps the mean and covariances of its samples, updated in constant
+ * time using Welford's method. Once the window is full, the samples weights
+ * decay exponentially with a time constant of UVC_CLOCK_WINDOW samples. The
+ * means are stored relative to the first sample with UVC_CLOCK_MEAN_SHIFT
+ * fractional bits, as rounding them to integers would bias the slope.
+ *
+ * All values are unwrapped to 64 bits and scaled to units of roughly 1us to
+ * bound the magnitude of the covariances: device clock ticks are shifted right
+ * to bring the device clock frequency below 1MHz, SOF values are stored with
+ * 10 fractional bits and host timestamps in units of 1024ns.
+ */
+#define UVC_CLOCK_WINDOW	256
+#define UVC_CLOCK_MIN_SAMPLES	16
+#define UVC_CLOCK_SLOPE_SHIFT	30
+#define UVC_CLOCK_MEAN_SHIFT	16
+#define UVC_CLOCK_SOF_SHIFT	10
+#define UVC_CLOCK_TS_SHIFT	10
+#define UVC_CLOCK_MAX_ERROR	32767
+
+static void uvc_clock_fit_reset(struct uvc_clock_fit *fit)
+{
+	fit->count = 0;
+	fit->cov_xx = 0;
+	fit->cov_xy = 0;
+	fit->slope = fit->nominal;
+	fit->error = 0;
+}
+
+static u64 uvc_clock_fit_eval(const struct uvc_clock_fit *fit, u64 x)
+{
+	s64 dx = ((s64)(x - fit->x0) << UVC_CLOCK_MEAN_SHIFT) - fit->mean_x;
+
+	return fit->y0 + (fit->mean_y >> UVC_CLOCK_MEAN_SHIFT)
+	     + ((fit->slope * (dx >> UVC_CLOCK_MEAN_SHIFT))
+		>> UVC_CLOCK_SLOPE_SHIFT);
+}
+
+static void uvc_clock_fit_add(struct uvc_clock_fit *fit, u64 x, u64 y)
+{
+	unsigned int shift;
+	s64 rx, ry;
+	s64 dx, dy;
+	s64 num;
+	s64 den;
+	s64 err;
+
+	if (fit->count == 0) {
+		fit->count = 1;
+		fit->x0 = x;
+		fit->y0 = y;
+		fit->mean_x = 0;
+		fit->mean_y = 0;
+		return;
+	}
+
+	/* Accumulate the squared prediction errors, with the same decay as
+	 * the samples, to report the timestamps quality.
+	 */
+	if (fit->count >= UVC_CLOCK_MIN_SAMPLES) {
+		err = y - uvc_clock_fit_eval(fit, x);
+		err = clamp_t(s64, err, -UVC_CLOCK_MAX_ERROR,
+			      UVC_CLOCK_MAX_ERROR);
+		fit->error += err * err - fit->error / UVC_CLOCK_WINDOW;
+	}
+
+	if (fit->count < UVC_CLOCK_WINDOW)
+		fit->count++;
+
+	rx = (s64)(x - fit->x0) << UVC_CLOCK_MEAN_SHIFT;
+	ry = (s64)(y - fit->y0) << UVC_CLOCK_MEAN_SHIFT;
+	dx = rx - fit->mean_x;
+	dy = ry - fit->mean_y;
+	fit->mean_x += div_s64(dx, fit->count);
+	fit->mean_y += div_s64(dy, fit->count);
+
+	dx >>= UVC_CLOCK_MEAN_SHIFT;
+	fit->cov_xx += div_s64(dx * ((rx - fit->mean_x) >> UVC_CLOCK_MEAN_SHIFT)
+			       - fit->cov_xx, fit->count);
+	fit->cov_xy += div_s64(dx * ((ry - fit->mean_y) >> UVC_CLOCK_MEAN_SHIFT)
+			       - fit->cov_xy, fit->count);
+
+	/* Compute the slope with UVC_CLOCK_SLOPE_SHIFT fractional bits,
+	 * scaling the covariances down when they're too large.
+	 */
+	num = fit->cov_xy;
+	den = fit->cov_xx;
+	shift = fls64(abs(num)) + UVC_CLOCK_SLOPE_SHIFT;
+	shift = shift > 62 ? shift - 62 : 0;
+
+	if (shift > UVC_CLOCK_SLOPE_SHIFT)
+		num >>= shift - UVC_CLOCK_SLOPE_SHIFT;
+	else
+		num *= 1LL << (UVC_CLOCK_SLOPE_SHIFT - shift);
+	den >>= shift;
+
+	if (den > 0)
+		fit->slope = div64_s64(num, den);
+}
+
+/*
+ * Return the deviation of the fit slope from its nominal value, in parts per
+ * billion.
+ */
+static s64 uvc_clock_fit_drift(const struct uvc_clock_fit *fit)
+{
+	s64 nominal = fit->nominal;
+	s64 delta = fit->slope - nominal;
+	unsigned int shift;
+
+	if (nominal <= 0)
+		return 0;
+
+	/* The nominal slope grows as the device clock frequency decreases.
+	 * Scale it below 2^32 to keep the product with NSEC_PER_SEC in range,
+	 * the delta is clamped to the nominal value.
+	 */
+	delta = clamp_t(s64, delta, -nominal, nominal);
+	shift = fls64(nominal);
+	shift = shift > 32 ? shift - 32 : 0;
+
+	return div64_s64((delta >> shift) * NSEC_PER_SEC, nominal >> shift);
+}
+
 static void
 uvc_video_clock_decode(struct uvc_streaming *stream, struct uvc_buffer *buf,
 		       const __u8 *data, int len)
 {
-	struct uvc_clock_sample *sample;
+	struct uvc_clock *clock = &stream->clock;
 	unsigned int header_size;
 	bool has_pts = false;
 	bool has_scr = false;
 	unsigned long flags;
 	struct timespec ts;
-	u16 host_sof;
+	u64 host_sof;
+	u64 host_ts;
+	u32 dev_stc;
 	u16 dev_sof;
+	s8 delta_sof;
 
 	switch (data[1] & (UVC_STREAM_PTS | UVC_STREAM_SCR)) {
 	case UVC_STREAM_PTS | UVC_STREAM_SCR:
@@ -417,8 +619,8 @@ uvc_video_clock_decode(struct uvc_streaming *stream, struct uvc_buffer *buf,
 	 *
 	 * - store the frame PTS in the buffer structure
 	 * - if the SCR field is present, retrieve the host SOF counter and
-	 *   kernel timestamps and store them with the SCR STC and SOF fields
-	 *   in the ring buffer
+	 *   kernel timestamps and feed them with the SCR STC and SOF fields
+	 *   to the clock estimators
 	 */
 	if (has_pts && buf != NULL)
 		buf->pts = get_unaligned_le32(&data[2]);
@@ -430,13 +632,10 @@ uvc_video_clock_decode(struct uvc_streaming *stream, struct uvc_buffer *buf,
 	 * previous one.
 	 */
 	dev_sof = get_unaligned_le16(&data[header_size - 2]);
-	if (dev_sof == stream->clock.last_sof)
+	if (dev_sof == clock->last_sof)
 		return;
 
-	stream->clock.last_sof = dev_sof;
-
-	host_sof = usb_get_current_frame_number(stream->dev->udev);
-	uvc_video_get_ts(&ts);
+	clock->last_sof = dev_sof;
 
 	/* The UVC specification allows device implementations that can't obtain
 	 * the USB frame number to keep their own frame counters as long as they
@@ -454,94 +653,94 @@ uvc_video_clock_decode(struct uvc_streaming *stream, struct uvc_buffer *buf,
 	 * compute a dynamic threshold instead of using a fixed 10 ms value, but
 	 * devices don't report reliable wDelay values.
 	 *
-	 * See uvc_video_clock_host_sof() for an explanation regarding why only
-	 * the 8 LSBs of the delta are kept.
+	 * Host SOF counters reported by usb_get_current_frame_number() usually
+	 * don't cover the whole 11-bits SOF range (0-2047) but are limited to
+	 * the HCI frame schedule window. They can be limited to 8, 9 or 10 bits
+	 * depending on the host controller and its configuration. As the device
+	 * and host frame numbers are sampled in a short interval, the difference
+	 * between their values is equal to a small delta plus an integer
+	 * multiple of 256, only the 8 LSBs of the difference are thus kept.
 	 */
-	if (stream->clock.sof_offset == (u16)-1) {
-		u16 delta_sof = (host_sof - dev_sof) & 255;
-		if (delta_sof >= 10)
-			stream->clock.sof_offset = delta_sof;
+	dev_stc = get_unaligned_le32(&data[header_size - 6]);
+	delta_sof = (usb_get_current_frame_number(stream->dev->udev) - dev_sof)
+		  & 255;
+	uvc_video_get_ts(&ts);
+	host_ts = timespec_to_ns(&ts) >> UVC_CLOCK_TS_SHIFT;
+
+	if (clock->sof_offset == (u16)-1) {
+		if ((u8)delta_sof >= 10)
+			clock->sof_offset = (u8)delta_sof;
 		else
-			stream->clock.sof_offset = 0;
+			clock->sof_offset = 0;
 	}
 
-	dev_sof = (dev_sof + stream->clock.sof_offset) & 2047;
+	dev_sof = (dev_sof + clock->sof_offset) & 2047;
+	delta_sof = (u8)delta_sof - clock->sof_offset;
 
-	spin_lock_irqsave(&stream->clock.lock, flags);
+	spin_lock_irqsave(&clock->lock, flags);
 
-	sample = &stream->clock.samples[stream->clock.head];
-	sample->dev_stc = get_unaligned_le32(&data[header_size - 6]);
-	sample->dev_sof = dev_sof;
-	sample->host_sof = host_sof;
-	sample->host_ts = ts;
+	/* Unwrap the device clock and SOF. Restart the estimation when no
+	 * sample has been received for more than a second, as the SOF counter
+	 * could have wrapped around unnoticed, or when the host clock went
+	 * backward. The unwrapped values start one period above zero to avoid
+	 * wrapping below zero when computing earlier values.
+	 */
+	if (clock->sof.count == 0 ||
+	    host_ts - clock->host_ts > (NSEC_PER_SEC >> UVC_CLOCK_TS_SHIFT)) {
+		uvc_clock_fit_reset(&clock->sof);
+		uvc_clock_fit_reset(&clock->host);
+		clock->stc = (1ULL << 32) + dev_stc;
+		clock->dev_sof = (u64)(2048 + dev_sof) << UVC_CLOCK_SOF_SHIFT;
+	} else {
+		clock->stc += (u32)(dev_stc - clock->last_stc);
+		clock->dev_sof += (u64)((dev_sof - (clock->dev_sof
+			       >> UVC_CLOCK_SOF_SHIFT)) & 2047)
+			       << UVC_CLOCK_SOF_SHIFT;
+	}
 
-	/* Update the sliding window head and count. */
-	stream->clock.head = (stream->clock.head + 1) % stream->clock.size;
+	clock->last_stc = dev_stc;
+	clock->host_ts = host_ts;
 
-	if (stream->clock.count < stream->clock.size)
-		stream->clock.count++;
+	host_sof = clock->dev_sof + ((s64)delta_sof << UVC_CLOCK_SOF_SHIFT);
 
-	spin_unlock_irqrestore(&stream->clock.lock, flags);
+	uvc_clock_fit_add(&clock->sof, clock->stc >> clock->stc_shift,
+			  clock->dev_sof);
+	uvc_clock_fit_add(&clock->host, host_sof, host_ts);
+
+	spin_unlock_irqrestore(&clock->lock, flags);
 }
 
 static void uvc_video_clock_reset(struct uvc_streaming *stream)
 {
 	struct uvc_clock *clock = &stream->clock;
 
-	clock->head = 0;
-	clock->count = 0;
+	uvc_clock_fit_reset(&clock->sof);
+	uvc_clock_fit_reset(&clock->host);
 	clock->last_sof = -1;
 	clock->sof_offset = -1;
 }
 
-static int uvc_video_clock_init(struct uvc_streaming *stream)
+static void uvc_video_clock_init(struct uvc_streaming *stream)
 {
 	struct uvc_clock *clock = &stream->clock;
+	u32 freq = stream->ctrl.dwClockFrequency;
 
-	spin_lock_init(&clock->lock);
-	clock->size = 32;
+	/* Scale the device clock below 1MHz, and compute the nominal slopes
+	 * of the fits from the device clock frequency and the 1kHz SOF clock.
+	 * Assume a 48MHz device clock when the frequency isn't reported, the
+	 * fits don't depend on the nominal value.
+	 */
+	clock->stc_shift = fls(freq ? freq : 48000000);
+	clock->stc_shift = clock->stc_shift > 20 ? clock->stc_shift - 20 : 0;
 
-	clock->samples = kmalloc(clock->size * sizeof(*clock->samples),
-				 GFP_KERNEL);
-	if (clock->samples == NULL)
-		return -ENOMEM;
+	clock->sof.nominal = freq ? div_u64(1000ULL << (UVC_CLOCK_SOF_SHIFT +
+					    UVC_CLOCK_SLOPE_SHIFT +
+					    clock->stc_shift), freq)
+			   : 0;
+	clock->host.nominal = (1000000LL << UVC_CLOCK_SLOPE_SHIFT)
+			    >> (UVC_CLOCK_SOF_SHIFT + UVC_CLOCK_TS_SHIFT);
 
 	uvc_video_clock_reset(stream);
-
-	return 0;
-}
-
-static void uvc_video_clock_cleanup(struct uvc_streaming *stream)
-{
-	kfree(stream->clock.samples);
-	stream->clock.samples = NULL;
-}
-
-/*
- * uvc_video_clock_host_sof - Return the host SOF value for a clock sample
- *
- * Host SOF counters reported by usb_get_current_frame_number() usually don't
- * cover the whole 11-bits SOF range (0-2047) but are limited to the HCI frame
- * schedule window. They can be limited to 8, 9 or 10 bits depending on the host
- * controller and its configuration.
- *
- * We thus need to recover the SOF value corresponding to the host frame number.
- * As the device and host frame numbers are sampled in a short interval, the
- * difference between their values should be equal to a small delta plus an
- * integer multiple of 256 caused by the host frame number limited precision.
- *
- * To obtain the recovered host SOF value, compute the small delta by masking
- * the high bits of the host frame counter and device SOF difference and add it
- * to the device SOF value.
- */
-static u16 uvc_video_clock_host_sof(const struct uvc_clock_sample *sample)
-{
-	/* The delta value can be negative. */
-	s8 delta_sof;
-
-	delta_sof = (sample->host_sof - sample->dev_sof) & 255;
-
-	return (sample->dev_sof + delta_sof) & 2047;
 }
 
 /*
@@ -553,74 +752,25 @@ static u16 uvc_video_clock_host_sof(const struct uvc_clock_sample *sample)
  *
  * The relationship between the device clock and the host clock isn't known.
  * However, the device and the host share the common USB SOF clock which can be
- * used to recover that relationship.
- *
- * The relationship between the device clock and the USB SOF clock is considered
- * to be linear over the clock samples sliding window and is given by
- *
- * SOF = m * PTS + p
- *
- * Several methods to compute the slope (m) and intercept (p) can be used. As
- * the clock drift should be small compared to the sliding window size, we
- * assume that the line that goes through the points at both ends of the window
- * is a good approximation. Naming those points P1 and P2, we get
- *
- * SOF = (SOF2 - SOF1) / (STC2 - STC1) * PTS
- *     + (SOF1 * STC2 - SOF2 * STC1) / (STC2 - STC1)
- *
- * or
- *
- * SOF = ((SOF2 - SOF1) * PTS + SOF1 * STC2 - SOF2 * STC1) / (STC2 - STC1)   (1)
+ * used to recover that relationship. The PTS is first unwrapped relatively to
+ * the last STC sample and converted to the SOF clock domain with the first
+ * fit, the result is then converted to the host clock domain with the second
+ * fit. The fits are kept up to date by uvc_video_clock_decode(), converting a
+ * timestamp takes constant time.
  *
- * to avoid losing precision in the division. Similarly, the host timestamp is
- * computed with
- *
- * TS = ((TS2 - TS1) * PTS + TS1 * SOF2 - TS2 * SOF1) / (SOF2 - SOF1)	     (2)
- *
- * SOF values are coded on 11 bits by USB. We extend their precision with 16
- * decimal bits, leading to a 11.16 coding.
- *
- * TODO: To avoid surprises with device clock values, PTS/STC timestamps should
- * be normalized using the nominal device clock frequency reported through the
- * UVC descriptors.
- *
- * Both the PTS/STC and SOF counters roll over, after a fixed but device
- * specific amount of time for PTS/STC and after 2048ms for SOF. As long as the
- * sliding window size is smaller than the rollover period, differences computed
- * on unsigned integers will produce the correct result. However, the p term in
- * the linear relations will be miscomputed.
- *
- * To fix the issue, we subtract a constant from the PTS and STC values to bring
- * PTS to half the 32 bit STC range. The sliding window STC values then fit into
- * the 32 bit range without any rollover.
- *
- * Similarly, we add 2048 to the device SOF values to make sure that the SOF
- * computed by (1) will never be smaller than 0. This offset is then compensated
- * by adding 2048 to the SOF values used in (2). However, this doesn't prevent
- * rollovers between (1) and (2): the SOF value computed by (1) can be slightly
- * lower than 4096, and the host SOF counters can have rolled over to 2048. This
- * case is handled by subtracting 2048 from the SOF value if it exceeds the host
- * SOF value at the end of the sliding window.
- *
- * Finally we subtract a constant from the host timestamps to bring the first
- * timestamp of the sliding window to 1s.
+ * The nominal device clock frequency is only used to scale the device clock
+ * values and to report the drift. Devices whose clock deviates from the
+ * advertised frequency are not rejected, the fit absorbs the deviation.
  */
 void uvc_video_clock_update(struct uvc_streaming *stream,
 			    struct vb2_v4l2_buffer *vbuf,
 			    struct uvc_buffer *buf)
 {
 	struct uvc_clock *clock = &stream->clock;
-	struct uvc_clock_sample *first;
-	struct uvc_clock_sample *last;
 	unsigned long flags;
 	struct timespec ts;
-	u32 delta_stc;
-	u32 y1, y2;
-	u32 x1, x2;
-	u32 mean;
-	u32 sof;
-	u32 div;
-	u32 rem;
+	u64 stc;
+	u64 sof;
 	u64 y;
 
 	if (!uvc_hw_timestamps_param)
@@ -628,88 +778,78 @@ void uvc_video_clock_update(struct uvc_streaming *stream,
 
 	spin_lock_irqsave(&clock->lock, flags);
 
-	if (clock->count < clock->size)
+	if (clock->sof.count < UVC_CLOCK_MIN_SAMPLES ||
+	    clock->host.count < UVC_CLOCK_MIN_SAMPLES)
 		goto done;
 
-	first = &clock->samples[clock->head];
-	last = &clock->samples[(clock->head - 1) % clock->size];
-
 	/* First step, PTS to SOF conversion. */
-	delta_stc = buf->pts - (1UL << 31);
-	x1 = first->dev_stc - delta_stc;
-	x2 = last->dev_stc - delta_stc;
-	if (x1 == x2)
-		goto done;
-
-	y1 = (first->dev_sof + 2048) << 16;
-	y2 = (last->dev_sof + 2048) << 16;
-	if (y2 < y1)
-		y2 += 2048 << 16;
-
-	y = (u64)(y2 - y1) * (1ULL << 31) + (u64)y1 * (u64)x2
-	  - (u64)y2 * (u64)x1;
-	y = div_u64(y, x2 - x1);
-
-	sof = y;
-
-	uvc_trace(UVC_TRACE_CLOCK, "%s: PTS %u y %llu.%06llu SOF %u.%06llu "
-		  "(x1 %u x2 %u y1 %u y2 %u SOF offset %u)\n",
-		  stream->dev->name, buf->pts,
-		  y >> 16, div_u64((y & 0xffff) * 1000000, 65536),
-		  sof >> 16, div_u64(((u64)sof & 0xffff) * 1000000LLU, 65536),
-		  x1, x2, y1, y2, clock->sof_offset);
+	stc = clock->stc + (s32)(buf->pts - clock->last_stc);
+	sof = uvc_clock_fit_eval(&clock->sof, stc >> clock->stc_shift);
 
 	/* Second step, SOF to host clock conversion. */
-	x1 = (uvc_video_clock_host_sof(first) + 2048) << 16;
-	x2 = (uvc_video_clock_host_sof(last) + 2048) << 16;
-	if (x2 < x1)
-		x2 += 2048 << 16;
-	if (x1 == x2)
-		goto done;
+	y = uvc_clock_fit_eval(&clock->host, sof);
+	ts = ns_to_timespec(y << UVC_CLOCK_TS_SHIFT);
 
-	ts = timespec_sub(last->host_ts, first->host_ts);
-	y1 = NSEC_PER_SEC;
-	y2 = (ts.tv_sec + 1) * NSEC_PER_SEC + ts.tv_nsec;
-
-	/* Interpolated and host SOF timestamps can wrap around at slightly
-	 * different times. Handle this by adding or removing 2048 to or from
-	 * the computed SOF value to keep it close to the SOF samples mean
-	 * value.
-	 */
-	mean = (x1 + x2) / 2;
-	if (mean - (1024 << 16) > sof)
-		sof += 2048 << 16;
-	else if (sof > mean + (1024 << 16))
-		sof -= 2048 << 16;
-
-	y = (u64)(y2 - y1) * (u64)sof + (u64)y1 * (u64)x2
-	  - (u64)y2 * (u64)x1;
-	y = div_u64(y, x2 - x1);
-
-	div = div_u64_rem(y, NSEC_PER_SEC, &rem);
-	ts.tv_sec = first->host_ts.tv_sec - 1 + div;
-	ts.tv_nsec = first->host_ts.tv_nsec + rem;
-	if (ts.tv_nsec >= NSEC_PER_SEC) {
-		ts.tv_sec++;
-		ts.tv_nsec -= NSEC_PER_SEC;
-	}
-
-	uvc_trace(UVC_TRACE_CLOCK, "%s: SOF %u.%06llu y %llu ts %lu.%06lu "
-		  "buf ts %lu.%06lu (x1 %u/%u/%u x2 %u/%u/%u y1 %u y2 %u)\n",
-		  stream->dev->name,
-		  sof >> 16, div_u64(((u64)sof & 0xffff) * 1000000LLU, 65536),
-		  y, ts.tv_sec, ts.tv_nsec / NSEC_PER_USEC,
+	uvc_trace(UVC_TRACE_CLOCK, "%s: PTS %u SOF %llu.%03llu ts %lu.%06lu "
+		  "buf ts %lu.%06lu (SOF offset %u)\n",
+		  stream->dev->name, buf->pts,
+		  (sof >> UVC_CLOCK_SOF_SHIFT) & 2047,
+		  ((sof & ((1 << UVC_CLOCK_SOF_SHIFT) - 1)) * 1000)
+		  >> UVC_CLOCK_SOF_SHIFT,
+		  ts.tv_sec, ts.tv_nsec / NSEC_PER_USEC,
 		  vbuf->timestamp.tv_sec,
 		  (unsigned long)vbuf->timestamp.tv_usec,
-		  x1, first->host_sof, first->dev_sof,
-		  x2, last->host_sof, last->dev_sof, y1, y2);
+		  clock->sof_offset);
 
 	/* Update the V4L2 buffer. */
 	vbuf->timestamp.tv_sec = ts.tv_sec;
 	vbuf->timestamp.tv_usec = ts.tv_nsec / NSEC_PER_USEC;
 
 done:
-	spin_unlock_irqrestore(&stream->clock.lock, flags);
+	spin_unlock_irqrestore(&clock->lock, flags);
+}
+
+/*
+ * uvc_video_clock_dump - Dump the clock estimators state
+ *
+ * Report the device and host clocks drift relative to the USB SOF clock, and
+ * the RMS error between the received samples and the estimators predictions.
+ */
+size_t uvc_video_clock_dump(struct uvc_streaming *stream, char *buf,
+			    size_t size)
+{
+	struct uvc_clock *clock = &stream->clock;
+	struct uvc_clock_fit sof;
+	struct uvc_clock_fit host;
+	unsigned long flags;
+	size_t count = 0;
+
+	spin_lock_irqsave(&clock->lock, flags);
+	sof = clock->sof;
+	host = clock->host;
+	spin_unlock_irqrestore(&clock->lock, flags);
+
+	count += scnprintf(buf + count, size - count,
+			   "samples: %u/%u\n", sof.count, UVC_CLOCK_WINDOW);
+	if (sof.count < UVC_CLOCK_MIN_SAMPLES)
+		return count;
+
+	/* A device clock slower than nominal leads to a steeper slope. */
+	if (sof.nominal)
+		count += scnprintf(buf + count, size - count,
+				   "device clock drift: %lld ppb\n",
+				   -uvc_clock_fit_drift(&sof));
+	count += scnprintf(buf + count, size - count,
+			   "host clock drift: %lld ppb\n"
+			   "device clock error: %llu ns rms\n"
+			   "host clock error: %llu ns rms\n",
+			   uvc_clock_fit_drift(&host),
+			   (u64)int_sqrt(sof.error / UVC_CLOCK_WINDOW) * 1000000
+			   >> UVC_CLOCK_SOF_SHIFT,
+			   (u64)int_sqrt(host.error / UVC_CLOCK_WINDOW)
+			   << UVC_CLOCK_TS_SHIFT);
+
+	return count;
 }
 
 /* ------------------------------------------------------------------------
@@ -898,6 +1038,14 @@ size_t uvc_video_stats_dump(struct uvc_streaming *stream, char *buf,
 			   stream->stats.stream.nb_empty,
 			   stream->stats.stream.nb_errors,
 			   stream->stats.stream.nb_invalid);
+	count += scnprintf(buf + count, size - count,
+			   "lost:    %u\nunderruns: %u urb, %u buffer\n",
+			   stream->stats.stream.nb_lost,
+			   stream->stats.stream.nb_underruns,
+			   stream->stats.stream.nb_no_buffer);
+	count += scnprintf(buf + count, size - count,
+			   "urbs: %u x %u bytes\n",
+			   stream->nurbs, stream->urb_size);
 	count += scnprintf(buf + count, size - count,
 			   "pts: %u early, %u initial, %u ok\n",
 			   stream->stats.stream.nb_pts_early,
@@ -949,8 +1097,9 @@ static void uvc_video_stats_stop(struct uvc_streaming *stream)
  * made until the next payload. -ENODATA can be used to drop the current
  * payload if no other error code is appropriate.
  *
- * uvc_video_decode_data is called for every URB with URB data. It copies the
- * data to the video buffer.
+ * uvc_video_decode_data is called for every URB with URB data. It schedules a
+ * copy of the data to the video buffer, which is performed by the stream
+ * worker before the URB is resubmitted.
  *
  * uvc_video_decode_end is called with header data at the end of a bulk or
  * isochronous payload. It performs any additional header data processing and
@@ -1069,21 +1218,26 @@ static int uvc_video_decode_start(struct uvc_streaming *stream,
 	return data[0];
 }
 
-static void uvc_video_decode_data(struct uvc_streaming *stream,
+static void uvc_video_decode_data(struct uvc_urb *uvc_urb,
 		struct uvc_buffer *buf, const __u8 *data, int len)
 {
-	unsigned int maxlen, nbytes;
-	void *mem;
+	struct uvc_copy_op *op;
+	unsigned int maxlen;
 
 	if (len <= 0)
 		return;
 
-	/* Copy the video data to the buffer. */
+	/* Queue the copy of the video data to the buffer. The buffer can't be
+	 * completed before the copy is done, so take a reference to it.
+	 */
 	maxlen = buf->length - buf->bytesused;
-	mem = buf->mem + buf->bytesused;
-	nbytes = min((unsigned int)len, maxlen);
-	memcpy(mem, data, nbytes);
-	buf->bytesused += nbytes;
+	op = &uvc_urb->copy_operations[uvc_urb->async_operations++];
+	op->buf = buf;
+	op->src = data;
+	op->dst = buf->mem + buf->bytesused;
+	op->len = min((unsigned int)len, maxlen);
+	kref_get(&buf->ref);
+	buf->bytesused += op->len;
 
 	/* Complete the current frame if the buffer size was exceeded. */
 	if (len > maxlen) {
@@ -1160,12 +1314,87 @@ static void uvc_video_validate_buffer(const struct uvc_streaming *stream,
 		buf->error = 1;
 }
 
+/*
+ * Append the payload header to the metadata buffer. Headers with the same SCR
+ * as the previous header carry no new information and are skipped to save
+ * space.
+ */
+static void uvc_video_decode_meta(struct uvc_streaming *stream,
+		struct uvc_buffer *meta_buf, const __u8 *mem, unsigned int length)
+{
+	struct uvc_meta_buf *meta;
+	struct timespec ts;
+	unsigned long flags;
+	const __u8 *scr;
+	u64 ns;
+	u16 sof;
+
+	if (meta_buf == NULL || length == 2)
+		return;
+
+	if (mem[1] & UVC_STREAM_SCR) {
+		scr = mem + (mem[1] & UVC_STREAM_PTS ? 6 : 2);
+		if (!memcmp(scr, stream->meta.last_scr, 6))
+			return;
+	} else {
+		scr = NULL;
+	}
+
+	if (meta_buf->length - meta_buf->bytesused <
+	    length + sizeof(meta->ns) + sizeof(meta->sof)) {
+		meta_buf->error = 1;
+		return;
+	}
+
+	local_irq_save(flags);
+	uvc_video_get_ts(&ts);
+	sof = usb_get_current_frame_number(stream->dev->udev);
+	local_irq_restore(flags);
+	ns = timespec_to_ns(&ts);
+
+	meta = meta_buf->mem + meta_buf->bytesused;
+	put_unaligned(ns, &meta->ns);
+	put_unaligned(sof, &meta->sof);
+	memcpy(&meta->length, mem, length);
+	meta_buf->bytesused += length + sizeof(meta->ns) + sizeof(meta->sof);
+
+	if (scr)
+		memcpy(stream->meta.last_scr, scr, 6);
+}
+
+/*
+ * Complete the current video buffer and the metadata buffer associated with
+ * it, and return the next ones. The metadata buffer inherits the sequence
+ * number and timestamp of the video frame.
+ */
+static void uvc_video_next_buffers(struct uvc_streaming *stream,
+		struct uvc_buffer **video_buf, struct uvc_buffer **meta_buf)
+{
+	if (*meta_buf) {
+		struct vb2_v4l2_buffer *vb2_meta = &(*meta_buf)->buf;
+		const struct vb2_v4l2_buffer *vb2_video = &(*video_buf)->buf;
+
+		vb2_meta->sequence = vb2_video->sequence;
+		vb2_meta->field = vb2_video->field;
+		vb2_meta->timestamp = vb2_video->timestamp;
+
+		(*meta_buf)->state = UVC_BUF_STATE_READY;
+		if (!(*meta_buf)->error)
+			(*meta_buf)->error = (*video_buf)->error;
+		*meta_buf = uvc_queue_next_buffer(&stream->meta.queue,
+						  *meta_buf);
+	}
+
+	*video_buf = uvc_queue_next_buffer(&stream->queue, *video_buf);
+}
+
 /*
  * Completion handler for video URBs.
  */
 static void uvc_video_decode_isoc(struct urb *urb, struct uvc_streaming *stream,
-	struct uvc_buffer *buf)
+	struct uvc_buffer *buf, struct uvc_buffer *meta_buf)
 {
+	struct uvc_urb *uvc_urb = urb->context;
 	u8 *mem;
 	int ret, i;
 
@@ -1173,6 +1402,7 @@ static void uvc_video_decode_isoc(struct urb *urb, struct uvc_streaming *stream,
 		if (urb->iso_frame_desc[i].status < 0) {
 			uvc_trace(UVC_TRACE_FRAME, "USB isochronous frame "
 				"lost (%d).\n", urb->iso_frame_desc[i].status);
+			stream->stats.stream.nb_lost++;
 			/* Mark the buffer as faulty. */
 			if (buf != NULL)
 				buf->error = 1;
@@ -1186,16 +1416,17 @@ static void uvc_video_decode_isoc(struct urb *urb, struct uvc_streaming *stream,
 				urb->iso_frame_desc[i].actual_length);
 			if (ret == -EAGAIN) {
 				uvc_video_validate_buffer(stream, buf);
-				buf = uvc_queue_next_buffer(&stream->queue,
-							    buf);
+				uvc_video_next_buffers(stream, &buf, &meta_buf);
 			}
 		} while (ret == -EAGAIN);
 
 		if (ret < 0)
 			continue;
 
+		uvc_video_decode_meta(stream, meta_buf, mem, ret);
+
 		/* Decode the payload data. */
-		uvc_video_decode_data(stream, buf, mem + ret,
+		uvc_video_decode_data(uvc_urb, buf, mem + ret,
 			urb->iso_frame_desc[i].actual_length - ret);
 
 		/* Process the header again. */
@@ -1204,14 +1435,200 @@ static void uvc_video_decode_isoc(struct urb *urb, struct uvc_streaming *stream,
 
 		if (buf->state == UVC_BUF_STATE_READY) {
 			uvc_video_validate_buffer(stream, buf);
-			buf = uvc_queue_next_buffer(&stream->queue, buf);
+			uvc_video_next_buffers(stream, &buf, &meta_buf);
 		}
 	}
 }
 
+/*
+ * Zero-copy bulk transfers.
+ *
+ * When the host controller supports unconstrained scatter-gather lists and a
+ * whole payload fits in a URB, bulk IN URBs are pointed directly at the vb2
+ * buffer memory. The first entry of the scatter-gather list receives the
+ * payload header in a small scratch buffer, and the rest of the payload lands
+ * in the buffer at the offset where it is expected to be stored.
+ *
+ * The offset is predicted at submission time by a per-buffer cursor that
+ * advances by a full payload for every URB submitted to the buffer, and never
+ * falls behind the number of bytes already stored in it. Short or dropped
+ * payloads thus can't make later URBs overlap the region of a URB still in
+ * flight. Payloads received at the predicted offset are not copied at all.
+ * Otherwise (short payloads, frame boundaries, header size changes) the data
+ * is moved to its final location by the copy worker. As predictions never
+ * underestimate the final offset, data is only ever moved backwards, and never
+ * into the region of a URB still in flight.
+ */
+
+/*
+ * Record the size of the smallest payload header seen so far. Zero-copy URBs
+ * are only submitted once the header size is known.
+ */
+static void uvc_video_zc_learn_header(struct uvc_streaming *stream,
+	unsigned int size)
+{
+	if (!stream->bulk.zero_copy)
+		return;
+
+	if (stream->bulk.zc_header_size == 0 ||
+	    size < stream->bulk.zc_header_size)
+		stream->bulk.zc_header_size = size;
+}
+
+/*
+ * Point the URB at the first buffer of the irq queue if possible, or at its
+ * bounce buffer otherwise. Must be called with the queue irqlock held.
+ */
+static void uvc_video_zc_prepare(struct uvc_urb *uvc_urb)
+{
+	struct uvc_streaming *stream = uvc_urb->stream;
+	struct uvc_video_queue *queue = &stream->queue;
+	unsigned int hsize = stream->bulk.zc_header_size;
+	unsigned int size = stream->urb_size - hsize;
+	struct uvc_buffer *buf = NULL;
+	struct urb *urb = uvc_urb->urb;
+	unsigned int offset = 0;
+	unsigned int nsgs;
+	u8 *mem;
+
+	if (hsize && !list_empty(&queue->irqqueue)) {
+		buf = list_first_entry(&queue->irqqueue, struct uvc_buffer,
+				       queue);
+		offset = max(buf->zc_next, buf->bytesused);
+
+		/* Only MMAP buffers are known to be backed by vmalloc memory
+		 * owned by the driver.
+		 */
+		if (buf->buf.vb2_buf.memory != V4L2_MEMORY_MMAP ||
+		    offset + size > buf->length)
+			buf = NULL;
+	}
+
+	if (buf == NULL) {
+		urb->sg = NULL;
+		urb->num_sgs = 0;
+		urb->transfer_buffer = uvc_urb->buffer;
+#ifndef CONFIG_DMA_NONCOHERENT
+		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+#endif
+		return;
+	}
+
+	sg_init_table(uvc_urb->sg, uvc_urb->nsgs);
+	sg_set_buf(&uvc_urb->sg[0], uvc_urb->zc_header, hsize);
+
+	mem = buf->mem + offset;
+	flush_kernel_vmap_range(mem, size);
+
+	for (nsgs = 1; size; ++nsgs) {
+		unsigned int len = min_t(unsigned int, size,
+					 PAGE_SIZE - offset_in_page(mem));
+
+		sg_set_page(&uvc_urb->sg[nsgs], vmalloc_to_page(mem), len,
+			    offset_in_page(mem));
+		mem += len;
+		size -= len;
+	}
+
+	sg_mark_end(&uvc_urb->sg[nsgs - 1]);
+
+	/* If the submission fails the cursor overestimates the offset of the
+	 * next URBs, which is harmless.
+	 */
+	buf->zc_next = offset + stream->urb_size - hsize;
+
+	kref_get(&buf->ref);
+	uvc_urb->zc_buf = buf;
+	uvc_urb->zc_offset = offset;
+	uvc_urb->zc_header_size = hsize;
+
+	urb->sg = uvc_urb->sg;
+	urb->num_sgs = nsgs;
+	urb->transfer_buffer = NULL;
+	urb->transfer_flags &= ~URB_NO_TRANSFER_DMA_MAP;
+}
+
+/*
+ * Release the buffer targeted by a zero-copy URB.
+ */
+static void uvc_video_zc_release(struct uvc_urb *uvc_urb)
+{
+	struct uvc_buffer *buf = uvc_urb->zc_buf;
+
+	if (buf == NULL)
+		return;
+
+	uvc_urb->zc_buf = NULL;
+	uvc_queue_buffer_release(buf);
+}
+
+static void uvc_video_decode_bulk_zc(struct uvc_urb *uvc_urb,
+	struct uvc_streaming *stream, struct uvc_buffer *buf,
+	struct uvc_buffer *meta_buf)
+{
+	struct urb *urb = uvc_urb->urb;
+	unsigned int hsize = uvc_urb->zc_header_size;
+	unsigned int len = urb->actual_length;
+	u8 *header = uvc_urb->zc_header;
+	u8 *mem = uvc_urb->zc_buf->mem + uvc_urb->zc_offset;
+	int ret;
+
+	stream->bulk.payload_size += len;
+	invalidate_kernel_vmap_range(mem, stream->urb_size - hsize);
+
+	/* Reassemble headers larger than expected in the scratch buffer. */
+	if (len > hsize && header[0] > hsize)
+		memcpy(header + hsize, mem, min_t(unsigned int, len,
+						  header[0]) - hsize);
+
+	do {
+		ret = uvc_video_decode_start(stream, buf, header, len);
+		if (ret == -EAGAIN)
+			uvc_video_next_buffers(stream, &buf, &meta_buf);
+	} while (ret == -EAGAIN);
+
+	if (ret < 0 || buf == NULL)
+		goto done;
+
+	uvc_video_decode_meta(stream, meta_buf, header, ret);
+
+	memcpy(stream->bulk.header, header, ret);
+	stream->bulk.header_size = ret;
+	uvc_video_zc_learn_header(stream, ret);
+
+	if (ret < hsize) {
+		/* The beginning of the payload data ended up in the scratch
+		 * buffer. Moving the data forward could overwrite the region
+		 * of the next URB, drop it instead.
+		 */
+		uvc_trace(UVC_TRACE_FRAME, "Payload header shrunk from %u "
+			  "to %d bytes, dropping payload.\n", hsize, ret);
+		buf->error = 1;
+	} else if (mem + ret - hsize == buf->mem + buf->bytesused) {
+		/* The data has been received in place. The region of the URB
+		 * fits in the buffer, it can't overflow.
+		 */
+		buf->bytesused += len - ret;
+	} else {
+		uvc_video_decode_data(uvc_urb, buf, mem + ret - hsize,
+				      len - ret);
+	}
+
+	uvc_video_decode_end(stream, buf, stream->bulk.header,
+			     stream->bulk.payload_size);
+	if (buf->state == UVC_BUF_STATE_READY)
+		uvc_video_next_buffers(stream, &buf, &meta_buf);
+
+done:
+	stream->bulk.header_size = 0;
+	stream->bulk.skip_payload = 0;
+	stream->bulk.payload_size = 0;
+}
+
 static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
-	struct uvc_buffer *buf)
+	struct uvc_buffer *buf, struct uvc_buffer *meta_buf)
 {
+	struct uvc_urb *uvc_urb = urb->context;
 	u8 *mem;
 	int len, ret;
 
@@ -1222,6 +1639,12 @@ static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
 	if (urb->actual_length == 0 && stream->bulk.header_size == 0)
 		return;
 
+	/* Zero-copy URBs carry a complete payload each. */
+	if (uvc_urb->zc_buf) {
+		uvc_video_decode_bulk_zc(uvc_urb, stream, buf, meta_buf);
+		return;
+	}
+
 	mem = urb->transfer_buffer;
 	len = urb->actual_length;
 	stream->bulk.payload_size += len;
@@ -1233,8 +1656,8 @@ static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
 		do {
 			ret = uvc_video_decode_start(stream, buf, mem, len);
 			if (ret == -EAGAIN)
-				buf = uvc_queue_next_buffer(&stream->queue,
-							    buf);
+				uvc_video_next_buffers(stream, &buf,
+						       &meta_buf);
 		} while (ret == -EAGAIN);
 
 		/* If an error occurred skip the rest of the payload. */
@@ -1243,6 +1666,8 @@ static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
 		} else {
 			memcpy(stream->bulk.header, mem, ret);
 			stream->bulk.header_size = ret;
+			uvc_video_zc_learn_header(stream, ret);
+			uvc_video_decode_meta(stream, meta_buf, mem, ret);
 
 			mem += ret;
 			len -= ret;
@@ -1256,7 +1681,7 @@ static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
 
 	/* Process video data. */
 	if (!stream->bulk.skip_payload && buf != NULL)
-		uvc_video_decode_data(stream, buf, mem, len);
+		uvc_video_decode_data(uvc_urb, buf, mem, len);
 
 	/* Detect the payload end by a URB smaller than the maximum size (or
 	 * a payload size equal to the maximum) and process the header again.
@@ -1267,8 +1692,8 @@ static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
 			uvc_video_decode_end(stream, buf, stream->bulk.header,
 				stream->bulk.payload_size);
 			if (buf->state == UVC_BUF_STATE_READY)
-				buf = uvc_queue_next_buffer(&stream->queue,
-							    buf);
+				uvc_video_next_buffers(stream, &buf,
+						       &meta_buf);
 		}
 
 		stream->bulk.header_size = 0;
@@ -1278,7 +1703,7 @@ static void uvc_video_decode_bulk(struct urb *urb, struct uvc_streaming *stream,
 }
 
 static void uvc_video_encode_bulk(struct urb *urb, struct uvc_streaming *stream,
-	struct uvc_buffer *buf)
+	struct uvc_buffer *buf, struct uvc_buffer *meta_buf)
 {
 	u8 *mem = urb->transfer_buffer;
 	int len = stream->urb_size, ret;
@@ -1320,14 +1745,162 @@ static void uvc_video_encode_bulk(struct urb *urb, struct uvc_streaming *stream,
 	urb->transfer_buffer_length = stream->urb_size - len;
 }
 
-static void uvc_video_complete(struct urb *urb)
+/*
+ * Submit a URB, setting up zero-copy bulk transfers when enabled. The offset
+ * cursors rely on URBs being queued in submission order, the irqlock is thus
+ * held across the submission.
+ */
+static int uvc_video_submit_urb(struct uvc_urb *uvc_urb, gfp_t gfp_flags)
 {
-	struct uvc_streaming *stream = urb->context;
+	struct uvc_streaming *stream = uvc_urb->stream;
+	struct uvc_video_queue *queue = &stream->queue;
+	unsigned long flags;
+	int ret;
+
+	if (!stream->bulk.zero_copy) {
+		ret = usb_submit_urb(uvc_urb->urb, gfp_flags);
+		if (ret == 0)
+			atomic_inc(&stream->urbs_queued);
+		return ret;
+	}
+
+	spin_lock_irqsave(&queue->irqlock, flags);
+	uvc_video_zc_prepare(uvc_urb);
+	ret = usb_submit_urb(uvc_urb->urb, GFP_ATOMIC);
+	if (ret == 0)
+		atomic_inc(&stream->urbs_queued);
+	spin_unlock_irqrestore(&queue->irqlock, flags);
+
+	/* Releasing the buffer can requeue it, which takes the irqlock. */
+	if (ret < 0)
+		uvc_video_zc_release(uvc_urb);
+
+	return ret;
+}
+
+/*
+ * Frame progress events.
+ *
+ * When subscribed to, the completion handler records how much data the buffer
+ * being filled holds once the URB has been decoded, and hands the URB over to
+ * the copy worker. As the worker processes URBs in completion order, all the
+ * data has reached the buffer when it reports the progress.
+ */
+static void uvc_video_progress_prepare(struct uvc_urb *uvc_urb)
+{
+	struct uvc_streaming *stream = uvc_urb->stream;
 	struct uvc_video_queue *queue = &stream->queue;
 	struct uvc_buffer *buf = NULL;
 	unsigned long flags;
+
+	if (!atomic_read(&stream->progress.subscribers))
+		return;
+
+	spin_lock_irqsave(&queue->irqlock, flags);
+	if (!list_empty(&queue->irqqueue))
+		buf = list_first_entry(&queue->irqqueue, struct uvc_buffer,
+				       queue);
+	if (buf != NULL && buf->bytesused) {
+		kref_get(&buf->ref);
+		uvc_urb->progress_buf = buf;
+		uvc_urb->progress_bytes = buf->bytesused;
+	}
+	spin_unlock_irqrestore(&queue->irqlock, flags);
+}
+
+static void uvc_video_progress_report(struct uvc_urb *uvc_urb)
+{
+	struct uvc_streaming *stream = uvc_urb->stream;
+	struct uvc_buffer *buf = uvc_urb->progress_buf;
+	unsigned int bytes = uvc_urb->progress_bytes;
+	struct uvc_frame_progress *progress;
+	struct uvc_progress_sub *sub;
+	struct v4l2_event ev;
+	unsigned long flags;
+
+	if (buf == NULL)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UVC_EVENT_FRAME_PROGRESS;
+
+	progress = (struct uvc_frame_progress *)&ev.u.data;
+	progress->index = buf->buf.vb2_buf.index;
+	progress->sequence = buf->buf.sequence;
+	progress->bytesused = bytes;
+
+	/* Events are delivered to the subscriptions with the same id only, queue
+	 * them to each subscription according to its own interval.
+	 */
+	spin_lock_irqsave(&stream->progress.lock, flags);
+	list_for_each_entry(sub, &stream->progress.subs, list) {
+		/* The byte count only decreases for a new frame, sequence
+		 * numbers restart at stream on.
+		 */
+		if (sub->sequence != buf->buf.sequence || bytes < sub->bytes) {
+			sub->sequence = buf->buf.sequence;
+			sub->bytes = 0;
+		}
+
+		if (bytes <= sub->bytes || bytes - sub->bytes < sub->sev->id)
+			continue;
+
+		ev.id = sub->sev->id;
+		v4l2_event_queue_fh(sub->sev->fh, &ev);
+		sub->bytes = bytes;
+	}
+	spin_unlock_irqrestore(&stream->progress.lock, flags);
+
+	uvc_urb->progress_buf = NULL;
+	uvc_queue_buffer_release(buf);
+}
+
+/*
+ * Perform the payload copies scheduled by the completion handler, release the
+ * buffers and resubmit the URB.
+ */
+static void uvc_video_copy_data_work(struct work_struct *work)
+{
+	struct uvc_urb *uvc_urb = container_of(work, struct uvc_urb, work);
+	unsigned int i;
+	int ret;
+
+	/* Zero-copy payloads are moved within the same buffer, the source and
+	 * destination may overlap.
+	 */
+	for (i = 0; i < uvc_urb->async_operations; ++i) {
+		struct uvc_copy_op *op = &uvc_urb->copy_operations[i];
+
+		memmove(op->dst, op->src, op->len);
+		uvc_queue_buffer_release(op->buf);
+	}
+
+	uvc_video_zc_release(uvc_urb);
+	uvc_video_progress_report(uvc_urb);
+
+	/* The URB is poisoned when streaming stops, don't complain then. */
+	ret = uvc_video_submit_urb(uvc_urb, GFP_KERNEL);
+	if (ret < 0 && ret != -EPERM)
+		uvc_printk(KERN_ERR, "Failed to resubmit video URB (%d).\n",
+			ret);
+}
+
+static void uvc_video_complete(struct urb *urb)
+{
+	struct uvc_urb *uvc_urb = urb->context;
+	struct uvc_streaming *stream = uvc_urb->stream;
+	struct uvc_video_queue *queue = &stream->queue;
+	struct uvc_video_queue *qmeta = NULL;
+	struct uvc_buffer *buf = NULL;
+	struct uvc_buffer *buf_meta = NULL;
+	int queued;
 	int ret;
 
+	queued = atomic_dec_return(&stream->urbs_queued);
+
+	if (stream->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		qmeta = &stream->meta.queue;
+
 	switch (urb->status) {
 	case 0:
 		break;
@@ -1337,27 +1910,51 @@ static void uvc_video_complete(struct urb *urb)
 			"completion handler.\n", urb->status);
 
 	case -ENOENT:		/* usb_kill_urb() called. */
-		if (stream->frozen)
+		if (stream->frozen) {
+			uvc_video_zc_release(uvc_urb);
 			return;
+		}
 
 	case -ECONNRESET:	/* usb_unlink_urb() called. */
 	case -ESHUTDOWN:	/* The endpoint is being disabled. */
+		uvc_video_zc_release(uvc_urb);
 		uvc_queue_cancel(queue, urb->status == -ESHUTDOWN);
+		if (qmeta)
+			uvc_queue_cancel(qmeta, urb->status == -ESHUTDOWN);
 		return;
 	}
 
-	spin_lock_irqsave(&queue->irqlock, flags);
-	if (!list_empty(&queue->irqqueue))
-		buf = list_first_entry(&queue->irqqueue, struct uvc_buffer,
-				       queue);
-	spin_unlock_irqrestore(&queue->irqlock, flags);
-
-	stream->decode(urb, stream, buf);
+	buf = uvc_queue_get_current_buffer(queue);
+	if (qmeta)
+		buf_meta = uvc_queue_get_current_buffer(qmeta);
 
-	if ((ret = usb_submit_urb(urb, GFP_ATOMIC)) < 0) {
-		uvc_printk(KERN_ERR, "Failed to resubmit video URB (%d).\n",
-			ret);
+	/* Account for the hardware running out of URBs, and for data received
+	 * (or requested) while userspace had no buffer queued.
+	 */
+	if (queued == 0)
+		stream->stats.stream.nb_underruns++;
+	if (buf == NULL && (urb->actual_length ||
+			    stream->type == V4L2_BUF_TYPE_VIDEO_OUTPUT))
+		stream->stats.stream.nb_no_buffer++;
+
+	/* Decode the payload headers and schedule the data copies. */
+	uvc_urb->async_operations = 0;
+	stream->decode(urb, stream, buf, buf_meta);
+
+	if (stream->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		uvc_video_progress_prepare(uvc_urb);
+
+	/* Resubmit the URB right away if there is nothing to copy or report. */
+	if (!uvc_urb->async_operations && !uvc_urb->progress_buf) {
+		uvc_video_zc_release(uvc_urb);
+		ret = uvc_video_submit_urb(uvc_urb, GFP_ATOMIC);
+		if (ret < 0)
+			uvc_printk(KERN_ERR, "Failed to resubmit video URB "
+				"(%d).\n", ret);
+		return;
 	}
+
+	queue_work(stream->async_wq, &uvc_urb->work);
 }
 
 /*
@@ -1367,35 +1964,73 @@ static void uvc_free_urb_buffers(struct uvc_streaming *stream)
 {
 	unsigned int i;
 
-	for (i = 0; i < UVC_URBS; ++i) {
-		if (stream->urb_buffer[i]) {
+	for (i = 0; i < UVC_MAX_URBS; ++i) {
+		struct uvc_urb *uvc_urb = &stream->uvc_urb[i];
+
+		if (uvc_urb->buffer) {
 #ifndef CONFIG_DMA_NONCOHERENT
 			usb_free_coherent(stream->dev->udev, stream->urb_size,
-				stream->urb_buffer[i], stream->urb_dma[i]);
+				uvc_urb->buffer, uvc_urb->dma);
 #else
-			kfree(stream->urb_buffer[i]);
+			kfree(uvc_urb->buffer);
 #endif
-			stream->urb_buffer[i] = NULL;
+			uvc_urb->buffer = NULL;
 		}
 	}
 
 	stream->urb_size = 0;
 }
 
+/*
+ * Compute the number of URBs needed to keep the stream's inflight_us worth of
+ * data in flight. The bandwidth of isochronous streams is given by the
+ * endpoint, the bandwidth of bulk streams is estimated from the maximum frame
+ * size and the frame interval.
+ */
+static unsigned int uvc_video_nurbs(struct uvc_streaming *stream,
+	unsigned int urb_size, unsigned int psize)
+{
+	unsigned int max_urbs;
+	u64 bytes;
+
+	max_urbs = clamp_t(unsigned int, stream->max_urbs, UVC_MIN_URBS,
+			   UVC_MAX_URBS);
+
+	if (stream->intf->num_altsetting > 1) {
+		bytes = psize;
+		if (stream->dev->udev->speed >= USB_SPEED_HIGH)
+			bytes *= 8000;
+		else
+			bytes *= 1000;
+	} else if (stream->ctrl.dwFrameInterval) {
+		bytes = div_u64((u64)stream->ctrl.dwMaxVideoFrameSize *
+				10000000, stream->ctrl.dwFrameInterval);
+	} else {
+		return max_urbs;
+	}
+
+	bytes = div_u64(bytes * stream->inflight_us, 1000000);
+	bytes = div_u64(bytes + urb_size - 1, urb_size);
+
+	return clamp_t(unsigned int, bytes, UVC_MIN_URBS, max_urbs);
+}
+
 /*
  * Allocate transfer buffers. This function can be called with buffers
  * already allocated when resuming from suspend, in which case it will
  * return without touching the buffers.
  *
- * Limit the buffer size to UVC_MAX_PACKETS bulk/isochronous packets. If the
- * system is too low on memory try successively smaller numbers of packets
- * until allocation succeeds.
+ * Limit the buffer size to the stream's max_packets bulk/isochronous packets,
+ * and size the URB pool with uvc_video_nurbs() for the largest buffer size.
+ * If the system is too low on memory try successively smaller numbers of
+ * packets with the same number of URBs until allocation succeeds.
  *
  * Return the number of allocated packets on success or 0 when out of memory.
  */
 static int uvc_alloc_urb_buffers(struct uvc_streaming *stream,
 	unsigned int size, unsigned int psize, gfp_t gfp_flags)
 {
+	unsigned int max_packets;
 	unsigned int npackets;
 	unsigned int i;
 
@@ -1406,32 +2041,47 @@ static int uvc_alloc_urb_buffers(struct uvc_streaming *stream,
 	/* Compute the number of packets. Bulk endpoints might transfer UVC
 	 * payloads across multiple URBs.
 	 */
+	if (stream->intf->num_altsetting > 1)
+		max_packets = UVC_MAX_PACKETS;
+	else
+		max_packets = UVC_MAX_BULK_PACKETS;
+	max_packets = clamp_t(unsigned int, stream->max_packets, 2,
+			      max_packets);
+
 	npackets = DIV_ROUND_UP(size, psize);
-	if (npackets > UVC_MAX_PACKETS)
-		npackets = UVC_MAX_PACKETS;
+	if (npackets > max_packets)
+		npackets = max_packets;
+
+	/* Keep the number of URBs when retrying, so that every retry halves
+	 * the total allocation size.
+	 */
+	stream->nurbs = uvc_video_nurbs(stream, psize * npackets, psize);
 
 	/* Retry allocations until one succeed. */
 	for (; npackets > 1; npackets /= 2) {
-		for (i = 0; i < UVC_URBS; ++i) {
-			stream->urb_size = psize * npackets;
+		stream->urb_size = psize * npackets;
+
+		for (i = 0; i < stream->nurbs; ++i) {
+			struct uvc_urb *uvc_urb = &stream->uvc_urb[i];
+
 #ifndef CONFIG_DMA_NONCOHERENT
-			stream->urb_buffer[i] = usb_alloc_coherent(
+			uvc_urb->buffer = usb_alloc_coherent(
 				stream->dev->udev, stream->urb_size,
-				gfp_flags | __GFP_NOWARN, &stream->urb_dma[i]);
+				gfp_flags | __GFP_NOWARN, &uvc_urb->dma);
 #else
-			stream->urb_buffer[i] =
+			uvc_urb->buffer =
 			    kmalloc(stream->urb_size, gfp_flags | __GFP_NOWARN);
 #endif
-			if (!stream->urb_buffer[i]) {
+			if (!uvc_urb->buffer) {
 				uvc_free_urb_buffers(stream);
 				break;
 			}
 		}
 
-		if (i == UVC_URBS) {
+		if (i == stream->nurbs) {
 			uvc_trace(UVC_TRACE_VIDEO, "Allocated %u URB buffers "
-				"of %ux%u bytes each.\n", UVC_URBS, npackets,
-				psize);
+				"of %ux%u bytes each.\n", stream->nurbs,
+				npackets, psize);
 			return npackets;
 		}
 	}
@@ -1450,15 +2100,33 @@ static void uvc_uninit_video(struct uvc_streaming *stream, int free_buffers)
 	unsigned int i;
 
 	uvc_video_stats_stop(stream);
+	uvc_bandwidth_release(stream);
+
+	/* Poison the URBs so that the copy worker can't resubmit them, and
+	 * wait for pending copies to complete before freeing them.
+	 */
+	for (i = 0; i < UVC_MAX_URBS; ++i) {
+		urb = stream->uvc_urb[i].urb;
+		if (urb != NULL)
+			usb_poison_urb(urb);
+	}
+
+	flush_workqueue(stream->async_wq);
 
-	for (i = 0; i < UVC_URBS; ++i) {
-		urb = stream->urb[i];
+	for (i = 0; i < UVC_MAX_URBS; ++i) {
+		urb = stream->uvc_urb[i].urb;
 		if (urb == NULL)
 			continue;
 
-		usb_kill_urb(urb);
 		usb_free_urb(urb);
-		stream->urb[i] = NULL;
+		stream->uvc_urb[i].urb = NULL;
+	}
+
+	for (i = 0; i < UVC_MAX_URBS; ++i) {
+		kfree(stream->uvc_urb[i].zc_header);
+		kfree(stream->uvc_urb[i].sg);
+		stream->uvc_urb[i].zc_header = NULL;
+		stream->uvc_urb[i].sg = NULL;
 	}
 
 	if (free_buffers)
@@ -1468,7 +2136,7 @@ static void uvc_uninit_video(struct uvc_streaming *stream, int free_buffers)
 /*
  * Compute the maximum number of bytes per interval for an endpoint.
  */
-static unsigned int uvc_endpoint_max_bpi(struct usb_device *dev,
+unsigned int uvc_endpoint_max_bpi(struct usb_device *dev,
 					 struct usb_host_endpoint *ep)
 {
 	u16 psize;
@@ -1509,7 +2177,9 @@ static int uvc_init_video_isoc(struct uvc_streaming *stream,
 
 	size = npackets * psize;
 
-	for (i = 0; i < UVC_URBS; ++i) {
+	for (i = 0; i < stream->nurbs; ++i) {
+		struct uvc_urb *uvc_urb = &stream->uvc_urb[i];
+
 		urb = usb_alloc_urb(npackets, gfp_flags);
 		if (urb == NULL) {
 			uvc_uninit_video(stream, 1);
@@ -1517,17 +2187,17 @@ static int uvc_init_video_isoc(struct uvc_streaming *stream,
 		}
 
 		urb->dev = stream->dev->udev;
-		urb->context = stream;
+		urb->context = uvc_urb;
 		urb->pipe = usb_rcvisocpipe(stream->dev->udev,
 				ep->desc.bEndpointAddress);
 #ifndef CONFIG_DMA_NONCOHERENT
 		urb->transfer_flags = URB_ISO_ASAP | URB_NO_TRANSFER_DMA_MAP;
-		urb->transfer_dma = stream->urb_dma[i];
+		urb->transfer_dma = uvc_urb->dma;
 #else
 		urb->transfer_flags = URB_ISO_ASAP;
 #endif
 		urb->interval = ep->desc.bInterval;
-		urb->transfer_buffer = stream->urb_buffer[i];
+		urb->transfer_buffer = uvc_urb->buffer;
 		urb->complete = uvc_video_complete;
 		urb->number_of_packets = npackets;
 		urb->transfer_buffer_length = size;
@@ -1537,7 +2207,7 @@ static int uvc_init_video_isoc(struct uvc_streaming *stream,
 			urb->iso_frame_desc[j].length = psize;
 		}
 
-		stream->urb[i] = urb;
+		uvc_urb->urb = urb;
 	}
 
 	return 0;
@@ -1551,7 +2221,7 @@ static int uvc_init_video_bulk(struct uvc_streaming *stream,
 	struct usb_host_endpoint *ep, gfp_t gfp_flags)
 {
 	struct urb *urb;
-	unsigned int npackets, pipe, i;
+	unsigned int npackets, pipe, nsgs, i;
 	u16 psize;
 	u32 size;
 
@@ -1575,7 +2245,21 @@ static int uvc_init_video_bulk(struct uvc_streaming *stream,
 	if (stream->type == V4L2_BUF_TYPE_VIDEO_OUTPUT)
 		size = 0;
 
-	for (i = 0; i < UVC_URBS; ++i) {
+	/* Zero-copy requires complete payloads in every URB, and scatter-gather
+	 * lists with entries of any size. The data region of a URB can span
+	 * one more page than its size, plus an entry for the header.
+	 */
+	nsgs = DIV_ROUND_UP(size, PAGE_SIZE) + 2;
+	stream->bulk.zero_copy = usb_endpoint_dir_in(&ep->desc) &&
+		size >= stream->bulk.max_payload_size &&
+		size > UVC_ZC_HEADER_SIZE &&
+		stream->dev->udev->bus->sg_tablesize >= nsgs &&
+		usb_device_no_sg_constraint(stream->dev->udev);
+	stream->bulk.zc_header_size = 0;
+
+	for (i = 0; i < stream->nurbs; ++i) {
+		struct uvc_urb *uvc_urb = &stream->uvc_urb[i];
+
 		urb = usb_alloc_urb(0, gfp_flags);
 		if (urb == NULL) {
 			uvc_uninit_video(stream, 1);
@@ -1583,16 +2267,31 @@ static int uvc_init_video_bulk(struct uvc_streaming *stream,
 		}
 
 		usb_fill_bulk_urb(urb, stream->dev->udev, pipe,
-			stream->urb_buffer[i], size, uvc_video_complete,
-			stream);
+			uvc_urb->buffer, size, uvc_video_complete,
+			uvc_urb);
 #ifndef CONFIG_DMA_NONCOHERENT
 		urb->transfer_flags = URB_NO_TRANSFER_DMA_MAP;
-		urb->transfer_dma = stream->urb_dma[i];
+		urb->transfer_dma = uvc_urb->dma;
 #endif
 
-		stream->urb[i] = urb;
+		uvc_urb->urb = urb;
+
+		if (stream->bulk.zero_copy) {
+			uvc_urb->zc_header = kmalloc(UVC_ZC_HEADER_SIZE,
+						     gfp_flags);
+			uvc_urb->sg = kmalloc_array(nsgs, sizeof(*uvc_urb->sg),
+						    gfp_flags);
+			uvc_urb->nsgs = nsgs;
+			if (uvc_urb->zc_header == NULL || uvc_urb->sg == NULL) {
+				uvc_uninit_video(stream, 1);
+				return -ENOMEM;
+			}
+		}
 	}
 
+	if (stream->bulk.zero_copy)
+		uvc_trace(UVC_TRACE_VIDEO, "Using zero-copy bulk transfers.\n");
+
 	return 0;
 }
 
@@ -1615,57 +2314,15 @@ static int uvc_init_video(struct uvc_streaming *stream, gfp_t gfp_flags)
 	uvc_video_stats_start(stream);
 
 	if (intf->num_altsetting > 1) {
-		struct usb_host_endpoint *best_ep = NULL;
-		unsigned int best_psize = UINT_MAX;
-		unsigned int bandwidth;
-		unsigned int uninitialized_var(altsetting);
-		int intfnum = stream->intfnum;
-
 		/* Isochronous endpoint, select the alternate setting. */
-		bandwidth = stream->ctrl.dwMaxPayloadTransferSize;
+		uvc_trace(UVC_TRACE_VIDEO, "Device requested %u B/frame "
+			"bandwidth.\n", stream->ctrl.dwMaxPayloadTransferSize);
 
-		if (bandwidth == 0) {
-			uvc_trace(UVC_TRACE_VIDEO, "Device requested null "
-				"bandwidth, defaulting to lowest.\n");
-			bandwidth = 1;
-		} else {
-			uvc_trace(UVC_TRACE_VIDEO, "Device requested %u "
-				"B/frame bandwidth.\n", bandwidth);
-		}
-
-		for (i = 0; i < intf->num_altsetting; ++i) {
-			struct usb_host_interface *alts;
-			unsigned int psize;
-
-			alts = &intf->altsetting[i];
-			ep = uvc_find_endpoint(alts,
-				stream->header.bEndpointAddress);
-			if (ep == NULL)
-				continue;
-
-			/* Check if the bandwidth is high enough. */
-			psize = uvc_endpoint_max_bpi(stream->dev->udev, ep);
-			if (psize >= bandwidth && psize <= best_psize) {
-				altsetting = alts->desc.bAlternateSetting;
-				best_psize = psize;
-				best_ep = ep;
-			}
-		}
+		ep = uvc_bandwidth_select(stream);
+		if (IS_ERR(ep))
+			return PTR_ERR(ep);
 
-		if (best_ep == NULL) {
-			uvc_trace(UVC_TRACE_VIDEO, "No fast enough alt setting "
-				"for requested bandwidth.\n");
-			return -EIO;
-		}
-
-		uvc_trace(UVC_TRACE_VIDEO, "Selecting alternate setting %u "
-			"(%u B/frame bandwidth).\n", altsetting, best_psize);
-
-		ret = usb_set_interface(stream->dev->udev, intfnum, altsetting);
-		if (ret < 0)
-			return ret;
-
-		ret = uvc_init_video_isoc(stream, best_ep, gfp_flags);
+		ret = uvc_init_video_isoc(stream, ep, gfp_flags);
 	} else {
 		/* Bulk endpoint, proceed to URB initialization. */
 		ep = uvc_find_endpoint(&intf->altsetting[0],
@@ -1676,12 +2333,16 @@ static int uvc_init_video(struct uvc_streaming *stream, gfp_t gfp_flags)
 		ret = uvc_init_video_bulk(stream, ep, gfp_flags);
 	}
 
-	if (ret < 0)
+	if (ret < 0) {
+		uvc_bandwidth_release(stream);
 		return ret;
+	}
 
 	/* Submit the URBs. */
-	for (i = 0; i < UVC_URBS; ++i) {
-		ret = usb_submit_urb(stream->urb[i], gfp_flags);
+	atomic_set(&stream->urbs_queued, 0);
+
+	for (i = 0; i < stream->nurbs; ++i) {
+		ret = uvc_video_submit_urb(&stream->uvc_urb[i], gfp_flags);
 		if (ret < 0) {
 			uvc_printk(KERN_ERR, "Failed to submit URB %u "
 					"(%d).\n", i, ret);
@@ -1738,9 +2399,14 @@ int uvc_video_resume(struct uvc_streaming *stream, int reset)
 	 * misbehave if they don't receive a SET_INTERFACE request before any
 	 * other video control request.
 	 */
-	if (reset)
+	if (reset) {
 		usb_set_interface(stream->dev->udev, stream->intfnum, 0);
 
+		mutex_lock(&stream->mutex);
+		uvc_probe_cache_flush(stream);
+		mutex_unlock(&stream->mutex);
+	}
+
 	stream->frozen = 0;
 
 	uvc_video_clock_reset(stream);
@@ -1783,6 +2449,25 @@ int uvc_video_init(struct uvc_streaming *stream)
 	}
 
 	atomic_set(&stream->active, 0);
+	spin_lock_init(&stream->clock.lock);
+
+	/* Payload copies are performed by an unbound worker to keep them out
+	 * of the URB completion handler. Zero-copy bulk transfers compact
+	 * payload data in place, which requires the copies to be performed in
+	 * the order the URBs completed.
+	 */
+	stream->async_wq = alloc_ordered_workqueue("uvcvideo", WQ_HIGHPRI);
+	if (stream->async_wq == NULL)
+		return -ENOMEM;
+
+	stream->max_urbs = uvc_max_urbs_param;
+	stream->max_packets = uvc_max_packets_param;
+	stream->inflight_us = uvc_inflight_param;
+
+	for (i = 0; i < UVC_MAX_URBS; ++i) {
+		stream->uvc_urb[i].stream = stream;
+		INIT_WORK(&stream->uvc_urb[i].work, uvc_video_copy_data_work);
+	}
 
 	/* Alternate setting 0 should be the default, yet the XBox Live Vision
 	 * Cam (and possibly other devices) crash or otherwise misbehave if
@@ -1890,29 +2575,35 @@ int uvc_video_enable(struct uvc_streaming *stream, int enable)
 			usb_clear_halt(stream->dev->udev, pipe);
 		}
 
-		uvc_video_clock_cleanup(stream);
 		return 0;
 	}
 
-	ret = uvc_video_clock_init(stream);
-	if (ret < 0)
-		return ret;
+	uvc_video_clock_init(stream);
+	memset(stream->meta.last_scr, 0, sizeof(stream->meta.last_scr));
 
-	/* Commit the streaming parameters. */
+	/* Commit the streaming parameters. If the device rejects them, they
+	 * might have come from a stale probe cache entry. Flush the cache and
+	 * negotiate again before giving up.
+	 */
 	ret = uvc_commit_video(stream, &stream->ctrl);
-	if (ret < 0)
-		goto error_commit;
+	if (ret < 0) {
+		uvc_probe_cache_flush(stream);
 
-	ret = uvc_init_video(stream, GFP_KERNEL);
-	if (ret < 0)
-		goto error_video;
+		ret = uvc_probe_video(stream, &stream->ctrl);
+		if (ret < 0)
+			return ret;
 
-	return 0;
+		ret = uvc_commit_video(stream, &stream->ctrl);
+		if (ret < 0)
+			return ret;
+	}
 
-error_video:
-	usb_set_interface(stream->dev->udev, stream->intfnum, 0);
-error_commit:
-	uvc_video_clock_cleanup(stream);
+	ret = uvc_init_video(stream, GFP_KERNEL);
+	if (ret < 0) {
+		uvc_bandwidth_release(stream);
+		usb_set_interface(stream->dev->udev, stream->intfnum, 0);
+		return ret;
+	}
 
-	return ret;
+	return 0;
 }
@@ -6,11 +6,14 @@
 #endif /* __KERNEL__ */
 
 #include <linux/kernel.h>
+#include <linux/kref.h>
 #include <linux/poll.h>
+#include <linux/scatterlist.h>
 #include <linux/usb.h>
 #include <linux/usb/video.h>
 #include <linux/uvcvideo.h>
 #include <linux/videodev2.h>
+#include <linux/workqueue.h>
 #include <media/media-device.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
@@ -138,12 +141,25 @@
 
 #define DRIVER_VERSION		"1.1.1"
 
-/* Number of isochronous URBs. */
-#define UVC_URBS		5
-/* Maximum number of packets per URB. */
+/* Minimum and maximum number of URBs per stream. */
+#define UVC_MIN_URBS		2
+#define UVC_MAX_URBS		16
+/* Default duration of the data in flight, in microseconds. */
+#define UVC_URBS_INFLIGHT_US	20000
+/* Maximum number of packets per isochronous URB. */
 #define UVC_MAX_PACKETS		32
+/* Maximum number of packets per bulk URB. */
+#define UVC_MAX_BULK_PACKETS	512
+/* Size of the scratch buffer receiving zero-copy bulk payload headers. */
+#define UVC_ZC_HEADER_SIZE	256
+/* Size of the metadata buffers. */
+#define UVC_METADATA_BUF_SIZE	(10 * 1024)
 /* Maximum status buffer size in bytes of interrupt URB. */
 #define UVC_MAX_STATUS_SIZE	16
+/* Number of control status events buffered for processing. */
+#define UVC_CTRL_STATUS_EVENTS	8
+/* Number of negotiated streaming parameters cached per stream. */
+#define UVC_PROBE_CACHE_SIZE	16
 
 #define UVC_CTRL_CONTROL_TIMEOUT	300
 #define UVC_CTRL_STREAMING_TIMEOUT	5000
@@ -226,7 +242,11 @@ struct uvc_control {
 	     loaded:1,
 	     modified:1,
 	     cached:1,
-	     initialized:1;
+	     initialized:1,
+	     refresh:1;
+
+	/* Expiration time of the cached value of auto-update controls. */
+	unsigned long expires;
 
 	__u8 *uvc_data;
 };
@@ -377,6 +397,14 @@ struct uvc_buffer {
 	unsigned int bytesused;
 
 	u32 pts;
+
+	/* Held by the irq queue, by every pending asynchronous copy and by
+	 * every zero-copy URB targeting the buffer memory.
+	 */
+	struct kref ref;
+
+	/* Offset the next zero-copy URB targeting the buffer will use. */
+	unsigned int zc_next;
 };
 
 #define UVC_QUEUE_DISCONNECTED		(1 << 0)
@@ -440,6 +468,10 @@ struct uvc_stats_stream {
 	unsigned int nb_invalid;	/* Number of packets with an invalid header */
 	unsigned int nb_errors;		/* Number of packets with the error bit set */
 
+	unsigned int nb_lost;		/* Number of isochronous packets lost */
+	unsigned int nb_underruns;	/* Number of times no URB was queued */
+	unsigned int nb_no_buffer;	/* Number of URBs without video buffer */
+
 	unsigned int nb_pts_constant;	/* Number of frames with constant PTS */
 	unsigned int nb_pts_early;	/* Number of frames with early PTS */
 	unsigned int nb_pts_initial;	/* Number of frames with initial PTS */
@@ -452,6 +484,53 @@ struct uvc_stats_stream {
 	unsigned int max_sof;		/* Maximum STC.SOF value */
 };
 
+/* A payload copy deferred from the URB completion handler to a worker. */
+struct uvc_copy_op {
+	struct uvc_buffer *buf;
+	void *dst;
+	const __u8 *src;
+	size_t len;
+};
+
+struct uvc_urb {
+	struct urb *urb;
+	struct uvc_streaming *stream;
+
+	char *buffer;
+	dma_addr_t dma;
+
+	/* Copies to perform before the URB can be resubmitted. */
+	unsigned int async_operations;
+	struct uvc_copy_op copy_operations[UVC_MAX_PACKETS];
+	struct work_struct work;
+
+	/* Zero-copy bulk transfers. The payload header is received in
+	 * zc_header and the payload data directly in zc_buf at zc_offset.
+	 */
+	struct uvc_buffer *zc_buf;
+	unsigned int zc_offset;
+	unsigned int zc_header_size;
+	__u8 *zc_header;
+	struct scatterlist *sg;
+	unsigned int nsgs;
+
+	/* Frame progress to report once the copies have been performed. */
+	struct uvc_buffer *progress_buf;
+	unsigned int progress_bytes;
+};
+
+/*
+ * Frame progress event subscription. The subscription id is the notification
+ * interval in bytes, and each subscription tracks the last frame and number of
+ * bytes it has been notified of.
+ */
+struct uvc_progress_sub {
+	struct list_head list;
+	struct v4l2_subscribed_event *sev;
+	__u32 sequence;
+	unsigned int bytes;
+};
+
 struct uvc_streaming {
 	struct list_head list;
 	struct uvc_device *dev;
@@ -474,16 +553,36 @@ struct uvc_streaming {
 	struct uvc_format *cur_format;
 	struct uvc_frame *cur_frame;
 
-	/* Protect access to ctrl, cur_format, cur_frame and hardware video
-	 * probe control.
+	/* Protect access to ctrl, cur_format, cur_frame, probe_cache and
+	 * hardware video probe control.
 	 */
 	struct mutex mutex;
 
+	/* Streaming parameters negotiated with the device, indexed by the
+	 * fields of the probe request set by the host.
+	 */
+	struct {
+		struct uvc_probe_cache_entry {
+			struct uvc_streaming_control key;
+			struct uvc_streaming_control ctrl;
+		} entries[UVC_PROBE_CACHE_SIZE];
+		unsigned int count;
+		unsigned int next;
+	} probe_cache;
+
 	/* Buffers queue. */
 	unsigned int frozen : 1;
 	struct uvc_video_queue queue;
 	void (*decode) (struct urb *urb, struct uvc_streaming *video,
-			struct uvc_buffer *buf);
+			struct uvc_buffer *buf, struct uvc_buffer *meta_buf);
+
+	/* Payload header metadata capture node. */
+	struct {
+		struct video_device vdev;
+		struct uvc_video_queue queue;
+		__u32 format;
+		__u8 last_scr[6];
+	} meta;
 
 	/* Context data used by the bulk completion handler. */
 	struct {
@@ -492,12 +591,44 @@ struct uvc_streaming {
 		int skip_payload;
 		__u32 payload_size;
 		__u32 max_payload_size;
+
+		/* Zero-copy state, protected by the queue irqlock. */
+		unsigned int zero_copy : 1;
+		unsigned int zc_header_size;
 	} bulk;
 
-	struct urb *urb[UVC_URBS];
-	char *urb_buffer[UVC_URBS];
-	dma_addr_t urb_dma[UVC_URBS];
+	struct uvc_urb uvc_urb[UVC_MAX_URBS];
+	unsigned int nurbs;
 	unsigned int urb_size;
+	atomic_t urbs_queued;
+
+	/* URB pool sizing limits, initialized from the module parameters and
+	 * adjustable through debugfs. Changes take effect at the next stream
+	 * start.
+	 */
+	u32 max_urbs;
+	u32 max_packets;
+	u32 inflight_us;
+
+	/* Frame progress events subscriptions, see uvc_progress_sub. */
+	struct {
+		atomic_t subscribers;
+		spinlock_t lock;
+		struct list_head subs;
+	} progress;
+
+	/* Isochronous bandwidth reservation, see uvc_bandwidth.c. */
+	struct uvc_bandwidth {
+		struct list_head list;
+		__u8 altsetting;
+		unsigned int required;
+		unsigned int allocated;
+		unsigned int budget;
+		const char *reason;
+	} bandwidth;
+
+	/* Worker running the payload copies, off the completion handler. */
+	struct workqueue_struct *async_wq;
 
 	__u32 sequence;
 	__u8 last_fid;
@@ -511,16 +642,30 @@ struct uvc_streaming {
 
 	/* Timestamps support. */
 	struct uvc_clock {
-		struct uvc_clock_sample {
-			u32 dev_stc;
-			u16 dev_sof;
-			struct timespec host_ts;
-			u16 host_sof;
-		} *samples;
-
-		unsigned int head;
-		unsigned int count;
-		unsigned int size;
+		/* Running linear fits of the SOF against the device clock and
+		 * of the host clock against the SOF.
+		 */
+		struct uvc_clock_fit {
+			u64 x0;
+			u64 y0;
+			s64 mean_x;
+			s64 mean_y;
+			s64 cov_xx;
+			s64 cov_xy;
+			s64 slope;
+			s64 nominal;
+			u64 error;
+			unsigned int count;
+		} sof, host;
+
+		/* Unwrapped device clock in ticks, and device SOF and host time
+		 * in the fit units, of the last sample.
+		 */
+		u64 stc;
+		u64 dev_sof;
+		u64 host_ts;
+		u32 last_stc;
+		unsigned int stc_shift;
 
 		u16 last_sof;
 		u16 sof_offset;
@@ -562,6 +707,22 @@ struct uvc_device {
 	__u8 *status;
 	struct input_dev *input;
 	char input_phys[64];
+
+	/* Control status events and background refresh of cached controls. */
+	struct {
+		struct work_struct work;
+		spinlock_t lock;
+		unsigned int head;
+		unsigned int count;
+		bool overflow;
+		struct uvc_ctrl_status {
+			__u8 data[UVC_MAX_STATUS_SIZE];
+			unsigned int len;
+		} events[UVC_CTRL_STATUS_EVENTS];
+	} ctrl_status;
+
+	/* Asynchronous control discovery */
+	struct work_struct ctrl_work;
 };
 
 enum uvc_handle_state {
@@ -606,6 +767,10 @@ extern unsigned int uvc_no_drop_param;
 extern unsigned int uvc_trace_param;
 extern unsigned int uvc_timeout_param;
 extern unsigned int uvc_hw_timestamps_param;
+extern unsigned int uvc_max_urbs_param;
+extern unsigned int uvc_max_packets_param;
+extern unsigned int uvc_inflight_param;
+extern unsigned int uvc_ctrl_cache_param;
 
 #define uvc_trace(flag, msg...) \
 	do { \
@@ -629,6 +794,12 @@ extern unsigned int uvc_hw_timestamps_param;
 /* Core driver */
 extern struct uvc_driver uvc_driver;
 
+extern int uvc_register_video_device(struct uvc_device *dev,
+		struct uvc_streaming *stream, struct video_device *vdev,
+		enum v4l2_buf_type type,
+		const struct v4l2_file_operations *fops,
+		const struct v4l2_ioctl_ops *ioctl_ops);
+
 extern struct uvc_entity *uvc_entity_by_id(struct uvc_device *dev, int id);
 
 /* Video buffers queue management. */
@@ -652,8 +823,11 @@ extern int uvc_queue_streamon(struct uvc_video_queue *queue,
 extern int uvc_queue_streamoff(struct uvc_video_queue *queue,
 			       enum v4l2_buf_type type);
 extern void uvc_queue_cancel(struct uvc_video_queue *queue, int disconnect);
+extern void uvc_queue_buffer_release(struct uvc_buffer *buf);
 extern struct uvc_buffer *uvc_queue_next_buffer(struct uvc_video_queue *queue,
 		struct uvc_buffer *buf);
+extern struct uvc_buffer *
+		uvc_queue_get_current_buffer(struct uvc_video_queue *queue);
 extern int uvc_queue_mmap(struct uvc_video_queue *queue,
 		struct vm_area_struct *vma);
 extern unsigned int uvc_queue_poll(struct uvc_video_queue *queue,
@@ -672,6 +846,9 @@ static inline int uvc_queue_streaming(struct uvc_video_queue *queue)
 extern const struct v4l2_ioctl_ops uvc_ioctl_ops;
 extern const struct v4l2_file_operations uvc_fops;
 
+/* Metadata */
+extern int uvc_meta_register(struct uvc_streaming *stream);
+
 /* Media controller */
 extern int uvc_mc_register_entities(struct uvc_video_chain *chain);
 extern void uvc_mc_cleanup_entity(struct uvc_entity *entity);
@@ -683,6 +860,7 @@ extern int uvc_video_resume(struct uvc_streaming *stream, int reset);
 extern int uvc_video_enable(struct uvc_streaming *stream, int enable);
 extern int uvc_probe_video(struct uvc_streaming *stream,
 		struct uvc_streaming_control *probe);
+extern void uvc_probe_cache_flush(struct uvc_streaming *stream);
 extern int uvc_query_ctrl(struct uvc_device *dev, __u8 query, __u8 unit,
 		__u8 intfnum, __u8 cs, void *data, __u16 size);
 void uvc_video_clock_update(struct uvc_streaming *stream,
@@ -708,6 +886,13 @@ extern int uvc_ctrl_add_mapping(struct uvc_video_chain *chain,
 extern int uvc_ctrl_init_device(struct uvc_device *dev);
 extern void uvc_ctrl_cleanup_device(struct uvc_device *dev);
 extern int uvc_ctrl_restore_values(struct uvc_device *dev);
+extern void uvc_ctrl_status_event(struct uvc_device *dev, const __u8 *data,
+		unsigned int len);
+extern void uvc_ctrl_status_work(struct work_struct *work);
+extern void uvc_ctrl_discovery_work(struct work_struct *work);
+extern void uvc_ctrl_start_discovery(struct uvc_device *dev);
+extern void uvc_ctrl_stop_discovery(struct uvc_device *dev);
+extern void uvc_ctrl_cleanup_info_cache(void);
 
 extern int uvc_ctrl_begin(struct uvc_video_chain *chain);
 extern int __uvc_ctrl_commit(struct uvc_fh *handle, int rollback,
@@ -740,9 +925,18 @@ extern uint32_t uvc_fraction_to_interval(uint32_t numerator,
 extern struct usb_host_endpoint *uvc_find_endpoint(
 		struct usb_host_interface *alts, __u8 epaddr);
 
+extern unsigned int uvc_endpoint_max_bpi(struct usb_device *dev,
+		struct usb_host_endpoint *ep);
+
+/* Bandwidth planning */
+extern struct usb_host_endpoint *uvc_bandwidth_select(
+		struct uvc_streaming *stream);
+extern void uvc_bandwidth_release(struct uvc_streaming *stream);
+extern size_t uvc_bandwidth_dump(char *buf, size_t size);
+
 /* Quirks support */
 void uvc_video_decode_isight(struct urb *urb, struct uvc_streaming *stream,
-		struct uvc_buffer *buf);
+		struct uvc_buffer *buf, struct uvc_buffer *meta_buf);
 
 /* debugfs and statistics */
 int uvc_debugfs_init(void);
@@ -750,6 +944,8 @@ void uvc_debugfs_cleanup(void);
 int uvc_debugfs_init_stream(struct uvc_streaming *stream);
 void uvc_debugfs_cleanup_stream(struct uvc_streaming *stream);
 
+size_t uvc_video_clock_dump(struct uvc_streaming *stream, char *buf,
+			    size_t size);
 size_t uvc_video_stats_dump(struct uvc_streaming *stream, char *buf,
 			    size_t size);
 
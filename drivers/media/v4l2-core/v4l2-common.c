@@ -405,3 +405,71 @@ void v4l2_get_timestamp(struct timeval *tv)
 	tv->tv_usec = ts.tv_nsec / NSEC_PER_USEC;
 }
 EXPORT_SYMBOL_GPL(v4l2_get_timestamp);
+
+/* Copy len bytes of field data, starting at offset pos in the field, into a
+ * frame buffer of the given size. For interlaced frames, the lines of the
+ * field are every other line of the frame, starting with the first line for
+ * the top field and the second one for the bottom field. Otherwise the field
+ * is the whole frame.
+ *
+ * The line spans are computed once, so that only the copies are left in the
+ * loop. This is meant to be called for every packet from the URB completion
+ * handlers of the analog video grabbers.
+ *
+ * Returns the number of bytes copied, which is less than len when the data
+ * doesn't fit in the frame buffer.
+ */
+size_t v4l2_field_weave(void *frame, size_t size, unsigned int bytesperline,
+			bool interlaced, bool bottom, size_t pos,
+			const void *src, size_t len)
+{
+	size_t stride, offset, copied, n;
+	unsigned int lineoff, lines, i;
+
+	if (!interlaced) {
+		if (pos >= size)
+			return 0;
+		len = min(len, size - pos);
+		memcpy(frame + pos, src, len);
+		return len;
+	}
+
+	stride = 2 * (size_t)bytesperline;
+	lineoff = pos % bytesperline;
+	offset = (pos / bytesperline) * stride + lineoff;
+	if (bottom)
+		offset += bytesperline;
+	if (offset >= size)
+		return 0;
+
+	/* End of the current line */
+	copied = min3(len, (size_t)(bytesperline - lineoff), size - offset);
+	memcpy(frame + offset, src, copied);
+	if (copied == len || lineoff + copied < bytesperline)
+		return copied;
+	offset += stride - lineoff;
+
+	/* Whole lines that fit in the frame */
+	lines = (len - copied) / bytesperline;
+	if (offset + bytesperline > size)
+		lines = 0;
+	else
+		lines = min_t(size_t, lines,
+			      (size - offset - bytesperline) / stride + 1);
+
+	for (i = 0; i < lines; i++) {
+		memcpy(frame + offset, src + copied, bytesperline);
+		copied += bytesperline;
+		offset += stride;
+	}
+
+	/* Beginning of the next line */
+	if (copied < len && offset < size) {
+		n = min3(len - copied, (size_t)bytesperline, size - offset);
+		memcpy(frame + offset, src + copied, n);
+		copied += n;
+	}
+
+	return copied;
+}
+EXPORT_SYMBOL_GPL(v4l2_field_weave);
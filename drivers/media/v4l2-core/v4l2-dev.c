@@ -230,6 +230,19 @@ struct video_device *video_devdata(struct file *file)
 }
 EXPORT_SYMBOL(video_devdata);
 
+static const struct file_operations v4l2_fops;
+
+/* Same as video_devdata(), but returns NULL for files that are not
+   V4L2 device nodes. For drivers that take file descriptors of other
+   devices from userspace. */
+struct video_device *video_devdata_checked(struct file *file)
+{
+	if (file->f_op != &v4l2_fops)
+		return NULL;
+	return video_devdata(file);
+}
+EXPORT_SYMBOL_GPL(video_devdata_checked);
+
 
 /* Priority handling */
 
@@ -311,6 +324,25 @@ static ssize_t v4l2_read(struct file *filp, char __user *buf,
 	return ret;
 }
 
+static ssize_t v4l2_splice_read(struct file *filp, loff_t *ppos,
+		struct pipe_inode_info *pipe, size_t len, unsigned int flags)
+{
+	struct video_device *vdev = video_devdata(filp);
+	ssize_t ret = -ENODEV;
+
+	/* Drivers without splice support get the copying default, which
+	   goes through v4l2_read(). */
+	if (!vdev->fops->splice_read)
+		return default_file_splice_read(filp, ppos, pipe, len, flags);
+	if (video_is_registered(vdev))
+		ret = vdev->fops->splice_read(filp, ppos, pipe, len, flags);
+	if ((vdev->dev_debug & V4L2_DEV_DEBUG_FOP) &&
+	    (vdev->dev_debug & V4L2_DEV_DEBUG_STREAMING))
+		printk(KERN_DEBUG "%s: splice_read: %zd (%zd)\n",
+			video_device_node_name(vdev), len, ret);
+	return ret;
+}
+
 static ssize_t v4l2_write(struct file *filp, const char __user *buf,
 		size_t sz, loff_t *off)
 {
@@ -455,6 +487,7 @@ static const struct file_operations v4l2_fops = {
 	.owner = THIS_MODULE,
 	.read = v4l2_read,
 	.write = v4l2_write,
+	.splice_read = v4l2_splice_read,
 	.open = v4l2_open,
 	.get_unmapped_area = v4l2_get_unmapped_area,
 	.mmap = v4l2_mmap,
@@ -574,27 +607,31 @@ static void determine_valid_ioctls(struct video_device *vdev)
 		/* video specific ioctls */
 		if ((is_rx && (ops->vidioc_enum_fmt_vid_cap ||
 			       ops->vidioc_enum_fmt_vid_cap_mplane ||
-			       ops->vidioc_enum_fmt_vid_overlay)) ||
+			       ops->vidioc_enum_fmt_vid_overlay ||
+			       ops->vidioc_enum_fmt_meta_cap)) ||
 		    (is_tx && (ops->vidioc_enum_fmt_vid_out ||
 			       ops->vidioc_enum_fmt_vid_out_mplane)))
 			set_bit(_IOC_NR(VIDIOC_ENUM_FMT), valid_ioctls);
 		if ((is_rx && (ops->vidioc_g_fmt_vid_cap ||
 			       ops->vidioc_g_fmt_vid_cap_mplane ||
-			       ops->vidioc_g_fmt_vid_overlay)) ||
+			       ops->vidioc_g_fmt_vid_overlay ||
+			       ops->vidioc_g_fmt_meta_cap)) ||
 		    (is_tx && (ops->vidioc_g_fmt_vid_out ||
 			       ops->vidioc_g_fmt_vid_out_mplane ||
 			       ops->vidioc_g_fmt_vid_out_overlay)))
 			 set_bit(_IOC_NR(VIDIOC_G_FMT), valid_ioctls);
 		if ((is_rx && (ops->vidioc_s_fmt_vid_cap ||
 			       ops->vidioc_s_fmt_vid_cap_mplane ||
-			       ops->vidioc_s_fmt_vid_overlay)) ||
+			       ops->vidioc_s_fmt_vid_overlay ||
+			       ops->vidioc_s_fmt_meta_cap)) ||
 		    (is_tx && (ops->vidioc_s_fmt_vid_out ||
 			       ops->vidioc_s_fmt_vid_out_mplane ||
 			       ops->vidioc_s_fmt_vid_out_overlay)))
 			 set_bit(_IOC_NR(VIDIOC_S_FMT), valid_ioctls);
 		if ((is_rx && (ops->vidioc_try_fmt_vid_cap ||
 			       ops->vidioc_try_fmt_vid_cap_mplane ||
-			       ops->vidioc_try_fmt_vid_overlay)) ||
+			       ops->vidioc_try_fmt_vid_overlay ||
+			       ops->vidioc_try_fmt_meta_cap)) ||
 		    (is_tx && (ops->vidioc_try_fmt_vid_out ||
 			       ops->vidioc_try_fmt_vid_out_mplane ||
 			       ops->vidioc_try_fmt_vid_out_overlay)))
@@ -13,7 +13,9 @@
  * Free Software Foundation; either version 2 of the License, or (at your
  * option) any later version.
  */
+#include <linux/dma-buf.h>
 #include <linux/module.h>
+#include <linux/reservation.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 
@@ -188,6 +190,124 @@ static void v4l2_m2m_try_run(struct v4l2_m2m_dev *m2m_dev)
 	m2m_dev->m2m_ops->device_run(m2m_dev->curr_ctx->priv);
 }
 
+static void v4l2_m2m_src_fence_cb(struct fence *fence, struct fence_cb *cb)
+{
+	struct v4l2_m2m_ctx *m2m_ctx =
+		container_of(cb, struct v4l2_m2m_ctx, src_fence_cb);
+
+	/* Called with the fence lock held, possibly in interrupt context */
+	schedule_work(&m2m_ctx->src_fence_work);
+}
+
+static void v4l2_m2m_src_fence_work(struct work_struct *work)
+{
+	struct v4l2_m2m_ctx *m2m_ctx =
+		container_of(work, struct v4l2_m2m_ctx, src_fence_work);
+	struct v4l2_m2m_dev *m2m_dev = m2m_ctx->m2m_dev;
+	struct fence *fence;
+	unsigned long flags;
+
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	fence = m2m_ctx->src_fence;
+	m2m_ctx->src_fence = NULL;
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+
+	if (fence)
+		fence_put(fence);
+
+	dprintk("Source fence signaled for m2m_ctx: %p\n", m2m_ctx);
+	v4l2_m2m_try_schedule(m2m_ctx);
+}
+
+/**
+ * v4l2_m2m_src_fence_pending() - check whether the next source buffer still
+ * waits for an implicit fence
+ * @m2m_ctx:	m2m context assigned to the instance to be checked
+ *
+ * Looks at the exclusive fence of the reservation object of each imported
+ * DMABUF plane of the first ready source buffer. If one of them has not
+ * signaled yet, a callback is installed that reschedules the context once it
+ * does, and true is returned. Must be called with job_spinlock held.
+ */
+static bool v4l2_m2m_src_fence_pending(struct v4l2_m2m_ctx *m2m_ctx)
+{
+	struct v4l2_m2m_queue_ctx *q_ctx = &m2m_ctx->out_q_ctx;
+	struct v4l2_m2m_buffer *b;
+	struct vb2_buffer *vb;
+	unsigned long flags;
+	unsigned int plane;
+	int ret;
+
+	/* A callback is already armed, it will reschedule us */
+	if (m2m_ctx->src_fence)
+		return true;
+
+	spin_lock_irqsave(&q_ctx->rdy_spinlock, flags);
+	if (list_empty(&q_ctx->rdy_queue)) {
+		spin_unlock_irqrestore(&q_ctx->rdy_spinlock, flags);
+		return false;
+	}
+	b = list_first_entry(&q_ctx->rdy_queue, struct v4l2_m2m_buffer, list);
+	vb = &b->vb.vb2_buf;
+
+	for (plane = 0; plane < vb->num_planes; ++plane) {
+		struct dma_buf *dbuf = vb->planes[plane].dbuf;
+		struct fence *fence;
+
+		if (vb->memory != VB2_MEMORY_DMABUF || !dbuf)
+			break;
+
+		fence = reservation_object_get_excl_rcu(dbuf->resv);
+		if (!fence)
+			continue;
+
+		ret = fence_add_callback(fence, &m2m_ctx->src_fence_cb,
+					 v4l2_m2m_src_fence_cb);
+		if (!ret) {
+			m2m_ctx->src_fence = fence;
+			spin_unlock_irqrestore(&q_ctx->rdy_spinlock, flags);
+			dprintk("Waiting for source fence of plane %u\n", plane);
+			return true;
+		}
+		/* -ENOENT: already signaled */
+		fence_put(fence);
+	}
+	spin_unlock_irqrestore(&q_ctx->rdy_spinlock, flags);
+
+	return false;
+}
+
+/**
+ * v4l2_m2m_cancel_src_fence() - drop a pending source fence callback
+ * @m2m_ctx:	m2m context
+ *
+ * Once this returns the fence work is not running anymore and no new one
+ * will be queued for the fence that was pending.
+ */
+static void v4l2_m2m_cancel_src_fence(struct v4l2_m2m_ctx *m2m_ctx)
+{
+	struct v4l2_m2m_dev *m2m_dev = m2m_ctx->m2m_dev;
+	struct fence *fence = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	if (m2m_ctx->src_fence &&
+	    fence_remove_callback(m2m_ctx->src_fence, &m2m_ctx->src_fence_cb)) {
+		fence = m2m_ctx->src_fence;
+		m2m_ctx->src_fence = NULL;
+	}
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+
+	if (fence)
+		fence_put(fence);
+
+	/*
+	 * If the callback could not be removed it has already run and queued
+	 * the work, which then owns the fence reference.
+	 */
+	flush_work(&m2m_ctx->src_fence_work);
+}
+
 /**
  * v4l2_m2m_try_schedule() - check whether an instance is ready to be added to
  * the pending job queue and add it if so.
@@ -207,6 +327,9 @@ static void v4l2_m2m_try_run(struct v4l2_m2m_dev *m2m_dev)
  * return 1 if the instance is ready.
  * An example of the above could be an instance that requires more than one
  * src/dst buffer per transaction.
+ *
+ * If the context waits for source fences (see v4l2_m2m_set_src_fence_wait()),
+ * the exclusive fences of the next source buffer have to be signaled as well.
  */
 void v4l2_m2m_try_schedule(struct v4l2_m2m_ctx *m2m_ctx)
 {
@@ -260,6 +383,12 @@ void v4l2_m2m_try_schedule(struct v4l2_m2m_ctx *m2m_ctx)
 	spin_unlock_irqrestore(&m2m_ctx->cap_q_ctx.rdy_spinlock, flags_cap);
 	spin_unlock_irqrestore(&m2m_ctx->out_q_ctx.rdy_spinlock, flags_out);
 
+	if (m2m_ctx->src_fence_wait && v4l2_m2m_src_fence_pending(m2m_ctx)) {
+		spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags_job);
+		dprintk("Input buffer not idle yet\n");
+		return;
+	}
+
 	if (m2m_dev->m2m_ops->job_ready
 		&& (!m2m_dev->m2m_ops->job_ready(m2m_ctx->priv))) {
 		spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags_job);
@@ -309,6 +438,8 @@ static void v4l2_m2m_cancel_job(struct v4l2_m2m_ctx *m2m_ctx)
 		/* Do nothing, was not on queue/running */
 		spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
 	}
+
+	v4l2_m2m_cancel_src_fence(m2m_ctx);
 }
 
 /**
@@ -724,6 +855,7 @@ struct v4l2_m2m_ctx *v4l2_m2m_ctx_init(struct v4l2_m2m_dev *m2m_dev,
 	spin_lock_init(&cap_q_ctx->rdy_spinlock);
 
 	INIT_LIST_HEAD(&m2m_ctx->queue);
+	INIT_WORK(&m2m_ctx->src_fence_work, v4l2_m2m_src_fence_work);
 
 	ret = queue_init(drv_priv, &out_q_ctx->q, &cap_q_ctx->q);
 
@@ -198,6 +198,23 @@ static const struct usb_descriptor_header * const uvc_ss_streaming[] = {
 	NULL,
 };
 
+/* Bulk streaming uses a single alternate setting with the endpoint. */
+static const struct usb_descriptor_header * const uvc_fs_bulk_streaming[] = {
+	(struct usb_descriptor_header *) &uvc_fs_streaming_ep,
+	NULL,
+};
+
+static const struct usb_descriptor_header * const uvc_hs_bulk_streaming[] = {
+	(struct usb_descriptor_header *) &uvc_hs_streaming_ep,
+	NULL,
+};
+
+static const struct usb_descriptor_header * const uvc_ss_bulk_streaming[] = {
+	(struct usb_descriptor_header *) &uvc_ss_streaming_ep,
+	(struct usb_descriptor_header *) &uvc_ss_streaming_comp,
+	NULL,
+};
+
 void uvc_set_trace_param(unsigned int trace)
 {
 	uvc_gadget_trace_param = trace;
@@ -224,6 +241,63 @@ uvc_function_ep0_complete(struct usb_ep *ep, struct usb_request *req)
 		memcpy(&uvc_event->data.data, req->buf, req->actual);
 		v4l2_event_queue(&uvc->vdev, &v4l2_event);
 	}
+
+	/* Bulk streaming has no alternate setting to select, the host starts
+	 * the stream by committing the streaming parameters. A new commit
+	 * while streaming restarts the stream with the new parameters.
+	 */
+	if (uvc->event_commit) {
+		uvc->event_commit = 0;
+
+		if (req->status < 0)
+			return;
+
+		if (uvc->state == UVC_STATE_STREAMING) {
+			memset(&v4l2_event, 0, sizeof(v4l2_event));
+			v4l2_event.type = UVC_EVENT_STREAMOFF;
+			v4l2_event_queue(&uvc->vdev, &v4l2_event);
+
+			uvc->state = UVC_STATE_CONNECTED;
+		}
+
+		if (uvc->state == UVC_STATE_CONNECTED) {
+			memset(&v4l2_event, 0, sizeof(v4l2_event));
+			v4l2_event.type = UVC_EVENT_STREAMON;
+			v4l2_event_queue(&uvc->vdev, &v4l2_event);
+		}
+	}
+}
+
+/*
+ * Hosts mimicking the Windows driver stop bulk streaming with a
+ * CLEAR_FEATURE(ENDPOINT_HALT) request to the streaming endpoint instead of
+ * selecting alternate setting 0. The request only reaches the function when
+ * the UDC driver doesn't handle it by itself.
+ */
+static int
+uvc_function_clear_halt(struct uvc_device *uvc)
+{
+	struct usb_composite_dev *cdev = uvc->func.config->cdev;
+	struct usb_request *req = uvc->control_req;
+	struct v4l2_event v4l2_event;
+
+	if (uvc->state == UVC_STATE_STREAMING) {
+		memset(&v4l2_event, 0, sizeof(v4l2_event));
+		v4l2_event.type = UVC_EVENT_STREAMOFF;
+		v4l2_event_queue(&uvc->vdev, &v4l2_event);
+
+		uvc->state = UVC_STATE_CONNECTED;
+	}
+
+	usb_ep_clear_halt(uvc->video.ep);
+
+	/* Complete the status stage, userspace doesn't see the request. */
+	uvc->event_setup_out = 0;
+	uvc->event_commit = 0;
+	req->length = 0;
+	req->zero = 0;
+
+	return usb_ep_queue(cdev->gadget->ep0, req, GFP_ATOMIC);
 }
 
 static int
@@ -233,6 +307,15 @@ uvc_function_setup(struct usb_function *f, const struct usb_ctrlrequest *ctrl)
 	struct v4l2_event v4l2_event;
 	struct uvc_event *uvc_event = (void *)&v4l2_event.u.data;
 
+	if (uvc->streaming_bulk && uvc->video.ep && uvc->video.ep->desc &&
+	    ctrl->bRequestType == (USB_DIR_OUT | USB_TYPE_STANDARD |
+				   USB_RECIP_ENDPOINT) &&
+	    ctrl->bRequest == USB_REQ_CLEAR_FEATURE &&
+	    le16_to_cpu(ctrl->wValue) == USB_ENDPOINT_HALT &&
+	    (le16_to_cpu(ctrl->wIndex) & 0xff) ==
+	    uvc->video.ep->desc->bEndpointAddress)
+		return uvc_function_clear_halt(uvc);
+
 	/* printk(KERN_INFO "setup request %02x %02x value %04x index %04x %04x\n",
 	 *	ctrl->bRequestType, ctrl->bRequest, le16_to_cpu(ctrl->wValue),
 	 *	le16_to_cpu(ctrl->wIndex), le16_to_cpu(ctrl->wLength));
@@ -252,6 +335,12 @@ uvc_function_setup(struct usb_function *f, const struct usb_ctrlrequest *ctrl)
 	 */
 	uvc->event_setup_out = !(ctrl->bRequestType & USB_DIR_IN);
 	uvc->event_length = le16_to_cpu(ctrl->wLength);
+	uvc->event_commit = uvc->streaming_bulk &&
+		ctrl->bRequestType == (USB_DIR_OUT | USB_TYPE_CLASS |
+				       USB_RECIP_INTERFACE) &&
+		ctrl->bRequest == UVC_SET_CUR &&
+		(le16_to_cpu(ctrl->wIndex) & 0xff) == uvc->streaming_intf &&
+		(le16_to_cpu(ctrl->wValue) >> 8) == UVC_VS_COMMIT_CONTROL;
 
 	memset(&v4l2_event, 0, sizeof(v4l2_event));
 	v4l2_event.type = UVC_EVENT_SETUP;
@@ -279,6 +368,8 @@ uvc_function_get_alt(struct usb_function *f, unsigned interface)
 		return 0;
 	else if (interface != uvc->streaming_intf)
 		return -EINVAL;
+	else if (uvc->streaming_bulk)
+		return 0;
 	else
 		return uvc->video.ep->enabled ? 1 : 0;
 }
@@ -322,10 +413,33 @@ uvc_function_set_alt(struct usb_function *f, unsigned interface, unsigned alt)
 	if (interface != uvc->streaming_intf)
 		return -EINVAL;
 
-	/* TODO
-	if (usb_endpoint_xfer_bulk(&uvc->desc.vs_ep))
-		return alt ? -EINVAL : 0;
-	*/
+	if (uvc->streaming_bulk) {
+		if (alt)
+			return -EINVAL;
+
+		/* The bulk endpoint belongs to the only alternate setting,
+		 * selecting it stops the stream.
+		 */
+		if (uvc->state == UVC_STATE_STREAMING) {
+			memset(&v4l2_event, 0, sizeof(v4l2_event));
+			v4l2_event.type = UVC_EVENT_STREAMOFF;
+			v4l2_event_queue(&uvc->vdev, &v4l2_event);
+
+			uvc->state = UVC_STATE_CONNECTED;
+		}
+
+		if (!uvc->video.ep)
+			return -EINVAL;
+
+		usb_ep_disable(uvc->video.ep);
+
+		ret = config_ep_by_speed(f->config->cdev->gadget,
+				&(uvc->func), uvc->video.ep);
+		if (ret)
+			return ret;
+
+		return usb_ep_enable(uvc->video.ep);
+	}
 
 	switch (alt) {
 	case 0:
@@ -471,20 +585,26 @@ uvc_copy_descriptors(struct uvc_device *uvc, enum usb_device_speed speed)
 	case USB_SPEED_SUPER:
 		uvc_control_desc = uvc->desc.ss_control;
 		uvc_streaming_cls = uvc->desc.ss_streaming;
-		uvc_streaming_std = uvc_ss_streaming;
+		uvc_streaming_std = uvc->streaming_bulk
+				  ? uvc_ss_bulk_streaming
+				  : uvc_ss_streaming;
 		break;
 
 	case USB_SPEED_HIGH:
 		uvc_control_desc = uvc->desc.fs_control;
 		uvc_streaming_cls = uvc->desc.hs_streaming;
-		uvc_streaming_std = uvc_hs_streaming;
+		uvc_streaming_std = uvc->streaming_bulk
+				  ? uvc_hs_bulk_streaming
+				  : uvc_hs_streaming;
 		break;
 
 	case USB_SPEED_FULL:
 	default:
 		uvc_control_desc = uvc->desc.fs_control;
 		uvc_streaming_cls = uvc->desc.fs_streaming;
-		uvc_streaming_std = uvc_fs_streaming;
+		uvc_streaming_std = uvc->streaming_bulk
+				  ? uvc_fs_bulk_streaming
+				  : uvc_fs_streaming;
 		break;
 	}
 
@@ -501,7 +621,7 @@ uvc_copy_descriptors(struct uvc_device *uvc, enum usb_device_speed speed)
 	 * uvc_ss_control_comp (for SS only)
 	 * uvc_streaming_intf_alt0
 	 * Class-specific UVC streaming descriptors
-	 * uvc_{fs|hs}_streaming
+	 * uvc_{fs|hs|ss}_streaming or uvc_{fs|hs|ss}_bulk_streaming
 	 */
 
 	/* Count descriptors and compute their size. */
@@ -593,6 +713,12 @@ uvc_function_bind(struct usb_configuration *c, struct usb_function *f)
 	opts->streaming_interval = clamp(opts->streaming_interval, 1U, 16U);
 	opts->streaming_maxpacket = clamp(opts->streaming_maxpacket, 1U, 3072U);
 	opts->streaming_maxburst = min(opts->streaming_maxburst, 15U);
+	opts->streaming_requests = clamp(opts->streaming_requests, 1U,
+					 UVC_MAX_STREAMING_REQUESTS);
+	if (opts->streaming_payload_size)
+		opts->streaming_payload_size =
+			clamp(opts->streaming_payload_size, 64U,
+			      UVC_MAX_STREAMING_PAYLOAD);
 
 	/* Fill in the FS/HS/SS Video Streaming specific descriptors from the
 	 * module parameters.
@@ -627,6 +753,35 @@ uvc_function_bind(struct usb_configuration *c, struct usb_function *f)
 		cpu_to_le16(max_packet_size * max_packet_mult *
 			    opts->streaming_maxburst);
 
+	/* Bulk endpoints use the maximum packet size mandated for their speed
+	 * and move the endpoint to the first alternate setting.
+	 */
+	uvc->streaming_bulk = opts->streaming_bulk;
+	uvc_streaming_intf_alt0.bNumEndpoints = opts->streaming_bulk ? 1 : 0;
+
+	if (opts->streaming_bulk) {
+		uvc_fs_streaming_ep.bmAttributes = USB_ENDPOINT_XFER_BULK;
+		uvc_fs_streaming_ep.wMaxPacketSize = cpu_to_le16(64);
+		uvc_fs_streaming_ep.bInterval = 0;
+
+		uvc_hs_streaming_ep.bmAttributes = USB_ENDPOINT_XFER_BULK;
+		uvc_hs_streaming_ep.wMaxPacketSize = cpu_to_le16(512);
+		uvc_hs_streaming_ep.bInterval = 0;
+
+		uvc_ss_streaming_ep.bmAttributes = USB_ENDPOINT_XFER_BULK;
+		uvc_ss_streaming_ep.wMaxPacketSize = cpu_to_le16(1024);
+		uvc_ss_streaming_ep.bInterval = 0;
+		uvc_ss_streaming_comp.bmAttributes = 0;
+		uvc_ss_streaming_comp.wBytesPerInterval = 0;
+	} else {
+		uvc_fs_streaming_ep.bmAttributes = USB_ENDPOINT_SYNC_ASYNC
+						 | USB_ENDPOINT_XFER_ISOC;
+		uvc_hs_streaming_ep.bmAttributes = USB_ENDPOINT_SYNC_ASYNC
+						 | USB_ENDPOINT_XFER_ISOC;
+		uvc_ss_streaming_ep.bmAttributes = USB_ENDPOINT_SYNC_ASYNC
+						 | USB_ENDPOINT_XFER_ISOC;
+	}
+
 	/* Allocate endpoints. */
 	ep = usb_ep_autoconfig(cdev->gadget, &uvc_control_ep);
 	if (!ep) {
@@ -720,17 +875,30 @@ uvc_function_bind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Initialise video. */
-	ret = uvcg_video_init(&uvc->video);
+	ret = uvcg_video_init(&uvc->video, cdev->gadget);
 	if (ret < 0)
 		goto error;
 
+	/* Bulk requests carry one payload each, the streaming control reported
+	 * by userspace must announce the same dwMaxPayloadTransferSize.
+	 */
+	uvc->video.num_requests = opts->streaming_requests;
+	uvc->video.max_req_size = opts->streaming_payload_size;
+	if (opts->streaming_bulk)
+		uvc->video.max_payload_size = opts->streaming_payload_size
+					    ? : UVC_DEFAULT_BULK_PAYLOAD;
+
 	/* Register a V4L2 device. */
 	ret = uvc_register_video(uvc);
 	if (ret < 0) {
 		printk(KERN_INFO "Unable to register video device\n");
+		uvcg_video_cleanup(&uvc->video);
 		goto error;
 	}
 
+	uvcg_video_debugfs_init(&uvc->video,
+				video_device_node_name(&uvc->vdev));
+
 	return 0;
 
 error:
@@ -839,6 +1007,7 @@ static struct usb_function_instance *uvc_alloc_inst(void)
 
 	opts->streaming_interval = 1;
 	opts->streaming_maxpacket = 1024;
+	opts->streaming_requests = UVC_NUM_REQUESTS;
 
 	uvcg_attach_configfs(opts);
 	return &opts->func_inst;
@@ -861,6 +1030,7 @@ static void uvc_unbind(struct usb_configuration *c, struct usb_function *f)
 	INFO(cdev, "%s\n", __func__);
 
 	video_unregister_device(&uvc->vdev);
+	uvcg_video_cleanup(&uvc->video);
 	v4l2_device_unregister(&uvc->v4l2_dev);
 
 	usb_ep_free_request(cdev->gadget->ep0, uvc->control_req);
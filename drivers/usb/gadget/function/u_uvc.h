@@ -21,6 +21,9 @@
 
 #define fi_to_f_uvc_opts(f)	container_of(f, struct f_uvc_opts, func_inst)
 
+#define UVC_MAX_STREAMING_REQUESTS	64U
+#define UVC_MAX_STREAMING_PAYLOAD	(256U * 1024U)
+
 struct f_uvc_opts {
 	struct usb_function_instance			func_inst;
 	unsigned int					uvc_gadget_trace_param;
@@ -28,6 +31,15 @@ struct f_uvc_opts {
 	unsigned int					streaming_maxpacket;
 	unsigned int					streaming_maxburst;
 
+	/*
+	 * Number of USB requests kept in flight, maximum payload size in bytes
+	 * (0 to derive it from the endpoint) and bulk streaming endpoint
+	 * instead of isochronous.
+	 */
+	unsigned int					streaming_requests;
+	unsigned int					streaming_payload_size;
+	unsigned int					streaming_bulk;
+
 	/*
 	 * Control descriptors array pointers for full-/high-speed and
 	 * super-speed. They point by default to the uvc_fs_control_cls and
@@ -96,7 +96,9 @@ extern unsigned int uvc_gadget_trace_param;
  * Driver specific constants
  */
 
-#define UVC_NUM_REQUESTS			4
+#define UVC_NUM_REQUESTS			16
+#define UVC_REQUEST_HEADER_LEN			2
+#define UVC_DEFAULT_BULK_PAYLOAD		(16 * 1024)
 #define UVC_MAX_REQUEST_SIZE			64
 #define UVC_MAX_EVENTS				4
 
@@ -104,6 +106,29 @@ extern unsigned int uvc_gadget_trace_param;
  * Structures
  */
 
+struct uvc_video;
+
+struct uvc_request
+{
+	struct usb_request *req;
+	__u8 *req_buffer;
+	struct uvc_video *video;
+
+	/* Scatter-gather list of the header and buffer data. */
+	struct scatterlist *sg;
+	unsigned int max_sgs;
+
+	/* Buffer to complete when the request completes. */
+	struct uvc_buffer *last_buf;
+};
+
+struct uvc_video_stats
+{
+	u64 bytes;
+	unsigned long requests;
+	unsigned long underruns;
+};
+
 struct uvc_video
 {
 	struct usb_ep *ep;
@@ -118,12 +143,23 @@ struct uvc_video
 
 	/* Requests */
 	unsigned int req_size;
-	struct usb_request *req[UVC_NUM_REQUESTS];
-	__u8 *req_buffer[UVC_NUM_REQUESTS];
+	unsigned int num_requests;
+	unsigned int max_req_size;	/* 0 to use the endpoint size */
+	struct uvc_request *ureq;
 	struct list_head req_free;
-	spinlock_t req_lock;
+	spinlock_t req_lock;	/* Protects req_free, enabled and stats */
+	bool enabled;
+	atomic_t req_inflight;
+
+	/* Statistics since the last stream start */
+	struct uvc_video_stats stats;
+	struct dentry *debugfs;
+
+	/* Requests are encoded and queued by the pump worker only. */
+	struct work_struct pump;
+	struct workqueue_struct *async_wq;
 
-	void (*encode) (struct usb_request *req, struct uvc_video *video,
+	void (*encode) (struct uvc_request *ureq, struct uvc_video *video,
 			struct uvc_buffer *buf);
 
 	/* Context data used by the completion handler */
@@ -164,10 +200,12 @@ struct uvc_device
 	void *control_buf;
 
 	unsigned int streaming_intf;
+	bool streaming_bulk;
 
 	/* Events */
 	unsigned int event_length;
 	unsigned int event_setup_out : 1;
+	unsigned int event_commit : 1;
 };
 
 static inline struct uvc_device *to_uvc(struct usb_function *f)
@@ -2255,6 +2255,11 @@ UVCG_OPTS_ATTR(streaming_maxpacket, le16_to_cpu, kstrtou16, u16, le16_to_cpu,
 	       3072);
 UVCG_OPTS_ATTR(streaming_maxburst, identity_conv, kstrtou8, u8, identity_conv,
 	       15);
+UVCG_OPTS_ATTR(streaming_requests, identity_conv, kstrtou8, u8, identity_conv,
+	       UVC_MAX_STREAMING_REQUESTS);
+UVCG_OPTS_ATTR(streaming_payload_size, identity_conv, kstrtou32, u32,
+	       identity_conv, UVC_MAX_STREAMING_PAYLOAD);
+UVCG_OPTS_ATTR(streaming_bulk, identity_conv, kstrtou8, u8, identity_conv, 1);
 
 #undef identity_conv
 
@@ -2264,6 +2269,9 @@ static struct configfs_attribute *uvc_attrs[] = {
 	&f_uvc_opts_attr_streaming_interval,
 	&f_uvc_opts_attr_streaming_maxpacket,
 	&f_uvc_opts_attr_streaming_maxburst,
+	&f_uvc_opts_attr_streaming_requests,
+	&f_uvc_opts_attr_streaming_payload_size,
+	&f_uvc_opts_attr_streaming_bulk,
 	NULL,
 };
 
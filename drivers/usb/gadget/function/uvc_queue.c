@@ -21,6 +21,7 @@
 #include <linux/wait.h>
 
 #include <media/v4l2-common.h>
+#include <media/videobuf2-dma-sg.h>
 #include <media/videobuf2-vmalloc.h>
 
 #include "uvc.h"
@@ -29,7 +30,7 @@
  * Video buffers queue management.
  *
  * Video queues is initialized by uvcg_queue_init(). The function performs
- * basic initialization of the uvc_video_queue struct and never fails.
+ * basic initialization of the uvc_video_queue struct.
  *
  * Video buffers are managed by videobuf2. The driver uses a mutex to protect
  * the videobuf2 queue operations by serializing calls to videobuf2 and a
@@ -54,6 +55,7 @@ static int uvc_queue_setup(struct vb2_queue *vq, const void *parg,
 	*nplanes = 1;
 
 	sizes[0] = video->imagesize;
+	alloc_ctxs[0] = queue->alloc_ctx;
 
 	return 0;
 }
@@ -76,6 +78,11 @@ static int uvc_buffer_prepare(struct vb2_buffer *vb)
 	buf->state = UVC_BUF_STATE_QUEUED;
 	buf->mem = vb2_plane_vaddr(vb, 0);
 	buf->length = vb2_plane_size(vb, 0);
+	if (queue->use_sg) {
+		buf->sgt = vb2_dma_sg_plane_desc(vb, 0);
+		buf->sg = buf->sgt->sgl;
+		buf->offset = 0;
+	}
 	if (vb->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
 		buf->bytesused = 0;
 	else
@@ -114,23 +121,44 @@ static struct vb2_ops uvc_queue_qops = {
 	.wait_finish = vb2_ops_wait_finish,
 };
 
-int uvcg_queue_init(struct uvc_video_queue *queue, enum v4l2_buf_type type,
-		    struct mutex *lock)
+/*
+ * Initialize the queue. When the UDC supports scatter-gather, buffers are
+ * allocated with the dma-sg allocator for the given device and USB requests
+ * transfer directly from them. Otherwise buffers are allocated with vmalloc
+ * and copied to the requests.
+ */
+int uvcg_queue_init(struct uvc_video_queue *queue, struct device *dev,
+		    enum v4l2_buf_type type, struct mutex *lock)
 {
 	int ret;
 
+	queue->use_sg = dev != NULL;
+	queue->alloc_ctx = NULL;
+
+	if (queue->use_sg) {
+		queue->alloc_ctx = vb2_dma_sg_init_ctx(dev);
+		if (IS_ERR(queue->alloc_ctx)) {
+			ret = PTR_ERR(queue->alloc_ctx);
+			queue->alloc_ctx = NULL;
+			return ret;
+		}
+	}
+
 	queue->queue.type = type;
 	queue->queue.io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF;
 	queue->queue.drv_priv = queue;
 	queue->queue.buf_struct_size = sizeof(struct uvc_buffer);
 	queue->queue.ops = &uvc_queue_qops;
 	queue->queue.lock = lock;
-	queue->queue.mem_ops = &vb2_vmalloc_memops;
+	queue->queue.mem_ops = queue->use_sg ? &vb2_dma_sg_memops
+					     : &vb2_vmalloc_memops;
 	queue->queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
 				     | V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
 	ret = vb2_queue_init(&queue->queue);
-	if (ret)
+	if (ret) {
+		uvcg_queue_cleanup(queue);
 		return ret;
+	}
 
 	spin_lock_init(&queue->irqlock);
 	INIT_LIST_HEAD(&queue->irqqueue);
@@ -139,6 +167,13 @@ int uvcg_queue_init(struct uvc_video_queue *queue, enum v4l2_buf_type type,
 	return 0;
 }
 
+void uvcg_queue_cleanup(struct uvc_video_queue *queue)
+{
+	if (queue->alloc_ctx)
+		vb2_dma_sg_cleanup_ctx(queue->alloc_ctx);
+	queue->alloc_ctx = NULL;
+}
+
 /*
  * Free the video buffers.
  */
@@ -245,6 +280,7 @@ void uvcg_queue_cancel(struct uvc_video_queue *queue, int disconnect)
 		list_del(&buf->queue);
 		buf->state = UVC_BUF_STATE_ERROR;
 		vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_ERROR);
+		queue->dropped++;
 	}
 	/* This must be protected by the irqlock spinlock to avoid race
 	 * conditions between uvc_queue_buffer and the disconnection event that
@@ -286,6 +322,8 @@ int uvcg_queue_enable(struct uvc_video_queue *queue, int enable)
 
 		queue->sequence = 0;
 		queue->buf_used = 0;
+		queue->frames = 0;
+		queue->dropped = 0;
 	} else {
 		ret = vb2_streamoff(&queue->queue, queue->queue.type);
 		if (ret < 0)
@@ -307,6 +345,23 @@ int uvcg_queue_enable(struct uvc_video_queue *queue, int enable)
 	return ret;
 }
 
+/*
+ * Return a buffer to userspace once all of its data has been transferred.
+ * Called with &queue_irqlock held.
+ */
+void uvcg_complete_buffer(struct uvc_video_queue *queue,
+			  struct uvc_buffer *buf)
+{
+	buf->state = UVC_BUF_STATE_DONE;
+	buf->buf.field = V4L2_FIELD_NONE;
+	buf->buf.sequence = queue->sequence++;
+	v4l2_get_timestamp(&buf->buf.timestamp);
+
+	vb2_set_plane_payload(&buf->buf.vb2_buf, 0, buf->bytesused);
+	vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_DONE);
+	queue->frames++;
+}
+
 /* called with &queue_irqlock held.. */
 struct uvc_buffer *uvcg_queue_next_buffer(struct uvc_video_queue *queue,
 					  struct uvc_buffer *buf)
@@ -317,6 +372,7 @@ struct uvc_buffer *uvcg_queue_next_buffer(struct uvc_video_queue *queue,
 	     buf->length != buf->bytesused) {
 		buf->state = UVC_BUF_STATE_QUEUED;
 		vb2_set_plane_payload(&buf->buf.vb2_buf, 0, 0);
+		queue->dropped++;
 		return buf;
 	}
 
@@ -327,12 +383,7 @@ struct uvc_buffer *uvcg_queue_next_buffer(struct uvc_video_queue *queue,
 	else
 		nextbuf = NULL;
 
-	buf->buf.field = V4L2_FIELD_NONE;
-	buf->buf.sequence = queue->sequence++;
-	v4l2_get_timestamp(&buf->buf.timestamp);
-
-	vb2_set_plane_payload(&buf->buf.vb2_buf, 0, buf->bytesused);
-	vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_DONE);
+	uvcg_complete_buffer(queue, buf);
 
 	return nextbuf;
 }
@@ -6,6 +6,7 @@
 #include <linux/kernel.h>
 #include <linux/poll.h>
 #include <linux/videodev2.h>
+#include <linux/scatterlist.h>
 #include <media/videobuf2-v4l2.h>
 
 /* Maximum frame size in bytes, for sanity checking. */
@@ -33,6 +34,11 @@ struct uvc_buffer {
 	void *mem;
 	unsigned int length;
 	unsigned int bytesused;
+
+	/* Scatter-gather position of the next byte to transfer. */
+	struct sg_table *sgt;
+	struct scatterlist *sg;
+	unsigned int offset;
 };
 
 #define UVC_QUEUE_DISCONNECTED		(1 << 0)
@@ -47,8 +53,16 @@ struct uvc_video_queue {
 
 	unsigned int buf_used;
 
-	spinlock_t irqlock;	/* Protects flags and irqqueue */
+	/* USB requests point directly to the buffers memory. */
+	bool use_sg;
+	void *alloc_ctx;
+
+	spinlock_t irqlock;	/* Protects flags, irqqueue and counters */
 	struct list_head irqqueue;
+
+	/* Frames completed and dropped since the queue was enabled */
+	unsigned long frames;
+	unsigned long dropped;
 };
 
 static inline int uvc_queue_streaming(struct uvc_video_queue *queue)
@@ -56,8 +70,10 @@ static inline int uvc_queue_streaming(struct uvc_video_queue *queue)
 	return vb2_is_streaming(&queue->queue);
 }
 
-int uvcg_queue_init(struct uvc_video_queue *queue, enum v4l2_buf_type type,
-		    struct mutex *lock);
+int uvcg_queue_init(struct uvc_video_queue *queue, struct device *dev,
+		    enum v4l2_buf_type type, struct mutex *lock);
+
+void uvcg_queue_cleanup(struct uvc_video_queue *queue);
 
 void uvcg_free_buffers(struct uvc_video_queue *queue);
 
@@ -85,6 +101,9 @@ void uvcg_queue_cancel(struct uvc_video_queue *queue, int disconnect);
 
 int uvcg_queue_enable(struct uvc_video_queue *queue, int enable);
 
+void uvcg_complete_buffer(struct uvc_video_queue *queue,
+			  struct uvc_buffer *buf);
+
 struct uvc_buffer *uvcg_queue_next_buffer(struct uvc_video_queue *queue,
 					  struct uvc_buffer *buf);
 
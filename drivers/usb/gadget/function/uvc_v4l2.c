@@ -177,7 +177,10 @@ uvc_v4l2_qbuf(struct file *file, void *fh, struct v4l2_buffer *b)
 	if (ret < 0)
 		return ret;
 
-	return uvcg_video_pump(video);
+	if (uvc->state == UVC_STATE_STREAMING)
+		queue_work(video->async_wq, &video->pump);
+
+	return 0;
 }
 
 static int
@@ -208,9 +211,11 @@ uvc_v4l2_streamon(struct file *file, void *fh, enum v4l2_buf_type type)
 
 	/*
 	 * Complete the alternate setting selection setup phase now that
-	 * userspace is ready to provide video frames.
+	 * userspace is ready to provide video frames. Bulk streaming is
+	 * started by a commit request that has already completed.
 	 */
-	uvc_function_setup_continue(uvc);
+	if (!uvc->streaming_bulk)
+		uvc_function_setup_continue(uvc);
 	uvc->state = UVC_STATE_STREAMING;
 
 	return 0;
@@ -11,8 +11,13 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
 #include <linux/usb/video.h>
@@ -58,10 +63,146 @@ uvc_video_encode_data(struct uvc_video *video, struct uvc_buffer *buf,
 	return nbytes;
 }
 
+/*
+ * Add video data to a request scatter-gather list, starting at entry nsgs,
+ * without copying it.
+ */
+static int
+uvc_video_encode_data_sg(struct uvc_video *video, struct uvc_request *ureq,
+		struct uvc_buffer *buf, unsigned int *nsgs, int len)
+{
+	struct uvc_video_queue *queue = &video->queue;
+	unsigned int remaining;
+	unsigned int nbytes = 0;
+
+	remaining = min((unsigned int)len, buf->bytesused - queue->buf_used);
+
+	while (remaining && buf->sg && *nsgs < ureq->max_sgs) {
+		unsigned int part = min(remaining, buf->sg->length - buf->offset);
+
+		sg_set_page(&ureq->sg[*nsgs], sg_page(buf->sg), part,
+			    buf->sg->offset + buf->offset);
+		(*nsgs)++;
+
+		buf->offset += part;
+		remaining -= part;
+		nbytes += part;
+
+		if (buf->offset == buf->sg->length) {
+			buf->sg = sg_next(buf->sg);
+			buf->offset = 0;
+		}
+	}
+
+	queue->buf_used += nbytes;
+
+	return nbytes;
+}
+
+/*
+ * Terminate a request scatter-gather list after nsgs entries.
+ */
+static void
+uvc_video_finish_sg(struct uvc_request *ureq, unsigned int nsgs)
+{
+	struct usb_request *req = ureq->req;
+
+	sg_mark_end(&ureq->sg[nsgs - 1]);
+	req->sg = ureq->sg;
+	req->num_sgs = nsgs;
+}
+
+/*
+ * Hand a fully transferred buffer over to the request that carries its last
+ * bytes. The buffer will be completed by the request completion handler, as
+ * the request still references its memory.
+ */
+static void
+uvc_video_release_buffer_sg(struct uvc_request *ureq, struct uvc_video *video,
+		struct uvc_buffer *buf)
+{
+	video->queue.buf_used = 0;
+	list_del(&buf->queue);
+	ureq->last_buf = buf;
+	video->fid ^= UVC_STREAM_FID;
+}
+
+static void
+uvc_video_encode_bulk_sg(struct uvc_request *ureq, struct uvc_video *video,
+		struct uvc_buffer *buf)
+{
+	struct usb_request *req = ureq->req;
+	unsigned int header_len = 0;
+	unsigned int nsgs = 0;
+	int len = video->req_size;
+	int ret;
+
+	sg_init_table(ureq->sg, ureq->max_sgs);
+
+	/* Add a header at the beginning of the payload. */
+	if (video->payload_size == 0) {
+		header_len = uvc_video_encode_header(video, buf,
+						     ureq->req_buffer, len);
+		sg_set_buf(&ureq->sg[nsgs++], ureq->req_buffer, header_len);
+		video->payload_size += header_len;
+		len -= header_len;
+	}
+
+	/* Process video data. */
+	len = min((int)(video->max_payload_size - video->payload_size), len);
+	ret = uvc_video_encode_data_sg(video, ureq, buf, &nsgs, len);
+
+	video->payload_size += ret;
+
+	if (nsgs)
+		uvc_video_finish_sg(ureq, nsgs);
+	else
+		req->num_sgs = 0;
+
+	req->length = header_len + ret;
+	req->zero = video->payload_size == video->max_payload_size;
+
+	if (buf->bytesused == video->queue.buf_used) {
+		uvc_video_release_buffer_sg(ureq, video, buf);
+		video->payload_size = 0;
+	}
+
+	if (video->payload_size == video->max_payload_size)
+		video->payload_size = 0;
+}
+
 static void
-uvc_video_encode_bulk(struct usb_request *req, struct uvc_video *video,
+uvc_video_encode_isoc_sg(struct uvc_request *ureq, struct uvc_video *video,
 		struct uvc_buffer *buf)
 {
+	struct usb_request *req = ureq->req;
+	unsigned int header_len;
+	unsigned int nsgs = 1;
+	int ret;
+
+	sg_init_table(ureq->sg, ureq->max_sgs);
+
+	/* Add the header. */
+	header_len = uvc_video_encode_header(video, buf, ureq->req_buffer,
+					     video->req_size);
+	sg_set_buf(&ureq->sg[0], ureq->req_buffer, header_len);
+
+	/* Process video data. */
+	ret = uvc_video_encode_data_sg(video, ureq, buf, &nsgs,
+				       video->req_size - header_len);
+
+	uvc_video_finish_sg(ureq, nsgs);
+	req->length = header_len + ret;
+
+	if (buf->bytesused == video->queue.buf_used)
+		uvc_video_release_buffer_sg(ureq, video, buf);
+}
+
+static void
+uvc_video_encode_bulk(struct uvc_request *ureq, struct uvc_video *video,
+		struct uvc_buffer *buf)
+{
+	struct usb_request *req = ureq->req;
 	void *mem = req->buf;
 	int len = video->req_size;
 	int ret;
@@ -99,9 +240,10 @@ uvc_video_encode_bulk(struct usb_request *req, struct uvc_video *video,
 }
 
 static void
-uvc_video_encode_isoc(struct usb_request *req, struct uvc_video *video,
+uvc_video_encode_isoc(struct uvc_request *ureq, struct uvc_video *video,
 		struct uvc_buffer *buf)
 {
+	struct usb_request *req = ureq->req;
 	void *mem = req->buf;
 	int len = video->req_size;
 	int ret;
@@ -130,43 +272,45 @@ uvc_video_encode_isoc(struct usb_request *req, struct uvc_video *video,
  */
 
 /*
- * I somehow feel that synchronisation won't be easy to achieve here. We have
- * three events that control USB requests submission:
+ * Three events control USB requests submission:
  *
- * - USB request completion: the completion handler will resubmit the request
- *   if a video buffer is available.
+ * - USB request completion: the completion handler returns the request to the
+ *   free list and schedules the pump worker.
  *
- * - USB interface setting selection: in response to a SET_INTERFACE request,
- *   the handler will start streaming if a video buffer is available and if
- *   video is not currently streaming.
+ * - USB interface setting selection and V4L2 streamon: the requests are
+ *   allocated and the pump worker is scheduled.
  *
- * - V4L2 buffer queueing: the driver will start streaming if video is not
- *   currently streaming.
+ * - V4L2 buffer queueing: the pump worker is scheduled if video is streaming.
  *
- * Race conditions between those 3 events might lead to deadlocks or other
- * nasty side effects.
+ * Only the pump worker encodes and queues requests, which serializes access
+ * to the encoding state. The worker takes all free requests in one go, and
+ * fills them under a single hold of the queue irqlock.
  *
  * The "video currently streaming" condition can't be detected by the irqqueue
  * being empty, as a request can still be in flight. A separate "queue paused"
- * flag is thus needed.
+ * flag is thus needed. It is set when the pump finds the irqqueue empty, and
+ * cleared when a buffer is queued.
  *
- * The paused flag will be set when we try to retrieve the irqqueue head if the
- * queue is empty, and cleared when we queue a buffer.
+ * When requests point to the buffers memory, a buffer is only completed once
+ * the request carrying its last bytes has completed. Requests complete in
+ * order, so all of the buffer data has then been transferred.
  *
- * The USB request completion handler will get the buffer at the irqqueue head
- * under protection of the queue spinlock. If the queue is empty, the streaming
- * paused flag will be set. Right after releasing the spinlock a userspace
- * application can queue a buffer. The flag will then cleared, and the ioctl
- * handler will restart the video stream.
+ * An underrun is recorded when a request completes successfully while no
+ * other request is queued to the UDC. The endpoint then sits idle until the
+ * pump catches up, which shows up on the host as missed isochronous intervals
+ * or stalled bulk transfers.
  */
 static void
 uvc_video_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct uvc_video *video = req->context;
+	struct uvc_request *ureq = req->context;
+	struct uvc_video *video = ureq->video;
 	struct uvc_video_queue *queue = &video->queue;
-	struct uvc_buffer *buf;
+	struct uvc_buffer *last_buf;
 	unsigned long flags;
-	int ret;
+	bool idle;
+
+	idle = atomic_dec_and_test(&video->req_inflight);
 
 	switch (req->status) {
 	case 0:
@@ -175,38 +319,42 @@ uvc_video_complete(struct usb_ep *ep, struct usb_request *req)
 	case -ESHUTDOWN:	/* disconnect from host. */
 		printk(KERN_DEBUG "VS request cancelled.\n");
 		uvcg_queue_cancel(queue, 1);
-		goto requeue;
+		break;
 
 	default:
 		printk(KERN_INFO "VS request completed with status %d.\n",
 			req->status);
 		uvcg_queue_cancel(queue, 0);
-		goto requeue;
-	}
-
-	spin_lock_irqsave(&video->queue.irqlock, flags);
-	buf = uvcg_queue_head(&video->queue);
-	if (buf == NULL) {
-		spin_unlock_irqrestore(&video->queue.irqlock, flags);
-		goto requeue;
+		break;
 	}
 
-	video->encode(req, video, buf);
+	last_buf = ureq->last_buf;
+	ureq->last_buf = NULL;
 
-	if ((ret = usb_ep_queue(ep, req, GFP_ATOMIC)) < 0) {
-		printk(KERN_INFO "Failed to queue request (%d).\n", ret);
-		usb_ep_set_halt(ep);
-		spin_unlock_irqrestore(&video->queue.irqlock, flags);
-		uvcg_queue_cancel(queue, 0);
-		goto requeue;
+	if (last_buf) {
+		spin_lock_irqsave(&queue->irqlock, flags);
+		if (req->status == 0) {
+			uvcg_complete_buffer(queue, last_buf);
+		} else {
+			last_buf->state = UVC_BUF_STATE_ERROR;
+			vb2_buffer_done(&last_buf->buf.vb2_buf,
+					VB2_BUF_STATE_ERROR);
+			queue->dropped++;
+		}
+		spin_unlock_irqrestore(&queue->irqlock, flags);
 	}
-	spin_unlock_irqrestore(&video->queue.irqlock, flags);
 
-	return;
-
-requeue:
 	spin_lock_irqsave(&video->req_lock, flags);
 	list_add_tail(&req->list, &video->req_free);
+	if (req->status == 0) {
+		video->stats.requests++;
+		video->stats.bytes += req->actual;
+	}
+	if (video->enabled && req->status == 0) {
+		if (idle)
+			video->stats.underruns++;
+		queue_work(video->async_wq, &video->pump);
+	}
 	spin_unlock_irqrestore(&video->req_lock, flags);
 }
 
@@ -215,16 +363,19 @@ uvc_video_free_requests(struct uvc_video *video)
 {
 	unsigned int i;
 
-	for (i = 0; i < UVC_NUM_REQUESTS; ++i) {
-		if (video->req[i]) {
-			usb_ep_free_request(video->ep, video->req[i]);
-			video->req[i] = NULL;
-		}
+	if (video->ureq) {
+		for (i = 0; i < video->num_requests; ++i) {
+			struct uvc_request *ureq = &video->ureq[i];
+
+			if (ureq->req)
+				usb_ep_free_request(video->ep, ureq->req);
 
-		if (video->req_buffer[i]) {
-			kfree(video->req_buffer[i]);
-			video->req_buffer[i] = NULL;
+			kfree(ureq->req_buffer);
+			kfree(ureq->sg);
 		}
+
+		kfree(video->ureq);
+		video->ureq = NULL;
 	}
 
 	INIT_LIST_HEAD(&video->req_free);
@@ -235,31 +386,67 @@ uvc_video_free_requests(struct uvc_video *video)
 static int
 uvc_video_alloc_requests(struct uvc_video *video)
 {
+	unsigned int buffer_size;
 	unsigned int req_size;
+	unsigned int max_sgs;
 	unsigned int i;
 	int ret = -ENOMEM;
 
 	BUG_ON(video->req_size);
 
-	req_size = video->ep->maxpacket
-		 * max_t(unsigned int, video->ep->maxburst, 1)
-		 * (video->ep->mult + 1);
+	/* Bulk requests carry a whole payload each. Isochronous requests are
+	 * sent once per service interval and can't exceed the endpoint
+	 * bandwidth.
+	 */
+	if (video->max_payload_size) {
+		req_size = video->max_payload_size;
+	} else {
+		req_size = video->ep->maxpacket
+			 * max_t(unsigned int, video->ep->maxburst, 1)
+			 * (video->ep->mult + 1);
+		if (video->max_req_size)
+			req_size = min(req_size, video->max_req_size);
+	}
+
+	/* With scatter-gather, the request buffer only holds the header. The
+	 * data spans at most one more page than its size in pages, plus one
+	 * entry for the header.
+	 */
+	buffer_size = video->queue.use_sg ? UVC_REQUEST_HEADER_LEN : req_size;
+	max_sgs = DIV_ROUND_UP(req_size, PAGE_SIZE) + 2;
 
-	for (i = 0; i < UVC_NUM_REQUESTS; ++i) {
-		video->req_buffer[i] = kmalloc(req_size, GFP_KERNEL);
-		if (video->req_buffer[i] == NULL)
+	video->ureq = kcalloc(video->num_requests, sizeof(*video->ureq),
+			      GFP_KERNEL);
+	if (video->ureq == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < video->num_requests; ++i) {
+		struct uvc_request *ureq = &video->ureq[i];
+
+		ureq->video = video;
+
+		ureq->req_buffer = kmalloc(buffer_size, GFP_KERNEL);
+		if (ureq->req_buffer == NULL)
 			goto error;
 
-		video->req[i] = usb_ep_alloc_request(video->ep, GFP_KERNEL);
-		if (video->req[i] == NULL)
+		if (video->queue.use_sg) {
+			ureq->sg = kmalloc_array(max_sgs, sizeof(*ureq->sg),
+						 GFP_KERNEL);
+			if (ureq->sg == NULL)
+				goto error;
+			ureq->max_sgs = max_sgs;
+		}
+
+		ureq->req = usb_ep_alloc_request(video->ep, GFP_KERNEL);
+		if (ureq->req == NULL)
 			goto error;
 
-		video->req[i]->buf = video->req_buffer[i];
-		video->req[i]->length = 0;
-		video->req[i]->complete = uvc_video_complete;
-		video->req[i]->context = video;
+		ureq->req->buf = ureq->req_buffer;
+		ureq->req->length = 0;
+		ureq->req->complete = uvc_video_complete;
+		ureq->req->context = ureq;
 
-		list_add_tail(&video->req[i]->list, &video->req_free);
+		list_add_tail(&ureq->req->list, &video->req_free);
 	}
 
 	video->req_size = req_size;
@@ -278,63 +465,70 @@ error:
 /*
  * uvcg_video_pump - Pump video data into the USB requests
  *
- * This function fills the available USB requests (listed in req_free) with
+ * This worker fills the available USB requests (listed in req_free) with
  * video data from the queued buffers.
  */
-int uvcg_video_pump(struct uvc_video *video)
+static void uvcg_video_pump(struct work_struct *work)
 {
+	struct uvc_video *video = container_of(work, struct uvc_video, pump);
 	struct uvc_video_queue *queue = &video->queue;
-	struct usb_request *req;
+	struct usb_request *req, *tmp;
+	struct uvc_request *ureq;
 	struct uvc_buffer *buf;
 	unsigned long flags;
+	LIST_HEAD(reqs);
 	int ret;
 
-	/* FIXME TODO Race between uvcg_video_pump and requests completion
-	 * handler ???
+	/* Retrieve all available USB requests, protected by the request
+	 * lock.
 	 */
+	spin_lock_irqsave(&video->req_lock, flags);
+	if (video->enabled)
+		list_splice_init(&video->req_free, &reqs);
+	spin_unlock_irqrestore(&video->req_lock, flags);
 
-	while (1) {
-		/* Retrieve the first available USB request, protected by the
-		 * request lock.
-		 */
-		spin_lock_irqsave(&video->req_lock, flags);
-		if (list_empty(&video->req_free)) {
-			spin_unlock_irqrestore(&video->req_lock, flags);
-			return 0;
-		}
-		req = list_first_entry(&video->req_free, struct usb_request,
-					list);
-		list_del(&req->list);
-		spin_unlock_irqrestore(&video->req_lock, flags);
+	if (list_empty(&reqs))
+		return;
 
-		/* Retrieve the first available video buffer and fill the
-		 * request, protected by the video queue irqlock.
-		 */
-		spin_lock_irqsave(&queue->irqlock, flags);
+	/* Fill the requests from the available video buffers and queue them,
+	 * protected by the video queue irqlock.
+	 */
+	spin_lock_irqsave(&queue->irqlock, flags);
+	list_for_each_entry_safe(req, tmp, &reqs, list) {
 		buf = uvcg_queue_head(queue);
-		if (buf == NULL) {
-			spin_unlock_irqrestore(&queue->irqlock, flags);
+		if (buf == NULL)
 			break;
-		}
 
-		video->encode(req, video, buf);
+		ureq = req->context;
+		video->encode(ureq, video, buf);
 
 		/* Queue the USB request */
+		list_del(&req->list);
+		atomic_inc(&video->req_inflight);
 		ret = usb_ep_queue(video->ep, req, GFP_ATOMIC);
 		if (ret < 0) {
 			printk(KERN_INFO "Failed to queue request (%d)\n", ret);
+			atomic_dec(&video->req_inflight);
 			usb_ep_set_halt(video->ep);
+			list_add(&req->list, &reqs);
+			if (ureq->last_buf) {
+				ureq->last_buf->state = UVC_BUF_STATE_ERROR;
+				vb2_buffer_done(&ureq->last_buf->buf.vb2_buf,
+						VB2_BUF_STATE_ERROR);
+				ureq->last_buf = NULL;
+				queue->dropped++;
+			}
 			spin_unlock_irqrestore(&queue->irqlock, flags);
 			uvcg_queue_cancel(queue, 0);
-			break;
+			goto done;
 		}
-		spin_unlock_irqrestore(&queue->irqlock, flags);
 	}
+	spin_unlock_irqrestore(&queue->irqlock, flags);
 
+done:
 	spin_lock_irqsave(&video->req_lock, flags);
-	list_add_tail(&req->list, &video->req_free);
+	list_splice_tail(&reqs, &video->req_free);
 	spin_unlock_irqrestore(&video->req_lock, flags);
-	return 0;
 }
 
 /*
@@ -342,6 +536,7 @@ int uvcg_video_pump(struct uvc_video *video)
  */
 int uvcg_video_enable(struct uvc_video *video, int enable)
 {
+	unsigned long flags;
 	unsigned int i;
 	int ret;
 
@@ -352,9 +547,21 @@ int uvcg_video_enable(struct uvc_video *video, int enable)
 	}
 
 	if (!enable) {
-		for (i = 0; i < UVC_NUM_REQUESTS; ++i)
-			if (video->req[i])
-				usb_ep_dequeue(video->ep, video->req[i]);
+		/* Stop the pump before dequeuing the requests, to make sure
+		 * they can't be queued again.
+		 */
+		spin_lock_irqsave(&video->req_lock, flags);
+		video->enabled = false;
+		spin_unlock_irqrestore(&video->req_lock, flags);
+
+		cancel_work_sync(&video->pump);
+
+		if (video->ureq) {
+			for (i = 0; i < video->num_requests; ++i)
+				if (video->ureq[i].req)
+					usb_ep_dequeue(video->ep,
+						       video->ureq[i].req);
+		}
 
 		uvc_video_free_requests(video);
 		uvcg_queue_enable(&video->queue, 0);
@@ -368,21 +575,40 @@ int uvcg_video_enable(struct uvc_video *video, int enable)
 		return ret;
 
 	if (video->max_payload_size) {
-		video->encode = uvc_video_encode_bulk;
+		video->encode = video->queue.use_sg ? uvc_video_encode_bulk_sg
+						    : uvc_video_encode_bulk;
 		video->payload_size = 0;
 	} else
-		video->encode = uvc_video_encode_isoc;
+		video->encode = video->queue.use_sg ? uvc_video_encode_isoc_sg
+						    : uvc_video_encode_isoc;
+
+	spin_lock_irqsave(&video->req_lock, flags);
+	memset(&video->stats, 0, sizeof(video->stats));
+	atomic_set(&video->req_inflight, 0);
+	video->enabled = true;
+	spin_unlock_irqrestore(&video->req_lock, flags);
 
-	return uvcg_video_pump(video);
+	queue_work(video->async_wq, &video->pump);
+	return 0;
 }
 
 /*
  * Initialize the UVC video stream.
  */
-int uvcg_video_init(struct uvc_video *video)
+int uvcg_video_init(struct uvc_video *video, struct usb_gadget *gadget)
 {
+	int ret;
+
 	INIT_LIST_HEAD(&video->req_free);
 	spin_lock_init(&video->req_lock);
+	INIT_WORK(&video->pump, uvcg_video_pump);
+
+	video->async_wq = alloc_workqueue("uvcgadget", WQ_UNBOUND | WQ_HIGHPRI,
+					  0);
+	if (video->async_wq == NULL)
+		return -ENOMEM;
+
+	video->num_requests = UVC_NUM_REQUESTS;
 
 	video->fcc = V4L2_PIX_FMT_YUYV;
 	video->bpp = 16;
@@ -390,9 +616,96 @@ int uvcg_video_init(struct uvc_video *video)
 	video->height = 240;
 	video->imagesize = 320 * 240 * 2;
 
-	/* Initialize the video buffers queue. */
-	uvcg_queue_init(&video->queue, V4L2_BUF_TYPE_VIDEO_OUTPUT,
-			&video->mutex);
+	/* Initialize the video buffers queue. Requests point directly to the
+	 * buffers memory if the UDC supports scatter-gather.
+	 */
+	ret = uvcg_queue_init(&video->queue,
+			      gadget->sg_supported ? gadget->dev.parent : NULL,
+			      V4L2_BUF_TYPE_VIDEO_OUTPUT, &video->mutex);
+	if (ret < 0) {
+		destroy_workqueue(video->async_wq);
+		video->async_wq = NULL;
+		return ret;
+	}
+
 	return 0;
 }
 
+void uvcg_video_cleanup(struct uvc_video *video)
+{
+	debugfs_remove_recursive(video->debugfs);
+	video->debugfs = NULL;
+
+	if (video->async_wq)
+		destroy_workqueue(video->async_wq);
+	video->async_wq = NULL;
+
+	uvcg_queue_cleanup(&video->queue);
+}
+
+/* --------------------------------------------------------------------------
+ * debugfs
+ */
+
+static int uvcg_video_stats_show(struct seq_file *s, void *unused)
+{
+	struct uvc_video *video = s->private;
+	struct uvc_video_queue *queue = &video->queue;
+	struct uvc_video_stats stats;
+	unsigned long frames, dropped;
+	unsigned long flags;
+
+	spin_lock_irqsave(&video->req_lock, flags);
+	stats = video->stats;
+	spin_unlock_irqrestore(&video->req_lock, flags);
+
+	spin_lock_irqsave(&queue->irqlock, flags);
+	frames = queue->frames;
+	dropped = queue->dropped;
+	spin_unlock_irqrestore(&queue->irqlock, flags);
+
+	seq_printf(s, "requests:     %u x %u bytes\n", video->num_requests,
+		   video->req_size);
+	seq_printf(s, "transfer:     %s\n",
+		   video->max_payload_size ? "bulk" : "isochronous");
+	seq_printf(s, "in flight:    %d\n", atomic_read(&video->req_inflight));
+	seq_printf(s, "completed:    %lu\n", stats.requests);
+	seq_printf(s, "bytes:        %llu\n", stats.bytes);
+	seq_printf(s, "underruns:    %lu\n", stats.underruns);
+	seq_printf(s, "frames:       %lu\n", frames);
+	seq_printf(s, "dropped:      %lu\n", dropped);
+
+	return 0;
+}
+
+static int uvcg_video_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, uvcg_video_stats_show, inode->i_private);
+}
+
+static const struct file_operations uvcg_video_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= uvcg_video_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Expose the streaming statistics in debugfs, in a uvc-gadget.<name>
+ * directory. Failures are not fatal.
+ */
+void uvcg_video_debugfs_init(struct uvc_video *video, const char *name)
+{
+	char dir_name[32];
+	struct dentry *dir;
+
+	snprintf(dir_name, sizeof(dir_name), "uvc-gadget.%s", name);
+
+	dir = debugfs_create_dir(dir_name, NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_file("stats", 0444, dir, video, &uvcg_video_stats_fops);
+	video->debugfs = dir;
+}
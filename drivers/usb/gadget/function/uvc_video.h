@@ -15,10 +15,14 @@
 #ifndef __UVC_VIDEO_H__
 #define __UVC_VIDEO_H__
 
-int uvcg_video_pump(struct uvc_video *video);
+struct usb_gadget;
 
 int uvcg_video_enable(struct uvc_video *video, int enable);
 
-int uvcg_video_init(struct uvc_video *video);
+int uvcg_video_init(struct uvc_video *video, struct usb_gadget *gadget);
+
+void uvcg_video_cleanup(struct uvc_video *video);
+
+void uvcg_video_debugfs_init(struct uvc_video *video, const char *name);
 
 #endif /* __UVC_VIDEO_H__ */
@@ -189,4 +189,8 @@ const struct v4l2_frmsize_discrete *v4l2_find_nearest_format(
 
 void v4l2_get_timestamp(struct timeval *tv);
 
+size_t v4l2_field_weave(void *frame, size_t size, unsigned int bytesperline,
+			bool interlaced, bool bottom, size_t pos,
+			const void *src, size_t len);
+
 #endif /* V4L2_COMMON_H_ */
@@ -64,6 +64,8 @@ struct v4l2_file_operations {
 	struct module *owner;
 	ssize_t (*read) (struct file *, char __user *, size_t, loff_t *);
 	ssize_t (*write) (struct file *, const char __user *, size_t, loff_t *);
+	ssize_t (*splice_read) (struct file *, loff_t *,
+				struct pipe_inode_info *, size_t, unsigned int);
 	unsigned int (*poll) (struct file *, struct poll_table_struct *);
 	long (*unlocked_ioctl) (struct file *, unsigned int, unsigned long);
 #ifdef CONFIG_COMPAT
@@ -215,6 +217,7 @@ static inline void video_set_drvdata(struct video_device *vdev, void *data)
 }
 
 struct video_device *video_devdata(struct file *file);
+struct video_device *video_devdata_checked(struct file *file);
 
 /* Combine video_get_drvdata and video_devdata as this is
    used very often. */
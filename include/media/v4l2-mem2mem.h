@@ -17,6 +17,8 @@
 #ifndef _MEDIA_V4L2_MEM2MEM_H
 #define _MEDIA_V4L2_MEM2MEM_H
 
+#include <linux/fence.h>
+#include <linux/workqueue.h>
 #include <media/videobuf2-v4l2.h>
 
 /**
@@ -85,6 +87,13 @@ struct v4l2_m2m_ctx {
 	unsigned long			job_flags;
 	wait_queue_head_t		finished;
 
+	/* Wait for implicit fences on imported source buffers */
+	bool				src_fence_wait;
+	/* Exclusive fence the next source buffer is waiting on */
+	struct fence			*src_fence;
+	struct fence_cb			src_fence_cb;
+	struct work_struct		src_fence_work;
+
 	/* Instance private data */
 	void				*priv;
 };
@@ -158,6 +167,23 @@ static inline void v4l2_m2m_set_dst_buffered(struct v4l2_m2m_ctx *m2m_ctx,
 	m2m_ctx->cap_q_ctx.buffered = buffered;
 }
 
+/**
+ * v4l2_m2m_set_src_fence_wait() - defer jobs until source DMABUFs are idle
+ *
+ * @m2m_ctx: pointer to struct v4l2_m2m_ctx
+ * @wait: if true, a job is only scheduled once the exclusive fence attached
+ *	  to every plane of the next source buffer has signaled
+ *
+ * Only buffers imported with V4L2_MEMORY_DMABUF carry fences, other memory
+ * types are scheduled as before. Waiting is done with fence callbacks, so
+ * neither QBUF nor the scheduler ever block on the producer.
+ */
+static inline void v4l2_m2m_set_src_fence_wait(struct v4l2_m2m_ctx *m2m_ctx,
+					       bool wait)
+{
+	m2m_ctx->src_fence_wait = wait;
+}
+
 void v4l2_m2m_ctx_release(struct v4l2_m2m_ctx *m2m_ctx);
 
 void v4l2_m2m_buf_queue(struct v4l2_m2m_ctx *m2m_ctx,
@@ -67,4 +67,37 @@ struct uvc_xu_control_query {
 #define UVCIOC_CTRL_MAP		_IOWR('u', 0x20, struct uvc_xu_control_mapping)
 #define UVCIOC_CTRL_QUERY	_IOWR('u', 0x21, struct uvc_xu_control_query)
 
+/*
+ * Frame progress events
+ *
+ * The event id selects the notification interval in bytes, 0 notifies every
+ * time new data is available. The payload is stored in the event data as a
+ * struct uvc_frame_progress.
+ */
+#define UVC_EVENT_FRAME_PROGRESS	(V4L2_EVENT_PRIVATE_START + 0)
+
+struct uvc_frame_progress {
+	__u32 index;		/* Index of the buffer being filled */
+	__u32 sequence;		/* Sequence number of the frame */
+	__u32 bytesused;	/* Number of bytes available in the buffer */
+	__u32 reserved[5];
+};
+
+/*
+ * Payload header metadata
+ *
+ * Buffers of the V4L2_META_FMT_UVC format contain a sequence of variable
+ * length entries, one per payload header received for the frame. Headers
+ * carrying the same SCR value as the previous header are skipped, headers
+ * without an SCR are always recorded. Entries contain the standard header
+ * fields only.
+ */
+struct uvc_meta_buf {
+	__u64 ns;		/* System timestamp in ns when received */
+	__u16 sof;		/* USB frame number when received */
+	__u8 length;		/* bHeaderLength */
+	__u8 flags;		/* bmHeaderInfo */
+	__u8 buf[];		/* Rest of the payload header */
+} __attribute__((__packed__));
+
 #endif
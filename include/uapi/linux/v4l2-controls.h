@@ -178,6 +178,10 @@ enum v4l2_colorfx {
  * We reserve 16 controls for this driver. */
 #define V4L2_CID_USER_TC358743_BASE		(V4L2_CID_USER_BASE + 0x1080)
 
+/* The base for the vaggr driver controls. See linux/vaggr.h for the list
+ * of controls. We reserve 16 controls for this driver. */
+#define V4L2_CID_USER_VAGGR_BASE		(V4L2_CID_USER_BASE + 0x1090)
+
 /* MPEG-class control IDs */
 /* The MPEG controls are applicable to all codec controls
  * and the 'MPEG' part of the define is historical */
@@ -0,0 +1,48 @@
+/*
+ * vaggr.h - Aggregate capture device for synchronized grabbers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef __LINUX_VAGGR_H_
+#define __LINUX_VAGGR_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+#define VAGGR_MAX_MEMBERS		16
+
+/* Controls */
+
+/* Maximum timestamp distance between the frames of a set, in microseconds */
+#define V4L2_CID_VAGGR_TOLERANCE	(V4L2_CID_USER_VAGGR_BASE + 0)
+
+/* Frame of a member device */
+struct vaggr_frame {
+	__u32	index;		/* buffer index in the member queue */
+	__u32	bytesused;
+	__u32	sequence;
+	__u32	flags;		/* V4L2_BUF_FLAG_* of the member buffer */
+	__u64	timestamp;	/* nanoseconds, CLOCK_MONOTONIC */
+};
+
+struct vaggr_set {
+	__u32	count;		/* number of members */
+	__u32	reserved[3];
+	struct vaggr_frame frames[VAGGR_MAX_MEMBERS];
+};
+
+struct vaggr_member {
+	__s32	fd;		/* open capture device node */
+	__u32	reserved[3];
+};
+
+#define VAGGR_IOC_ADD_MEMBER	_IOW('V', BASE_VIDIOC_PRIVATE + 0, \
+				     struct vaggr_member)
+#define VAGGR_IOC_CLEAR_MEMBERS	_IO('V', BASE_VIDIOC_PRIVATE + 1)
+
+#endif